@@ -0,0 +1,35 @@
+#version 330 core
+
+// This shader writes the surface of the lit objects to the G-buffer of the deferred renderer (it is used with "light.vert").
+// It reads the same material as "light.frag", but instead of lighting the fragment, it stores what the lighting pass
+// ("deferred/lighting.frag") needs to light it later: the colors of the surface & its normal (its position is found from the depth).
+
+// The "Frame" block & the "Material" struct are shared with "light.frag"
+#include "../light.glsl"
+
+uniform vec4 tint;
+uniform sampler2D tex;
+uniform Material material;
+
+in Varyings {
+    vec4 color;
+    vec2 tex_coord;
+    vec3 world;
+    vec3 view;
+    vec3 normal;
+} fs_in;
+
+// The targets of the G-buffer (see "DeferredRenderer")
+layout(location = 0) out vec4 accumulated_light; // The lighting pass adds the lights to the ambient light written here
+layout(location = 1) out vec4 diffuse;           // The surface color multiplied by the diffuse color of the material
+layout(location = 2) out vec4 specular;          // The surface color multiplied by the specular color of the material (and the shininess in alpha)
+layout(location = 3) out vec4 normal;            // The normal in the world space
+
+void main() {
+    // The surface color is the factor that "light.frag" applies to the accumulated light
+    vec3 albedo = (tint * fs_in.color * texture(tex, fs_in.tex_coord)).rgb;
+    accumulated_light = vec4(albedo * material.ambient * ambient_light, 1.0);
+    diffuse = vec4(albedo * material.diffuse, 1.0);
+    specular = vec4(albedo * material.specular, material.shininess);
+    normal = vec4(normalize(fs_in.normal), 0.0);
+}
@@ -0,0 +1,55 @@
+#version 330 core
+
+// The lighting pass of the deferred renderer (it is used with "fullscreen.vert" and its result is added to the ambient light
+// written by "deferred/gbuffer.frag"). Each pixel reads its surface from the G-buffer, then evaluates the same lights as
+// "light.frag": the lights that reach every fragment, then the lights of its cluster. So the cost of the lights depends on the
+// number of lit pixels on the screen instead of the number of fragments drawn by the objects (including the hidden ones).
+
+// The "Frame" block, the lights & the light functions are shared with "light.frag"
+#include "../light.glsl"
+
+// The G-buffer (the units are set by the renderer)
+uniform sampler2D gbuffer_diffuse;
+uniform sampler2D gbuffer_specular;
+uniform sampler2D gbuffer_normal;
+uniform sampler2D gbuffer_depth;
+// Brings the positions back from the normalized device coordinates to the world space
+uniform mat4 inverse_view_projection;
+
+// The surface of the pixel as read from the G-buffer
+struct Surface {
+    vec3 world;
+    vec3 normal;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+in vec2 tex_coord;
+out vec4 frag_color;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbuffer_depth, pixel, 0).x;
+    // The pixels that no lit object covers keep their cleared depth (they are left to the forward passes)
+    if(depth == 1.0f) discard;
+
+    // The world position is found by undoing the projection of the pixel
+    vec2 ndc = (gl_FragCoord.xy / vec2(textureSize(gbuffer_depth, 0))) * 2.0f - 1.0f;
+    vec4 world = inverse_view_projection * vec4(ndc, depth * 2.0f - 1.0f, 1.0f);
+
+    Surface surface;
+    surface.world = world.xyz / world.w;
+    surface.normal = texelFetch(gbuffer_normal, pixel, 0).xyz;
+    surface.diffuse = texelFetch(gbuffer_diffuse, pixel, 0).rgb;
+    vec4 specular = texelFetch(gbuffer_specular, pixel, 0);
+    surface.specular = specular.rgb;
+    surface.shininess = specular.a;
+    vec3 view = normalize(camera_position - surface.world);
+
+    // The ambient light was already written by the G-buffer pass, so only the lights are added here
+    Material material = Material(surface.diffuse, surface.specular, vec3(0.0f), vec3(0.0f), surface.shininess);
+    vec3 accumulated_light = calculate_lights(gl_FragCoord.xy, surface.world, surface.normal, view, material);
+
+    frag_color = vec4(accumulated_light, 0.0f);
+}
@@ -0,0 +1,25 @@
+#version 330 core
+
+// This shader only writes the depth of the lit objects (it is used by the depth pre-pass of the forward renderer).
+// The main pass then shades the lit objects with "light.vert" & the depth test set to GL_EQUAL, so the depth written here
+// must be exactly the depth computed by "light.vert": the position goes through the same operations on the same inputs
+// and "gl_Position" is declared invariant in both shaders.
+
+layout(location = 0) in vec3 position;
+
+#ifdef INSTANCED
+// Each instance reads its matrix from the instance buffer (see "Mesh::drawInstanced")
+layout(location = 4) in mat4 object_to_world;
+#else
+uniform mat4 object_to_world;
+#endif
+
+// The "Frame" block (and the light declarations, which this shader does not use)
+#include "light.glsl"
+
+invariant gl_Position;
+
+void main() {
+    vec3 world = (object_to_world * vec4(position, 1.0)).xyz;
+    gl_Position = view_projection * vec4(world, 1.0);
+}
@@ -1,29 +1,124 @@
-
 #ifndef OUR_LIGHT_COMMON_GLSL_INCLUDED
 #define OUR_LIGHT_COMMON_GLSL_INCLUDED
 
-    // This will be used to compute the diffuse factor.
-    float calculate_lambert(vec3 normal, vec3 light_direction){
-        return max(0.0f, dot(normal, -light_direction));
-    }
+// The declarations shared by the shaders that read the frame data or the lights. This is the only place where they are written:
+// GLSL doesn't support "#include" by default, so "ShaderProgram::attach" replaces each "#include" line with the file it names.
+
+// The data shared by all the draws of a frame. It is uploaded once per frame by the renderer (see "FrameData" in "frame-uniforms.hpp").
+// In the std140 layout, a vec3 takes 16 bytes, so each vec3 is followed by a scalar that fills its last 4 bytes.
+layout(std140) uniform Frame {
+    mat4 view_projection;
+    // The camera position will be used for specular computation.
+    vec3 camera_position;   int global_light_count;
+    vec3 camera_forward;    float cluster_depth_scale;
+    vec3 ambient_light;     float cluster_depth_bias;
+    ivec3 cluster_count;    int light_count;
+    vec2 cluster_tile_scale;
+};
+
+// These type constants match their peers in the C++ code.
+#define TYPE_DIRECTIONAL    0
+#define TYPE_POINT          1
+#define TYPE_SPOT           2
+
+// The lights are read from buffer textures, so there is no limit on their number (see "LightData" in "frame-uniforms.hpp").
+// The first "global_light_count" lights reach every fragment. The others are only evaluated by the fragments of the clusters
+// they reach: the screen is split into tiles and each tile into depth slices, and each cluster lists the indices of its lights.
+uniform samplerBuffer lights;           // 5 texels per light
+uniform usamplerBuffer light_clusters;  // The offset & count of the lights of each cluster in "light_indices"
+uniform usamplerBuffer light_indices;
+
+struct Light {
+    // These defines the colors and intensities of the light (already multiplied by the light color). The type is one of the TYPE_* constants.
+    vec3 diffuse;   int type;
+    // The radius is the distance at which the light fades out (0 if it reaches everything).
+    vec3 specular;  float radius;
+    // Position is used for point and spot lights. Direction is used for directional and spot lights.
+    // Attentuation factors are used for point and spot lights. Cone angles are used for spot lights.
+    vec3 position;  float attenuation_constant;
+    vec3 direction; float attenuation_linear;
+    float attenuation_quadratic, inner_angle, outer_angle;
+};
+
+Light readLight(int index){
+    int texel = index * 5;
+    vec4 t0 = texelFetch(lights, texel);
+    vec4 t1 = texelFetch(lights, texel + 1);
+    vec4 t2 = texelFetch(lights, texel + 2);
+    vec4 t3 = texelFetch(lights, texel + 3);
+    vec4 t4 = texelFetch(lights, texel + 4);
+    return Light(t0.xyz, int(t0.w), t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.x, t4.y, t4.z);
+}
+
+// This will be used to compute the diffuse factor.
+float calculate_lambert(vec3 normal, vec3 light_direction){
+    return max(0.0f, dot(normal, -light_direction));
+}
+
+// This will be used to compute the phong specular.
+float calculate_phong(vec3 normal, vec3 light_direction, vec3 view, float shininess){
+    vec3 reflected = reflect(light_direction, normal);
+    return pow(max(0.0f, dot(view, reflected)), shininess);
+}
+
+// This contains all the material properties for a single pixel.
+// We have an extra property "emissive" which is used when the pixel itself emits light.
+struct Material {
+    vec3 diffuse;
+    vec3 specular;
+    vec3 ambient;
+    vec3 emissive;
+    float shininess;
+};
+
+// Returns the diffuse & specular light that the light gives to the surface at "world" (the ambient component of all the lights is added once)
+vec3 calculate_light(Light light, vec3 world, vec3 normal, vec3 view, Material material){
+    vec3 light_direction;
+    float attenuation = 1;
+    if(light.type == TYPE_DIRECTIONAL)
+        light_direction = light.direction; // If light is directional, use its direction as the light direction
+    else {
+        // If not directional, compute the direction from the position.
+        light_direction = world - light.position;
+        float distance = length(light_direction);
+        light_direction /= distance;
+
+        // And compute the attenuation.
+        attenuation *= 1.0f / (light.attenuation_constant +
+        light.attenuation_linear * distance +
+        light.attenuation_quadratic * distance * distance);
+        // The light fades out before its radius, so it does not end abruptly at the edges of the clusters it reaches
+        if(light.radius > 0.0f) attenuation *= 1.0f - smoothstep(0.75f * light.radius, light.radius, distance);
 
-    // This will be used to compute the phong specular.
-    float calculate_phong(vec3 normal, vec3 light_direction, vec3 view, float shininess){
-        vec3 reflected = reflect(light_direction, normal);
-        return pow(max(0.0f, dot(view, reflected)), shininess);
+        if(light.type == TYPE_SPOT){
+            // If it is a spot light, comput the angle attenuation.
+            float angle = acos(dot(light.direction, light_direction));
+            attenuation *= smoothstep(light.outer_angle, light.inner_angle, angle);
+        }
     }
 
+    // Now we compute the diffuse & specular components separately.
+    vec3 diffuse = material.diffuse * light.diffuse * calculate_lambert(normal, light_direction);
+    vec3 specular = material.specular * light.specular * calculate_phong(normal, light_direction, view, material.shininess);
+    return (diffuse + specular) * attenuation;
+}
 
-    // This contains all the material properties for a single pixel.
-    // We have an extra property "emissive" which is used when the pixel itself emits light.
-    struct Material {
-        vec3 diffuse;
-        vec3 specular;
-        vec3 ambient;
-        vec3 emissive;
-        float shininess;
-    };
+// Returns the diffuse & specular light that all the lights give to the surface at "world", which is seen at the window
+// coordinates "frag_coord": the lights that reach every fragment, then the lights of its cluster.
+vec3 calculate_lights(vec2 frag_coord, vec3 world, vec3 normal, vec3 view, Material material){
+    vec3 accumulated_light = vec3(0.0f);
+    for(int index = 0; index < global_light_count; index++)
+        accumulated_light += calculate_light(readLight(index), world, normal, view, material);
 
-    
+    // The depth slices get thicker with the depth (their depths grow exponentially).
+    float depth = dot(world - camera_position, camera_forward);
+    ivec3 cluster;
+    cluster.xy = clamp(ivec2(frag_coord * cluster_tile_scale), ivec2(0), cluster_count.xy - 1);
+    cluster.z = clamp(int(floor(log(max(depth, 1e-4f)) * cluster_depth_scale + cluster_depth_bias)), 0, cluster_count.z - 1);
+    uvec2 range = texelFetch(light_clusters, (cluster.z * cluster_count.y + cluster.y) * cluster_count.x + cluster.x).xy;
+    for(uint index = 0u; index < range.y; index++)
+        accumulated_light += calculate_light(readLight(int(texelFetch(light_indices, int(range.x + index)).x)), world, normal, view, material);
+    return accumulated_light;
+}
 
 #endif
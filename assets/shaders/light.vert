@@ -8,13 +8,23 @@ layout(location = 3) in vec3 normal;
 
 // We will need to do the light processing in the world space so we will break our transformations into 2 stages:
 // 1- Object to World.
+#ifdef INSTANCED
+// Each instance reads its matrices from the instance buffer (see "Mesh::drawInstanced")
+layout(location = 4) in mat4 object_to_world;
+layout(location = 8) in mat4 object_to_world_inv_transpose;
+#else
 uniform mat4 object_to_world;
 uniform mat4 object_to_world_inv_transpose; // The inverse transpose will be used to transform the surface normal.
-// 2- World to Homogenous Clipspace.
-uniform mat4 view_projection;
-// The camera position will be used for specular computation.
-uniform vec3 camera_position;
+#endif
+// 2- World to Homogenous Clipspace (view_projection is read from the "Frame" block below).
+
+// The "Frame" block (and the light declarations, which this shader does not use)
+#include "light.glsl"
+
 uniform mat4 transform;
+// The depth pre-pass computes the same positions with "depth.vert", then the objects are shaded where their depth is equal
+// to the depth of the pre-pass. So both shaders must give exactly the same positions for the same inputs.
+invariant gl_Position;
 out Varyings {
     vec4 color;
     vec2 tex_coord;
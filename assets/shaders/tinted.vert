@@ -7,10 +7,22 @@ out Varyings {
     vec4 color;
 } vs_out;
 
+#ifdef INSTANCED
+// Each instance reads its object to world matrix from the instance buffer (see "Mesh::drawInstanced")
+// and the view projection matrix from the frame uniform buffer (see "FrameData" in "frame-uniforms.hpp").
+layout(location = 4) in mat4 instance_object_to_world;
+// The "Frame" block (and the light declarations, which this shader does not use)
+#include "light.glsl"
+#else
 uniform mat4 transform;
+#endif
 
 void main(){
     //TODO: (Req 7) Change the next line to apply the transformation matrix
+#ifdef INSTANCED
+    gl_Position = view_projection * instance_object_to_world * vec4(position, 1.0);
+#else
     gl_Position = transform*vec4(position, 1.0);
+#endif
     vs_out.color = color;
 }
\ No newline at end of file
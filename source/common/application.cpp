@@ -25,6 +25,7 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "gl-state-cache.hpp"
 
 std::string default_screenshot_filepath()
 {
@@ -332,6 +333,11 @@ int our::Application::run(int run_for_frames)
         // Get the current time (the time at which we are starting the current frame).
         double current_frame_time = glfwGetTime();
 
+        // ImGui changed the OpenGL state behind the back of the state cache while drawing the last frame, so the cache forgets it.
+        // The counters of the cache are reset too, so they hold the calls of a single frame (they are read in the next frame's GUI).
+        our::GLStateCache::invalidate();
+        our::GLStateCache::resetStats();
+
         // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
         if (currentState)
             currentState->onDraw(current_frame_time - last_frame_time);
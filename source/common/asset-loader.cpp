@@ -7,13 +7,15 @@
 #include "mesh/mesh.hpp"
 #include "mesh/mesh-utils.hpp"
 #include "material/material.hpp"
+#include "ecs/prefab.hpp"
 #include "deserialize-utils.hpp"
 
 namespace our {
 
     // This will load all the shaders defined in "data"
     // data must be in the form:
-    //    { shader_name : { "vs" : "path/to/vertex-shader", "fs" : "path/to/fragment-shader" }, ... }
+    //    { shader_name : { "vs" : "path/to/vertex-shader", "fs" : "path/to/fragment-shader", "instanced": false }, ... }
+    // If "instanced" is true, the shaders are also compiled with "INSTANCED" defined to create the instanced variant of the program
     template<>
     void AssetLoader<ShaderProgram>::deserialize(const nlohmann::json& data) {
         if(data.is_object()){
@@ -24,6 +26,13 @@ namespace our {
                 shader->attach(vsPath, GL_VERTEX_SHADER);
                 shader->attach(fsPath, GL_FRAGMENT_SHADER);
                 shader->link();
+                if(desc.value("instanced", false)){
+                    auto variant = new ShaderProgram();
+                    variant->attach(vsPath, GL_VERTEX_SHADER, "#define INSTANCED\n");
+                    variant->attach(fsPath, GL_FRAGMENT_SHADER, "#define INSTANCED\n");
+                    variant->link();
+                    shader->setInstancedVariant(variant);
+                }
                 assets[name] = shader;
             }
         }
@@ -63,13 +72,14 @@ namespace our {
     // This will load all the meshes defined in "data"
     // data must be in the form:
     //    { mesh_name : "path/to/3d-model-file", ... }
+    // The meshes are stored in the shared geometry arena, so the renderer can draw many of them in a single call
     template<>
     void AssetLoader<Mesh>::deserialize(const nlohmann::json& data) {
         
         if(data.is_object()){
             for(auto& [name, desc] : data.items()){
                 std::string path = desc.get<std::string>();
-                assets[name] = mesh_utils::loadOBJ(path);
+                assets[name] = mesh_utils::loadOBJ(path, GeometryArena::getShared());
             }
         }
     };
@@ -98,6 +108,23 @@ namespace our {
         }
     };
 
+    // This will load all the prefabs defined in "data"
+    // The components of the prefabs may refer to the other assets (e.g. meshes and materials)
+    // so you must deserialize them before deserializing the prefabs
+    // data must be in the form:
+    //    { prefab_name : entity, ... }
+    // Where entity is an entity json object (see "World::deserialize") which may have children
+    template<>
+    void AssetLoader<Prefab>::deserialize(const nlohmann::json& data) {
+        if(data.is_object()){
+            for(auto& [name, desc] : data.items()){
+                auto prefab = new Prefab();
+                prefab->deserialize(desc);
+                assets[name] = prefab;
+            }
+        }
+    };
+
     void deserializeAllAssets(const nlohmann::json& assetData){
         if(!assetData.is_object()) return;
         if(assetData.contains("shaders"))
@@ -110,14 +137,20 @@ namespace our {
             AssetLoader<Mesh>::deserialize(assetData["meshes"]);
         if(assetData.contains("materials"))
             AssetLoader<Material>::deserialize(assetData["materials"]);
+        if(assetData.contains("prefabs"))
+            AssetLoader<Prefab>::deserialize(assetData["prefabs"]);
     }
 
     void clearAllAssets(){
+        // The prefabs are cleared first since their prototypes refer to the other assets
+        AssetLoader<Prefab>::clear();
         AssetLoader<ShaderProgram>::clear();
         AssetLoader<Texture2D>::clear();
         AssetLoader<Sampler>::clear();
         AssetLoader<Mesh>::clear();
         AssetLoader<Material>::clear();
+        // The arena of the meshes is deleted once all the meshes in it are deleted
+        GeometryArena::releaseShared();
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "stream-buffer.hpp"
+#include "../gl-features.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+
+// ARB_buffer_storage is not part of OpenGL 3.3, so its constants & function are defined and loaded here
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace our {
+
+    typedef void (APIENTRY* BufferStorageFunction)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+    // Returns glBufferStorage if the driver supports it (nullptr otherwise). It is only looked up once.
+    static BufferStorageFunction getBufferStorage(){
+        static BufferStorageFunction function = hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage") ?
+            reinterpret_cast<BufferStorageFunction>(glfwGetProcAddress("glBufferStorage")) : nullptr;
+        return function;
+    }
+
+    bool StreamBuffer::isPersistentMappingSupported(){
+        return getBufferStorage() != nullptr;
+    }
+
+    StreamBuffer::StreamBuffer(GLenum target, size_t regionSize, size_t regionCount) :
+        target(target), regionSize(regionSize), regionCount(std::max<size_t>(regionCount, 1)) {
+        create();
+    }
+
+    StreamBuffer::~StreamBuffer(){
+        destroy();
+    }
+
+    void StreamBuffer::create(){
+        // The regions start at multiples of 256 bytes, which satisfies the offset alignment of every buffer binding
+        regionSize = (regionSize + 255) / 256 * 256;
+        size_t totalSize = regionSize * regionCount;
+        fences.assign(regionCount, nullptr);
+        // The first "begin" moves to the first region
+        currentRegion = regionCount - 1;
+        writeOffset = 0;
+
+        glGenBuffers(1, &name);
+        glBindBuffer(target, name);
+        persistent = false;
+        if(BufferStorageFunction bufferStorage = getBufferStorage()){
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(target, totalSize, nullptr, flags);
+            mapping = static_cast<unsigned char*>(glMapBufferRange(target, 0, totalSize, flags));
+            persistent = mapping != nullptr;
+            if(!persistent){
+                // The storage of the buffer is immutable now, so a new buffer is created for the fallback
+                glDeleteBuffers(1, &name);
+                glGenBuffers(1, &name);
+                glBindBuffer(target, name);
+            }
+        }
+        if(!persistent){
+            mapping = nullptr;
+            glBufferData(target, totalSize, nullptr, GL_STREAM_DRAW);
+        }
+    }
+
+    void StreamBuffer::destroy(){
+        for(GLsync& sync : fences){
+            if(sync) glDeleteSync(sync);
+            sync = nullptr;
+        }
+        if(mapping){
+            glBindBuffer(target, name);
+            glUnmapBuffer(target);
+            mapping = nullptr;
+        }
+        // OpenGL keeps the storage alive until the commands that still read it are done
+        glDeleteBuffers(1, &name);
+        name = 0;
+        writing = false;
+    }
+
+    void StreamBuffer::waitForRegion(size_t region){
+        GLsync sync = fences[region];
+        if(!sync) return;
+        // First, we only check the fence. If the GPU is done with the region (the usual case), there is nothing to wait for.
+        GLenum result = glClientWaitSync(sync, 0, 0);
+        if(result == GL_TIMEOUT_EXPIRED){
+            // The CPU is "regionCount" frames ahead of the GPU, so it has to wait (the commands are flushed so the fence can be reached)
+            ++stats.fenceWaits;
+            auto start = std::chrono::high_resolution_clock::now();
+            do {
+                result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 millisecond
+            } while(result == GL_TIMEOUT_EXPIRED);
+            auto end = std::chrono::high_resolution_clock::now();
+            stats.fenceWaitMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        glDeleteSync(sync);
+        fences[region] = nullptr;
+    }
+
+    void StreamBuffer::begin(){
+        if(writing) flush();
+        if(requiredSize > regionSize){
+            // The last frame did not fit, so the regions grow (the old buffer is released once the GPU is done with it)
+            size_t newSize = std::max(requiredSize, regionSize * 2);
+            destroy();
+            regionSize = newSize;
+            create();
+        }
+        requiredSize = 0;
+        currentRegion = (currentRegion + 1) % regionCount;
+        waitForRegion(currentRegion);
+        writeOffset = currentRegion * regionSize;
+        if(!persistent){
+            // The fence already guarantees that the GPU is done with the region, so the driver does not need to synchronize
+            glBindBuffer(target, name);
+            mapping = static_cast<unsigned char*>(glMapBufferRange(target, writeOffset, regionSize,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        }
+        writing = true;
+    }
+
+    void* StreamBuffer::allocate(size_t size, size_t alignment, size_t& offset){
+        size_t regionStart = currentRegion * regionSize;
+        if(alignment == 0) alignment = 1;
+        size_t start = (writeOffset + alignment - 1) / alignment * alignment;
+        if(!writing || !mapping || start + size > regionStart + regionSize){
+            // The space this frame needed is remembered so the next "begin" can make the regions large enough
+            requiredSize = std::max(requiredSize, start + size - regionStart);
+            ++stats.overflows;
+            return nullptr;
+        }
+        writeOffset = start + size;
+        offset = start;
+        // The persistent mapping covers the whole buffer while the other mapping only covers the current region
+        return persistent ? mapping + start : mapping + (start - regionStart);
+    }
+
+    void StreamBuffer::flush(){
+        if(!writing) return;
+        // The persistent mapping is coherent, so the writes are visible to the GPU without unmapping
+        if(!persistent && mapping){
+            glBindBuffer(target, name);
+            glUnmapBuffer(target);
+            mapping = nullptr;
+        }
+        writing = false;
+    }
+
+    void StreamBuffer::fence(){
+        if(fences[currentRegion]) glDeleteSync(fences[currentRegion]);
+        fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+}
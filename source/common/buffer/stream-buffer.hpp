@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace our {
+
+    // A buffer for the data written by the CPU every frame and read by the GPU in the same frame (e.g. instance matrices & uniform blocks).
+    // It is split into "regionCount" regions used in turn (one per frame), so the CPU writes the data of frame N+1
+    // while the GPU may still read the data of frame N. A fence is placed after the draws that read a region and
+    // the region is only written again once the GPU passed its fence, so the driver never has to stall on the buffer
+    // (and if the CPU gets more than "regionCount" frames ahead, the wait is counted in the stats).
+    // - If the driver supports ARB_buffer_storage (or OpenGL 4.4), the buffer is mapped once (persistent & coherent)
+    //   and the data is written directly to it.
+    // - Otherwise, each region is mapped with glMapBufferRange while it is written (unsynchronized, since the fences
+    //   already protect it, and invalidated, since its old contents are not needed).
+    // Usage per frame: "begin", then "allocate" & write, then "flush" before the draws, then "fence" after the draws.
+    class StreamBuffer {
+    public:
+        // The number of calls that had to wait (and for how long) since the buffer was created
+        struct Stats {
+            size_t fenceWaits = 0;         // The times "begin" found its region still in use by the GPU and waited for it
+            double fenceWaitMilliseconds = 0;
+            size_t overflows = 0;          // The allocations that did not fit in a region (the regions grow at the next "begin")
+        };
+
+    private:
+        GLuint name = 0;
+        GLenum target;
+        size_t regionSize, regionCount;
+        size_t requiredSize = 0;            // The size the current region needed (so the next "begin" can grow the regions)
+        size_t currentRegion = 0, writeOffset = 0;
+        std::vector<GLsync> fences;         // The fence of each region (nullptr if the GPU does not read it)
+        bool persistent = false;            // Whether the whole buffer is persistently mapped
+        unsigned char* mapping = nullptr;   // The mapping of the whole buffer (if persistent) or of the current region
+        bool writing = false;               // Whether a region is between "begin" and "flush"
+        Stats stats;
+
+        // Creates the buffer (and maps it if it is persistent)
+        void create();
+        void destroy();
+        // Waits until the GPU does not read the region anymore
+        void waitForRegion(size_t region);
+
+    public:
+        // "target" is the target to which the buffer is bound while it is created or mapped (e.g. GL_ARRAY_BUFFER).
+        // The data can still be read through any target (e.g. GL_UNIFORM_BUFFER using glBindBufferRange).
+        StreamBuffer(GLenum target, size_t regionSize, size_t regionCount = 3);
+        ~StreamBuffer();
+
+        // Starts writing the next region (it waits if the GPU still reads that region)
+        void begin();
+        // Returns a pointer to "size" free bytes of the current region at an offset (from the start of the buffer)
+        // that is a multiple of "alignment". Returns nullptr if the region is full (the regions grow at the next "begin").
+        void* allocate(size_t size, size_t alignment, size_t& offset);
+        // Ends the writes to the current region (this must be called before the draws that read it)
+        void flush();
+        // Marks the end of the commands that read the current region (this must be called after the draws that read it)
+        void fence();
+
+        // The OpenGL name of the buffer (it may change in "begin" when the regions grow)
+        GLuint getName() const { return name; }
+        bool isPersistent() const { return persistent; }
+        size_t getRegionSize() const { return regionSize; }
+        const Stats& getStats() const { return stats; }
+
+        // Returns true if the driver supports persistent mapping
+        static bool isPersistentMappingSupported();
+
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+    };
+
+}
@@ -0,0 +1,89 @@
+#include "texture-buffer.hpp"
+#include "stream-buffer.hpp"
+#include "../gl-state-cache.hpp"
+#include "../gl-features.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+// ARB_texture_buffer_range is not part of OpenGL 3.3, so its constant & function are defined and loaded here
+#ifndef GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT
+#define GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT 0x919F
+#endif
+
+namespace our {
+
+    typedef void (APIENTRY* TexBufferRangeFunction)(GLenum target, GLenum internalFormat, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    // Returns glTexBufferRange if the driver supports it (nullptr otherwise). It is only looked up once.
+    static TexBufferRangeFunction getTexBufferRange(){
+        static TexBufferRangeFunction function = hasGLVersion(4, 3) || hasGLExtension("GL_ARB_texture_buffer_range") ?
+            reinterpret_cast<TexBufferRangeFunction>(glfwGetProcAddress("glTexBufferRange")) : nullptr;
+        return function;
+    }
+
+    // Returns the alignment of the offsets given to glTexBufferRange (only called if it is supported)
+    static size_t getTexBufferOffsetAlignment(){
+        static size_t alignment = [](){
+            GLint value = 256;
+            glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &value);
+            return (size_t)std::max(value, 1);
+        }();
+        return alignment;
+    }
+
+    bool TextureBuffer::isRangeSupported(){
+        return getTexBufferRange() != nullptr;
+    }
+
+    size_t TextureBuffer::getMaxTexelCount(){
+        static size_t count = [](){
+            GLint value = 65536;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &value);
+            return (size_t)std::max(value, 65536);
+        }();
+        return count;
+    }
+
+    TextureBuffer::TextureBuffer(GLenum format, GLuint unit) : format(format), unit(unit) {
+        glGenTextures(1, &texture);
+        glGenBuffers(1, &buffer);
+    }
+
+    TextureBuffer::~TextureBuffer(){
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void TextureBuffer::bind() const {
+        // The buffer textures use units that no material uses, so only the active unit goes through the state cache
+        GLStateCache::activeTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+    void TextureBuffer::upload(StreamBuffer* stream, const void* data, size_t size){
+        // A buffer texture can not view an empty range, so an empty upload still writes a few (unread) bytes
+        static const unsigned char empty[16] = {};
+        if(size == 0){
+            data = empty;
+            size = sizeof(empty);
+        }
+        bind();
+        if(TexBufferRangeFunction texBufferRange = getTexBufferRange(); texBufferRange && stream){
+            size_t offset;
+            if(void* destination = stream->allocate(size, getTexBufferOffsetAlignment(), offset)){
+                std::copy_n(static_cast<const unsigned char*>(data), size, static_cast<unsigned char*>(destination));
+                texBufferRange(GL_TEXTURE_BUFFER, format, stream->getName(), offset, size);
+                return;
+            }
+            // If the stream buffer is full, this frame goes through the texture's own buffer
+        }
+        // The old storage is orphaned, so the draws of the previous frames keep reading it while the new one is written
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        bufferSize = std::max(bufferSize, size);
+        glBufferData(GL_TEXTURE_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    }
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstddef>
+
+namespace our {
+
+    class StreamBuffer;
+
+    // A buffer texture whose contents are written by the CPU every frame (e.g. the lights & the light clusters).
+    // The shaders read it with texelFetch through a "samplerBuffer" (or "usamplerBuffer") bound to a fixed texture unit,
+    // which holds far more data than a uniform block.
+    // - If the driver supports ARB_texture_buffer_range (or OpenGL 4.3), the data is written to the stream buffer of the frame
+    //   and the texture views its range, so it is never copied again and never stalls.
+    // - Otherwise, the texture views its own buffer, whose storage is orphaned (re-specified) every time it is written.
+    class TextureBuffer {
+        GLuint texture = 0, buffer = 0;
+        GLenum format; // The internal format of the texels (e.g. GL_RGBA32F or GL_R32UI)
+        GLuint unit;   // The texture unit to which the texture is bound
+        size_t bufferSize = 0; // The size of the storage of "buffer"
+
+    public:
+        TextureBuffer(GLenum format, GLuint unit);
+        ~TextureBuffer();
+
+        // Writes "size" bytes to the texture (through "stream" if it is not null and the driver can view its range)
+        // and binds the texture to its unit. The stream buffer must be between its "begin" and its "flush".
+        void upload(StreamBuffer* stream, const void* data, size_t size);
+        // Binds the texture to its texture unit
+        void bind() const;
+
+        GLuint getUnit() const { return unit; }
+
+        // Returns true if the texture can view a range of a stream buffer
+        static bool isRangeSupported();
+        // Returns the number of texels a buffer texture can hold (at least 65536)
+        static size_t getMaxTexelCount();
+
+        TextureBuffer(const TextureBuffer&) = delete;
+        TextureBuffer& operator=(const TextureBuffer&) = delete;
+    };
+
+}
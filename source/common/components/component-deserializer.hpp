@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../ecs/entity.hpp"
+#include "../ecs/component-registry.hpp"
 #include "camera.hpp"
 #include "mesh-renderer.hpp"
 #include "free-camera-controller.hpp"
@@ -9,23 +10,25 @@
 
 namespace our {
 
+    // Returns the registry holding all the component types that can be deserialized
+    inline const ComponentRegistry& getComponentRegistry(){
+        static const ComponentRegistry registry = [](){
+            ComponentRegistry registry;
+            registry.registerComponent<CameraComponent>();
+            registry.registerComponent<FreeCameraControllerComponent>();
+            registry.registerComponent<MovementComponent>();
+            registry.registerComponent<MeshRendererComponent>();
+            registry.registerComponent<LightComponent>();
+            return registry;
+        }();
+        return registry;
+    }
+
     // Given a json object, this function picks and creates a component in the given entity
     // based on the "type" specified in the json object which is later deserialized from the rest of the json object
     inline void deserializeComponent(const nlohmann::json& data, Entity* entity){
         std::string type = data.value("type", "");
-        Component* component = nullptr;
-        //TODO: (Req 8) Add an option to deserialize a "MeshRendererComponent" to the following if-else statement
-        if(type == CameraComponent::getID()){
-            component = entity->addComponent<CameraComponent>();
-        } else if (type == FreeCameraControllerComponent::getID()) {
-            component = entity->addComponent<FreeCameraControllerComponent>();
-        } else if (type == MovementComponent::getID()) {
-            component = entity->addComponent<MovementComponent>();
-        } else if (type == MeshRendererComponent::getID()) {
-            component = entity->addComponent<MeshRendererComponent>();
-        } else if (type == LightComponent::getID()) {
-            component = entity->addComponent<LightComponent>();
-        }
+        Component* component = getComponentRegistry().addComponent(type, entity);
         if(component) component->deserialize(data);
     }
 
@@ -25,6 +25,7 @@ namespace our {
         attenuation.constant=att[0];
         attenuation.linear=att[1];
         attenuation.quadratic=att[2];
+        range=data.value("range",0.f);
         
         
     }
@@ -25,6 +25,9 @@ namespace our {
         struct {
             float constant, linear, quadratic;
         } attenuation; // Used for Point and Spot Lights only
+        // The distance beyond which a point or spot light is faded out (0 to find it from the attenuation).
+        // The renderer only evaluates the light for the fragments within its range.
+        float range = 0;
         struct {
             float inner, outer;
         } spot_angle; // Used for Spot Lights only
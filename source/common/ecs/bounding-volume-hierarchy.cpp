@@ -0,0 +1,328 @@
+#include "bounding-volume-hierarchy.hpp"
+#include "entity.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    bool BoundingVolumeHierarchy::matches(const Entity* entity, Symbol tag){
+        return tag == Symbol() || entity->hasTag(tag);
+    }
+
+    int32_t BoundingVolumeHierarchy::allocateNode(){
+        if(!freeNodes.empty()){
+            int32_t index = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[index] = Node();
+            return index;
+        }
+        nodes.emplace_back();
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    void BoundingVolumeHierarchy::freeNode(int32_t index){
+        nodes[index] = Node();
+        freeNodes.push_back(index);
+    }
+
+    void BoundingVolumeHierarchy::refitAncestors(int32_t index){
+        while(index != NULL_NODE){
+            Node& node = nodes[index];
+            AABB bounds = AABB::merge(nodes[node.left].bounds, nodes[node.right].bounds);
+            // If this box did not change, none of the boxes above it can change
+            if(bounds == node.bounds) break;
+            node.bounds = bounds;
+            index = node.parent;
+        }
+    }
+
+    // Walks down from the root to find the node that should become the sibling of the new leaf.
+    // At each inner node, the leaf either gets a new parent shared with this node or goes down to one of the children.
+    // Going down adds (at least) the growth of this node's box to the cost, so the search stops once that is more
+    // than the cost of pairing the leaf with this node (this is the insertion used by Box2D's dynamic tree).
+    void BoundingVolumeHierarchy::insertLeaf(int32_t leaf){
+        if(root == NULL_NODE){
+            root = leaf;
+            nodes[leaf].parent = NULL_NODE;
+            return;
+        }
+        const AABB bounds = nodes[leaf].bounds;
+        int32_t index = root;
+        while(!nodes[index].isLeaf()){
+            const Node& node = nodes[index];
+            float area = node.bounds.surfaceArea();
+            float combinedArea = AABB::merge(node.bounds, bounds).surfaceArea();
+            // The cost of creating a new parent for this node and the new leaf
+            float cost = 2.0f * combinedArea;
+            // The cost added to the ancestors if the leaf is pushed further down
+            float inheritedCost = 2.0f * (combinedArea - area);
+            auto descendCost = [&](int32_t child){
+                const Node& childNode = nodes[child];
+                float mergedArea = AABB::merge(childNode.bounds, bounds).surfaceArea();
+                if(childNode.isLeaf()) return mergedArea + inheritedCost;
+                return mergedArea - childNode.bounds.surfaceArea() + inheritedCost;
+            };
+            float leftCost = descendCost(node.left), rightCost = descendCost(node.right);
+            if(cost < leftCost && cost < rightCost) break;
+            index = leftCost < rightCost ? node.left : node.right;
+        }
+
+        int32_t sibling = index;
+        int32_t oldParent = nodes[sibling].parent;
+        int32_t newParent = allocateNode(); // This may move the nodes, so no reference is held across it
+        Node& parentNode = nodes[newParent];
+        parentNode.parent = oldParent;
+        parentNode.bounds = AABB::merge(bounds, nodes[sibling].bounds);
+        parentNode.left = sibling;
+        parentNode.right = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+        if(oldParent == NULL_NODE){
+            root = newParent;
+        } else {
+            if(nodes[oldParent].left == sibling) nodes[oldParent].left = newParent;
+            else nodes[oldParent].right = newParent;
+            refitAncestors(oldParent);
+        }
+    }
+
+    // Detaches the leaf from the tree: its sibling takes the place of their parent (which is freed)
+    void BoundingVolumeHierarchy::removeLeaf(int32_t leaf){
+        if(leaf == root){
+            root = NULL_NODE;
+            return;
+        }
+        int32_t parent = nodes[leaf].parent;
+        int32_t grandParent = nodes[parent].parent;
+        int32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        nodes[sibling].parent = grandParent;
+        if(grandParent == NULL_NODE){
+            root = sibling;
+        } else {
+            if(nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+            else nodes[grandParent].right = sibling;
+        }
+        freeNode(parent);
+        refitAncestors(grandParent);
+    }
+
+    int32_t BoundingVolumeHierarchy::insert(Entity* entity, const AABB& bounds){
+        int32_t leaf = allocateNode();
+        nodes[leaf].bounds = bounds;
+        nodes[leaf].entity = entity;
+        pendingLeaves.push_back(leaf);
+        ++leafCount;
+        ++changesSinceBuild;
+        return leaf;
+    }
+
+    void BoundingVolumeHierarchy::remove(int32_t leaf){
+        // A leaf that is neither the root nor the child of a node was not linked yet
+        if(leaf != root && nodes[leaf].parent == NULL_NODE){
+            pendingLeaves.erase(std::find(pendingLeaves.begin(), pendingLeaves.end(), leaf));
+        } else {
+            removeLeaf(leaf);
+        }
+        freeNode(leaf);
+        --leafCount;
+        ++changesSinceBuild;
+    }
+
+    void BoundingVolumeHierarchy::update(int32_t leaf, const AABB& bounds){
+        if(nodes[leaf].bounds == bounds) return;
+        nodes[leaf].bounds = bounds;
+        refitAncestors(nodes[leaf].parent); // Nothing is refitted for a leaf that was not linked yet
+        ++changesSinceBuild;
+    }
+
+    // Splits the leaves in two along the longest axis of their centers. The split is picked by binning the centers
+    // and keeping the bin boundary with the lowest surface area heuristic cost (the area of each side times its leaf count).
+    int32_t BoundingVolumeHierarchy::build(int32_t* leaves, size_t count, std::vector<glm::vec3>& centers){
+        if(count == 1) return leaves[0];
+
+        AABB bounds, centerBounds;
+        for(size_t index = 0; index < count; ++index){
+            bounds = AABB::merge(bounds, nodes[leaves[index]].bounds);
+            centerBounds = AABB::merge(centerBounds, AABB(centers[leaves[index]], centers[leaves[index]]));
+        }
+        glm::vec3 extent = centerBounds.max - centerBounds.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        size_t middle = 0;
+        if(extent[axis] > 0.0f){
+            constexpr int BIN_COUNT = 16;
+            AABB binBounds[BIN_COUNT];
+            size_t binCounts[BIN_COUNT] = {};
+            const float scale = BIN_COUNT / extent[axis], start = centerBounds.min[axis];
+            auto binOf = [&](int32_t leaf){
+                return std::min(BIN_COUNT - 1, static_cast<int>((centers[leaf][axis] - start) * scale));
+            };
+            for(size_t index = 0; index < count; ++index){
+                int bin = binOf(leaves[index]);
+                binBounds[bin] = AABB::merge(binBounds[bin], nodes[leaves[index]].bounds);
+                ++binCounts[bin];
+            }
+            // The cost of the right side of each split is accumulated from the right, then the left side from the left
+            float rightCosts[BIN_COUNT] = {};
+            AABB accumulated;
+            size_t accumulatedCount = 0;
+            for(int bin = BIN_COUNT - 1; bin > 0; --bin){
+                accumulated = AABB::merge(accumulated, binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+                rightCosts[bin] = accumulatedCount ? accumulatedCount * accumulated.surfaceArea() : INFINITY;
+            }
+            accumulated = AABB();
+            accumulatedCount = 0;
+            float bestCost = INFINITY;
+            int bestSplit = -1; // The leaves in the bins [0, bestSplit] go to the left
+            for(int bin = 0; bin < BIN_COUNT - 1; ++bin){
+                accumulated = AABB::merge(accumulated, binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+                if(accumulatedCount == 0) continue;
+                float cost = accumulatedCount * accumulated.surfaceArea() + rightCosts[bin + 1];
+                if(cost < bestCost){
+                    bestCost = cost;
+                    bestSplit = bin;
+                }
+            }
+            if(bestSplit >= 0){
+                middle = std::partition(leaves, leaves + count, [&](int32_t leaf){ return binOf(leaf) <= bestSplit; }) - leaves;
+            }
+        }
+        // If the centers can not be split (e.g. they are all at the same point), the leaves are split in halves
+        if(middle == 0 || middle == count){
+            middle = count / 2;
+            std::nth_element(leaves, leaves + middle, leaves + count, [&](int32_t first, int32_t second){
+                return centers[first][axis] < centers[second][axis];
+            });
+        }
+
+        int32_t index = allocateNode();
+        int32_t left = build(leaves, middle, centers);
+        int32_t right = build(leaves + middle, count - middle, centers);
+        Node& node = nodes[index];
+        node.bounds = bounds;
+        node.left = left;
+        node.right = right;
+        nodes[left].parent = index;
+        nodes[right].parent = index;
+        return index;
+    }
+
+    void BoundingVolumeHierarchy::rebuild(){
+        pendingLeaves.clear();
+        if(leafCount == 0){
+            root = NULL_NODE;
+            return;
+        }
+        // The inner nodes are freed (so the new ones reuse their slots) and the leaves are kept where they are
+        std::vector<int32_t> leaves;
+        leaves.reserve(leafCount);
+        std::vector<glm::vec3> centers(nodes.size());
+        for(int32_t index = 0; index < static_cast<int32_t>(nodes.size()); ++index){
+            const Node& node = nodes[index];
+            if(node.entity){
+                leaves.push_back(index);
+                centers[index] = node.bounds.center();
+            } else if(!node.isLeaf()){
+                freeNode(index);
+            }
+        }
+        root = build(leaves.data(), leaves.size(), centers);
+        nodes[root].parent = NULL_NODE;
+        changesSinceBuild = 0;
+    }
+
+    void BoundingVolumeHierarchy::commit(){
+        // A rebuild costs O(N log N), so waiting for N changes keeps its cost at O(log N) per change
+        if(changesSinceBuild > 0 && changesSinceBuild >= leafCount){
+            rebuild();
+            return;
+        }
+        for(int32_t leaf : pendingLeaves) insertLeaf(leaf);
+        pendingLeaves.clear();
+    }
+
+    void BoundingVolumeHierarchy::clear(){
+        nodes.clear();
+        freeNodes.clear();
+        pendingLeaves.clear();
+        root = NULL_NODE;
+        leafCount = 0;
+        changesSinceBuild = 0;
+    }
+
+    int BoundingVolumeHierarchy::getDepth() const {
+        if(root == NULL_NODE) return 0;
+        int depth = 0;
+        std::vector<std::pair<int32_t, int>> stack;
+        stack.emplace_back(root, 0);
+        while(!stack.empty()){
+            auto [index, nodeDepth] = stack.back();
+            stack.pop_back();
+            depth = std::max(depth, nodeDepth);
+            if(nodes[index].isLeaf()) continue;
+            stack.emplace_back(nodes[index].left, nodeDepth + 1);
+            stack.emplace_back(nodes[index].right, nodeDepth + 1);
+        }
+        return depth;
+    }
+
+    void BoundingVolumeHierarchy::queryFrustum(const glm::vec4 (&planes)[6], std::vector<Entity*>& results) const {
+        visitFrustum(planes, [&](Entity* entity){ results.push_back(entity); });
+    }
+
+    void BoundingVolumeHierarchy::queryOverlaps(const AABB& bounds, std::vector<Entity*>& results, Symbol tag) const {
+        visitOverlaps(bounds, tag, [&](Entity* entity){ results.push_back(entity); return false; });
+    }
+
+    // Visits the boxes hit by the ray from the nearest to the farthest (the nearer child is visited first)
+    // and skips every box that the ray enters after the nearest hit found so far.
+    BoundingVolumeHierarchy::RayHit BoundingVolumeHierarchy::raycast(const glm::vec3& origin, const glm::vec3& direction,
+                                                                     float maxDistance, Symbol tag) const {
+        RayHit hit;
+        if(root == NULL_NODE) return hit;
+        const glm::vec3 inverseDirection = 1.0f / direction;
+        float limit = maxDistance, distance;
+        if(!nodes[root].bounds.intersectRay(origin, inverseDirection, limit, distance)) return hit;
+
+        struct Entry {
+            int32_t node;
+            float distance; // The distance at which the ray enters the node's box
+        };
+        std::vector<Entry> stack;
+        stack.push_back({root, distance});
+        while(!stack.empty()){
+            Entry entry = stack.back();
+            stack.pop_back();
+            if(entry.distance > limit || (hit.entity && entry.distance >= limit)) continue;
+            const Node& node = nodes[entry.node];
+            if(node.isLeaf()){
+                if(matches(node.entity, tag)){
+                    hit = {node.entity, entry.distance};
+                    limit = entry.distance;
+                }
+                continue;
+            }
+            float leftDistance, rightDistance;
+            bool hitsLeft = nodes[node.left].bounds.intersectRay(origin, inverseDirection, limit, leftDistance);
+            bool hitsRight = nodes[node.right].bounds.intersectRay(origin, inverseDirection, limit, rightDistance);
+            // The farther child is pushed first, so the nearer one is popped first
+            if(hitsLeft && hitsRight){
+                if(leftDistance <= rightDistance){
+                    stack.push_back({node.right, rightDistance});
+                    stack.push_back({node.left, leftDistance});
+                } else {
+                    stack.push_back({node.left, leftDistance});
+                    stack.push_back({node.right, rightDistance});
+                }
+            } else if(hitsLeft){
+                stack.push_back({node.left, leftDistance});
+            } else if(hitsRight){
+                stack.push_back({node.right, rightDistance});
+            }
+        }
+        return hit;
+    }
+
+}
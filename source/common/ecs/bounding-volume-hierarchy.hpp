@@ -0,0 +1,211 @@
+#pragma once
+
+#include "symbol.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+
+    // An axis aligned bounding box
+    struct AABB {
+        glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY); // A default constructed box is empty
+
+        AABB() = default;
+        AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+        static AABB merge(const AABB& first, const AABB& second) {
+            return AABB(glm::min(first.min, second.min), glm::max(first.max, second.max));
+        }
+        bool contains(const AABB& other) const {
+            return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+                && max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+        }
+        bool overlaps(const AABB& other) const {
+            return min.x <= other.max.x && min.y <= other.max.y && min.z <= other.max.z
+                && max.x >= other.min.x && max.y >= other.min.y && max.z >= other.min.z;
+        }
+        bool operator==(const AABB& other) const { return min == other.min && max == other.max; }
+        bool operator!=(const AABB& other) const { return !(*this == other); }
+
+        glm::vec3 center() const { return 0.5f * (min + max); }
+        // The surface area is the cost of a node in the surface area heuristic (the chance that a random ray hits the box)
+        float surfaceArea() const {
+            glm::vec3 size = max - min;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        // Returns the box that contains this box after it is transformed by the matrix
+        // (the extents are projected on the world axes instead of transforming the 8 corners)
+        AABB transformed(const glm::mat4& matrix) const {
+            glm::vec3 center = glm::vec3(matrix * glm::vec4(this->center(), 1.0f));
+            glm::vec3 extent = 0.5f * (max - min);
+            glm::vec3 worldExtent = glm::abs(glm::vec3(matrix[0])) * extent.x
+                                  + glm::abs(glm::vec3(matrix[1])) * extent.y
+                                  + glm::abs(glm::vec3(matrix[2])) * extent.z;
+            return AABB(center - worldExtent, center + worldExtent);
+        }
+
+        // Returns true if the ray (given by its origin & the inverse of its direction) enters the box before "maxDistance".
+        // "distance" receives the distance along the ray at which the ray enters the box (0 if the origin is inside the box).
+        bool intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& distance) const {
+            glm::vec3 near = (min - origin) * inverseDirection, far = (max - origin) * inverseDirection;
+            glm::vec3 entry = glm::min(near, far), exit = glm::max(near, far);
+            float enter = std::fmax(std::fmax(entry.x, entry.y), std::fmax(entry.z, 0.0f));
+            float leave = std::fmin(std::fmin(exit.x, exit.y), std::fmin(exit.z, maxDistance));
+            distance = enter;
+            return enter <= leave;
+        }
+    };
+
+    // A dynamic bounding volume hierarchy: a binary tree of boxes where each leaf holds the box of an entity
+    // and each inner node holds the box around its two children.
+    // It answers frustum, ray and overlap queries by skipping every subtree whose box misses the query,
+    // so their cost grows with the number of results (and the log of the size of the tree) instead of the size of the world.
+    // - New leaves are linked by "commit" next to the leaf whose box grows the least (using the surface area heuristic).
+    // - Moving a leaf only refits the boxes of its ancestors, so moving entities cost O(depth) per update.
+    // - Insertions and refits slowly degrade the tree, so "commit" rebuilds it from scratch (top down with binned SAH)
+    //   once enough changes were made since the last build. Static entities are rarely touched, so they are only
+    //   reorganized by these cheap rebuilds (e.g. when a scene is loaded, all its leaves are built at once).
+    // The world keeps a hierarchy of the world bounds of its mesh renderers (see "World::getBoundsHierarchy").
+    class BoundingVolumeHierarchy {
+    public:
+        static constexpr int32_t NULL_NODE = -1;
+
+        // The result of a ray cast
+        struct RayHit {
+            Entity* entity = nullptr; // The entity whose box was hit first (nullptr if the ray hit nothing)
+            float distance = INFINITY; // The distance along the ray at which it enters the box
+        };
+
+    private:
+        struct Node {
+            AABB bounds;
+            int32_t parent = NULL_NODE;
+            int32_t left = NULL_NODE, right = NULL_NODE; // Both are NULL_NODE for leaves
+            Entity* entity = nullptr; // The entity of a leaf (nullptr for inner nodes and free nodes)
+            bool isLeaf() const { return left == NULL_NODE; }
+        };
+
+        // The nodes are allocated in a vector and the freed slots are reused. The index of a leaf never changes
+        // (even when the tree is rebuilt), so the entities can keep the index of their leaf.
+        std::vector<Node> nodes;
+        std::vector<int32_t> freeNodes;
+        int32_t root = NULL_NODE;
+        size_t leafCount = 0;
+        size_t changesSinceBuild = 0; // The insertions, removals & refits since the tree was last rebuilt
+        std::vector<int32_t> pendingLeaves; // The leaves inserted since the last commit (they are not linked to the tree yet)
+
+        // A subtree waiting to be visited by a frustum query along with the planes its ancestors were not fully inside of
+        struct FrustumEntry {
+            int32_t node;
+            uint8_t planes;
+        };
+
+        // Returns true if the entity has the tag (an empty symbol matches every entity)
+        static bool matches(const Entity* entity, Symbol tag);
+
+        int32_t allocateNode();
+        void freeNode(int32_t index);
+        void insertLeaf(int32_t leaf);
+        void removeLeaf(int32_t leaf);
+        // Recomputes the boxes from the given node up to the root (it stops early once a box does not change)
+        void refitAncestors(int32_t index);
+        // Builds a subtree over the given leaves and returns its root
+        int32_t build(int32_t* leaves, size_t count, std::vector<glm::vec3>& centers);
+
+    public:
+        BoundingVolumeHierarchy() = default;
+
+        // Adds a leaf for the entity and returns its index (which stays valid until the leaf is removed).
+        // The leaf is only visible to the queries after the next "commit".
+        int32_t insert(Entity* entity, const AABB& bounds);
+        // Removes a leaf
+        void remove(int32_t leaf);
+        // Changes the box of a leaf and refits its ancestors
+        void update(int32_t leaf, const AABB& bounds);
+        // Rebuilds the whole tree from its leaves (the leaf indices do not change)
+        void rebuild();
+        // Links the inserted leaves to the tree, or rebuilds the tree if it changed a lot since it was last built
+        // (so the cost of a rebuild is amortized over these changes)
+        void commit();
+        // Removes all the leaves
+        void clear();
+
+        size_t size() const { return leafCount; }
+        bool empty() const { return leafCount == 0; }
+        // Returns the box of a leaf
+        const AABB& getBounds(int32_t leaf) const { return nodes[leaf].bounds; }
+        // Returns the box around all the leaves (an empty box if there are none)
+        AABB getRootBounds() const { return root == NULL_NODE ? AABB() : nodes[root].bounds; }
+        // Returns the depth of the deepest leaf (0 if the tree is empty or only holds one leaf)
+        int getDepth() const;
+
+        // Calls "visit(entity)" for each leaf whose box is (at least partially) inside the frustum.
+        // The planes are given as (a, b, c, d) where (a, b, c) is the normal pointing inside the frustum (see "extractFrustumPlanes").
+        // Once a subtree is fully inside some planes, these planes are not tested again for any of its nodes.
+        template<typename Visitor>
+        void visitFrustum(const glm::vec4 (&planes)[6], Visitor&& visit) const {
+            if(root == NULL_NODE) return;
+            std::vector<FrustumEntry> stack;
+            stack.push_back({root, 0x3F});
+            while(!stack.empty()){
+                FrustumEntry entry = stack.back();
+                stack.pop_back();
+                const Node& node = nodes[entry.node];
+                bool outside = false;
+                for(int index = 0; index < 6 && !outside; ++index){
+                    if(!(entry.planes & (1 << index))) continue;
+                    glm::vec3 normal = glm::vec3(planes[index]);
+                    // The corner farthest along the normal is the last one to leave the plane's half space (and the nearest the first)
+                    glm::vec3 farthest = glm::vec3(normal.x >= 0.0f ? node.bounds.max.x : node.bounds.min.x,
+                                                   normal.y >= 0.0f ? node.bounds.max.y : node.bounds.min.y,
+                                                   normal.z >= 0.0f ? node.bounds.max.z : node.bounds.min.z);
+                    glm::vec3 nearest = node.bounds.min + node.bounds.max - farthest;
+                    if(glm::dot(normal, farthest) + planes[index].w < 0.0f) outside = true;
+                    else if(glm::dot(normal, nearest) + planes[index].w >= 0.0f) entry.planes &= ~(1 << index);
+                }
+                if(outside) continue;
+                if(node.isLeaf()){
+                    visit(node.entity);
+                } else {
+                    stack.push_back({node.left, entry.planes});
+                    stack.push_back({node.right, entry.planes});
+                }
+            }
+        }
+
+        // Calls "visit(entity)" for each leaf whose box overlaps the given box and whose entity has the tag (if given).
+        // If "visit" returns true, the search stops and this function returns true.
+        template<typename Visitor>
+        bool visitOverlaps(const AABB& bounds, Symbol tag, Visitor&& visit) const {
+            if(root == NULL_NODE) return false;
+            std::vector<int32_t> stack;
+            stack.push_back(root);
+            while(!stack.empty()){
+                const Node& node = nodes[stack.back()];
+                stack.pop_back();
+                if(!node.bounds.overlaps(bounds)) continue;
+                if(node.isLeaf()){
+                    if(matches(node.entity, tag) && visit(node.entity)) return true;
+                } else {
+                    stack.push_back(node.left);
+                    stack.push_back(node.right);
+                }
+            }
+            return false;
+        }
+
+        // These append the matching entities to "results"
+        void queryFrustum(const glm::vec4 (&planes)[6], std::vector<Entity*>& results) const;
+        void queryOverlaps(const AABB& bounds, std::vector<Entity*>& results, Symbol tag = Symbol()) const;
+        // Returns the first box (with the tag if given) hit by the ray within "maxDistance".
+        // The direction does not have to be normalized (the distance is then measured in multiples of its length).
+        RayHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = INFINITY, Symbol tag = Symbol()) const;
+    };
+
+}
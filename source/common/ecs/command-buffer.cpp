@@ -0,0 +1,113 @@
+#include "command-buffer.hpp"
+#include "world.hpp"
+
+#include <atomic>
+
+namespace our {
+
+    namespace {
+        // Every command buffer gets a different id, so a thread never mistakes a new buffer for an old one allocated at the same address
+        std::atomic<uint64_t> nextBufferId{1};
+
+        // The last queue used by this thread. Most threads record into a single buffer, so this avoids locking after the first command.
+        struct CachedQueue {
+            uint64_t bufferId = 0;
+            void* queue = nullptr;
+        };
+        thread_local CachedQueue cachedQueue;
+    }
+
+    CommandBuffer::CommandBuffer(World* world) : world(world), bufferId(nextBufferId++) {}
+
+    CommandBuffer::Queue& CommandBuffer::getQueue(){
+        if(cachedQueue.bufferId == bufferId) return *static_cast<Queue*>(cachedQueue.queue);
+        // The queues are never deleted before the buffer, so the cached pointer stays valid
+        std::lock_guard<std::mutex> lock(mutex);
+        std::thread::id thread = std::this_thread::get_id();
+        // The thread may already have a queue if it recorded into another buffer since
+        for(auto& queue : queues){
+            if(queue->thread == thread){
+                cachedQueue = {bufferId, queue.get()};
+                return *queue;
+            }
+        }
+        auto queue = std::make_unique<Queue>();
+        queue->id = static_cast<uint32_t>(queues.size());
+        queue->thread = thread;
+        queues.push_back(std::move(queue));
+        cachedQueue = {bufferId, queues.back().get()};
+        return *queues.back();
+    }
+
+    void CommandBuffer::record(Target target, Command::Kind kind, std::function<void(Entity*)> apply){
+        getQueue().commands.push_back({kind, target, std::move(apply)});
+    }
+
+    CommandBuffer::PendingEntity CommandBuffer::create(std::function<void(Entity*)> setup){
+        Queue& queue = getQueue();
+        PendingEntity pending = {queue.id, queue.createCount++};
+        queue.commands.push_back({Command::Kind::CREATE, Target(), std::move(setup)});
+        return pending;
+    }
+
+    void CommandBuffer::destroy(EntityHandle entity){
+        record({entity}, Command::Kind::DESTROY, nullptr);
+    }
+
+    Entity* CommandBuffer::resolve(const Queue& queue, const Target& target){
+        if(target.pending != UINT32_MAX) return world->getEntity(queue.created[target.pending]);
+        return world->getEntity(target.handle);
+    }
+
+    void CommandBuffer::flush(){
+        // The applied commands may record new ones (e.g. the setup of a created entity), which are applied in the same flush.
+        // They go to the queue of the flushing thread, which may come before the queue being applied (or may be new),
+        // so the queues are visited again until none of them has commands left to apply.
+        // Each queue remembers how many of its commands were applied, so its commands are still applied in order.
+        bool applying = true;
+        while(applying){
+            applying = false;
+            // The queues are visited by index since a new queue may be added while they are applied
+            for(size_t queueIndex = 0; queueIndex < queues.size(); ++queueIndex){
+                Queue& queue = *queues[queueIndex];
+                if(queue.applied < queue.commands.size()) applying = true;
+                applyQueue(queue);
+            }
+        }
+        // The memory of the queues is kept to be reused by the next flush
+        discard();
+        world->deleteMarkedEntities();
+    }
+
+    void CommandBuffer::applyQueue(Queue& queue){
+        // The commands are visited by index since applying them may add commands to this queue
+        while(queue.applied < queue.commands.size()){
+            Command command = std::move(queue.commands[queue.applied++]);
+            switch(command.kind){
+            case Command::Kind::CREATE: {
+                Entity* entity = world->add();
+                queue.created.push_back(entity->getHandle());
+                if(command.apply) command.apply(entity);
+                break;
+            }
+            case Command::Kind::DESTROY:
+                // The entities are deleted together at the end, so the commands recorded after this one can still see the entity
+                if(Entity* entity = resolve(queue, command.target)) world->markForRemoval(entity);
+                break;
+            case Command::Kind::APPLY:
+                if(Entity* entity = resolve(queue, command.target)) command.apply(entity);
+                break;
+            }
+        }
+    }
+
+    void CommandBuffer::discard(){
+        for(auto& queue : queues){
+            queue->commands.clear();
+            queue->applied = 0;
+            queue->created.clear();
+            queue->createCount = 0;
+        }
+    }
+
+}
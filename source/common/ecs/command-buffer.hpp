@@ -0,0 +1,119 @@
+#pragma once
+
+#include "entity.hpp"
+#include "entity-handle.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include <cassert>
+
+namespace our {
+
+    class World; // A forward declaration of the World Class
+
+    // A command buffer records structural changes to a world (creating & destroying entities, adding & removing components)
+    // so that they can be applied later at a well defined point (see "World::flushCommands") instead of while the systems
+    // are iterating over the entities and the components.
+    // Each thread records into its own queue, so systems running in parallel can record commands without waiting for each other.
+    // When the buffer is flushed, the queues are applied one after the other (each queue in the order it was recorded),
+    // again and again until the applied commands record no new ones, then all the destroyed entities are deleted together.
+    class CommandBuffer {
+    public:
+        // A reference to an entity whose creation was recorded in this buffer but which does not exist yet.
+        // It can be used to record more commands on the new entity (on the thread that recorded the creation).
+        struct PendingEntity {
+            uint32_t queue;
+            uint32_t index; // The index of the creation in the queue
+        };
+
+    private:
+        // The entity targeted by a command: either an existing entity (handle) or one created by an earlier command of the same queue
+        struct Target {
+            EntityHandle handle;
+            uint32_t pending = UINT32_MAX;
+        };
+
+        struct Command {
+            enum class Kind { CREATE, DESTROY, APPLY } kind;
+            Target target;
+            std::function<void(Entity*)> apply; // The setup of a created entity or the change applied to an entity
+        };
+
+        struct Queue {
+            uint32_t id;
+            std::thread::id thread; // The thread that records into this queue
+            std::vector<Command> commands;
+            size_t applied = 0;                // The number of commands already applied by the current flush
+            std::vector<EntityHandle> created; // Filled while flushing: the handles of the entities created by this queue
+            uint32_t createCount = 0;          // The number of creations recorded since the last flush
+        };
+
+        World* world;
+        uint64_t bufferId; // A unique id which identifies this buffer in the thread local cache (see "getQueue")
+        std::vector<std::unique_ptr<Queue>> queues; // One queue for each thread that recorded into this buffer
+        std::mutex mutex; // Guards "queues" (only locked the first time a thread records into this buffer)
+
+        // Returns the queue of the calling thread (creating it if needed)
+        Queue& getQueue();
+        void record(Target target, Command::Kind kind, std::function<void(Entity*)> apply);
+        // Applies the commands of the queue that were not applied yet (including those recorded while they are applied)
+        void applyQueue(Queue& queue);
+        // Returns the entity targeted by a command while flushing (or nullptr if it no longer exists)
+        Entity* resolve(const Queue& queue, const Target& target);
+
+    public:
+        explicit CommandBuffer(World* world);
+
+        // Records the creation of an entity. "setup" (if any) is called on the new entity when the buffer is flushed.
+        PendingEntity create(std::function<void(Entity*)> setup = nullptr);
+        // Records the deletion of an entity (nothing happens if the entity was already deleted when the buffer is flushed)
+        void destroy(EntityHandle entity);
+        void destroy(Entity* entity) { destroy(entity->getHandle()); }
+
+        // Records adding a component of type T to an entity. "setup" (if any) is called on the new component when the buffer is flushed.
+        template<typename T>
+        void addComponent(EntityHandle entity, std::function<void(T&)> setup = nullptr) {
+            record({entity}, Command::Kind::APPLY, makeAddComponent<T>(std::move(setup)));
+        }
+        template<typename T>
+        void addComponent(PendingEntity entity, std::function<void(T&)> setup = nullptr) {
+            record(pendingTarget(entity), Command::Kind::APPLY, makeAddComponent<T>(std::move(setup)));
+        }
+
+        // Records removing the component of type T from an entity
+        template<typename T>
+        void removeComponent(EntityHandle entity) {
+            record({entity}, Command::Kind::APPLY, [](Entity* target){ target->deleteComponent<T>(); });
+        }
+
+        // Applies all the recorded commands then clears the buffer. It must not be called while other threads are recording.
+        void flush();
+        // Drops all the recorded commands without applying them (e.g. when the world is cleared)
+        void discard();
+
+        // Command buffers should not be copyable
+        CommandBuffer(const CommandBuffer&) = delete;
+        CommandBuffer& operator=(CommandBuffer const&) = delete;
+
+    private:
+        template<typename T>
+        static std::function<void(Entity*)> makeAddComponent(std::function<void(T&)> setup) {
+            return [setup = std::move(setup)](Entity* target){
+                T* component = target->addComponent<T>();
+                if(setup) setup(*component);
+            };
+        }
+
+        Target pendingTarget(PendingEntity entity) {
+            assert(entity.queue == getQueue().id && "A pending entity can only be used on the thread that recorded its creation");
+            Target target;
+            target.pending = entity.index;
+            return target;
+        }
+    };
+
+}
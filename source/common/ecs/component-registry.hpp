@@ -0,0 +1,76 @@
+#pragma once
+
+#include "entity.hpp"
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <memory>
+
+namespace our {
+
+    // The component registry knows every component type that can be created by name (e.g. during deserialization).
+    // Each registered type is stored at its component type id with its name (as returned by "T::getID()")
+    // and the functions that add a component of that type to an entity, create a standalone one (e.g. the prototypes of a prefab)
+    // or copy one into an entity.
+    // Creating a component by name costs a single hash lookup instead of a chain of string comparisons.
+    class ComponentRegistry {
+        // The information stored for each registered component type
+        struct Entry {
+            std::string name;
+            Component* (*add)(Entity*) = nullptr;
+            Component* (*create)() = nullptr;
+            Component* (*copy)(Entity*, const Component&) = nullptr;
+            void (*reserve)(ComponentStorage&, size_t) = nullptr;
+        };
+        std::array<Entry, MAX_COMPONENT_TYPES> entries; // The registered types indexed by their component type id
+        std::unordered_map<std::string, ComponentTypeId> types; // Maps the name of each registered type to its component type id
+    public:
+        // Registers the component type T under the name returned by "T::getID()"
+        template<typename T>
+        void registerComponent(){
+            static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+            const ComponentTypeId type = componentTypeId<T>;
+            entries[type].name = T::getID();
+            entries[type].add = [](Entity* entity) -> Component* { return entity->addComponent<T>(); };
+            entries[type].create = []() -> Component* { return new T(); };
+            entries[type].copy = [](Entity* entity, const Component& prototype) -> Component* {
+                return entity->addComponentCopy<T>(static_cast<const T&>(prototype));
+            };
+            entries[type].reserve = [](ComponentStorage& storage, size_t count){ storage.getPool<T>().reserve(count); };
+            types[T::getID()] = type;
+        }
+
+        // Adds a component whose type is registered under the given name to the entity and returns it
+        // If no type was registered with that name, nothing is added and nullptr is returned
+        Component* addComponent(const std::string& name, Entity* entity) const {
+            if(auto it = types.find(name); it != types.end())
+                return entries[it->second].add(entity);
+            return nullptr;
+        }
+
+        // Creates a standalone component whose type is registered under the given name and stores its type id in "type"
+        // If no type was registered with that name, nullptr is returned
+        std::unique_ptr<Component> create(const std::string& name, ComponentTypeId& type) const {
+            auto it = types.find(name);
+            if(it == types.end()) return nullptr;
+            type = it->second;
+            return std::unique_ptr<Component>(entries[type].create());
+        }
+
+        // Adds a copy of the prototype (whose type id is "type") to the entity without telling the world (see "Entity::addComponentCopy")
+        Component* copyComponent(ComponentTypeId type, Entity* entity, const Component& prototype) const {
+            return entries[type].copy(entity, prototype);
+        }
+
+        // Allocates room for "count" more components of the given type in the storage
+        void reserve(ComponentTypeId type, ComponentStorage& storage, size_t count) const {
+            entries[type].reserve(storage, count);
+        }
+
+        // Returns the name of the given component type (or an empty string if it was not registered)
+        const std::string& getName(ComponentTypeId type) const {
+            return entries[type].name;
+        }
+    };
+
+}
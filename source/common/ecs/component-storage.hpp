@@ -0,0 +1,176 @@
+#pragma once
+
+#include "component.hpp"
+#include <vector>
+#include <memory>
+#include <array>
+#include <type_traits>
+#include <iterator>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace our {
+
+    // This is the base class for all the component pools.
+    // It allows the storage (and the entities) to hold pools of different component types in the same container
+    // and to access or remove a component without knowing its concrete type.
+    class ComponentPoolBase {
+    public:
+        // Returns the component at the given index in the pool
+        virtual Component* at(uint32_t index) = 0;
+        // Destroys the component at the given index.
+        // To keep the pool packed, the last component is moved into the freed slot and it is returned
+        // so that its owner can update its slot. If no component was moved, nullptr is returned.
+        virtual Component* removeAt(uint32_t index) = 0;
+        // Destroys all the components in this pool
+        virtual void clear() = 0;
+        // Allocates the pages needed to hold "count" more components (so adding them does not allocate)
+        virtual void reserve(size_t count) = 0;
+        // Returns the number of components in this pool
+        virtual size_t size() const = 0;
+
+        virtual ~ComponentPoolBase() = default;
+    };
+
+    // A component pool stores all the components of type T in the world contiguously in fixed-size pages,
+    // so iterating over all the components of a type is a linear walk over memory (instead of chasing a heap pointer per component).
+    // Each entity remembers the index of each of its components in its slot table (see "Entity"), which makes
+    // the entities the sparse side of the set and the pools the dense side.
+    // Pages are never moved once allocated, so adding a component never invalidates pointers to the others.
+    template<typename T>
+    class ComponentPool : public ComponentPoolBase {
+        static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+    public:
+        // Each page holds 2^PAGE_BITS components
+        static constexpr size_t PAGE_BITS = 10;
+        static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    private:
+        // Uninitialized storage for a single component (components are constructed in-place when added)
+        using Storage = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+        std::vector<std::unique_ptr<Storage[]>> pages; // The pages holding the components
+        size_t count = 0;                               // The number of components in the pool
+
+        T* slot(size_t index) {
+            return std::launder(reinterpret_cast<T*>(&pages[index >> PAGE_BITS][index & (PAGE_SIZE - 1)]));
+        }
+        const T* slot(size_t index) const {
+            return std::launder(reinterpret_cast<const T*>(&pages[index >> PAGE_BITS][index & (PAGE_SIZE - 1)]));
+        }
+
+    public:
+        ComponentPool() = default;
+
+        // Creates a component at the end of the pool and returns a pointer to it (its index is size() - 1)
+        // The arguments are passed to the constructor of the component (e.g. a component to copy)
+        template<typename... Args>
+        T* emplace(Args&&... args) {
+            size_t index = count;
+            if((index >> PAGE_BITS) >= pages.size())
+                pages.emplace_back(new Storage[PAGE_SIZE]);
+            T* component = new (slot(index)) T(std::forward<Args>(args)...);
+            ++count;
+            return component;
+        }
+
+        void reserve(size_t extra) override {
+            size_t neededPages = (count + extra + PAGE_SIZE - 1) >> PAGE_BITS;
+            pages.reserve(neededPages);
+            while(pages.size() < neededPages) pages.emplace_back(new Storage[PAGE_SIZE]);
+        }
+
+        T* at(uint32_t index) override { return slot(index); }
+
+        T* removeAt(uint32_t index) override {
+            size_t last = count - 1;
+            T* moved = nullptr;
+            if(index != last){
+                *slot(index) = std::move(*slot(last));
+                moved = slot(index);
+            }
+            slot(last)->~T();
+            --count;
+            return moved;
+        }
+
+        void clear() override {
+            for(size_t index = 0; index < count; ++index) slot(index)->~T();
+            // The memory is released page by page instead of component by component
+            pages.clear();
+            count = 0;
+        }
+
+        size_t size() const override { return count; }
+
+        // Access the i-th component in the pool (0 <= index < size())
+        T& operator[](size_t index) { return *slot(index); }
+        const T& operator[](size_t index) const { return *slot(index); }
+
+        // A simple iterator that walks over the pool page by page
+        class iterator {
+            ComponentPool* pool;
+            size_t index;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+
+            iterator(ComponentPool* pool, size_t index) : pool(pool), index(index) {}
+            T& operator*() const { return (*pool)[index]; }
+            T* operator->() const { return &(*pool)[index]; }
+            iterator& operator++() { ++index; return *this; }
+            iterator operator++(int) { iterator old = *this; ++index; return old; }
+            bool operator==(const iterator& other) const { return index == other.index; }
+            bool operator!=(const iterator& other) const { return index != other.index; }
+        };
+
+        iterator begin() { return iterator(this, 0); }
+        iterator end() { return iterator(this, count); }
+
+        ~ComponentPool() override { clear(); }
+
+        // Pools should not be copyable
+        ComponentPool(const ComponentPool&) = delete;
+        ComponentPool& operator=(ComponentPool const&) = delete;
+    };
+
+    // The component storage owns one pool for each component type used in a world.
+    // The pools are indexed by the component type id and are created on demand the first time a component of a certain type is added.
+    // It also holds the change version of the world which is used to stamp the components when they are added or changed.
+    class ComponentStorage {
+        std::array<std::unique_ptr<ComponentPoolBase>, MAX_COMPONENT_TYPES> pools;
+        uint32_t changeVersion = 1; // It only increases (even when the storage is cleared), so older stamps never look new
+    public:
+        ComponentStorage() = default;
+
+        uint32_t getChangeVersion() const { return changeVersion; }
+        uint32_t advanceChangeVersion() { return ++changeVersion; }
+
+        // Returns the pool of components of type T (creating it if it does not exist yet)
+        template<typename T>
+        ComponentPool<T>& getPool() {
+            auto& pool = pools[componentTypeId<T>];
+            if(!pool) pool = std::make_unique<ComponentPool<T>>();
+            return *static_cast<ComponentPool<T>*>(pool.get());
+        }
+
+        // Returns the pool of components with the given type id, or nullptr if no component of that type was ever added
+        ComponentPoolBase* findPool(ComponentTypeId type) {
+            return pools[type].get();
+        }
+
+        // Destroys all the components in all the pools
+        void clear() {
+            for(auto& pool : pools) if(pool) pool->clear();
+        }
+
+        // The storage should not be copyable
+        ComponentStorage(const ComponentStorage&) = delete;
+        ComponentStorage &operator=(ComponentStorage const &) = delete;
+    };
+
+}
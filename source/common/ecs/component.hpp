@@ -2,17 +2,49 @@
 
 #include <json/json.hpp>
 #include <string>
+#include <cstdint>
+#include <cassert>
 
 namespace our {
 
     class Entity; // A forward declaration of the Entity Class
 
+    // Every component type gets a small integer id which is used to index the component pools, the entity slot tables
+    // and the bits of a component mask. The ids are generated once per type from a template (see "componentTypeId")
+    // so looking up a component never needs a string comparison or a dynamic_cast.
+    typedef uint32_t ComponentTypeId;
+    // A component mask holds one bit for each component type (bit i is set if the component type with id i is present)
+    typedef uint64_t ComponentMask;
+    // The maximum number of component types (it is bounded by the number of bits in a component mask)
+    constexpr ComponentTypeId MAX_COMPONENT_TYPES = 64;
+
+    namespace internal {
+        // The id that will be given to the next component type (constant-initialized to 0 before any dynamic initialization)
+        inline ComponentTypeId nextComponentTypeId = 0;
+        inline ComponentTypeId generateComponentTypeId() {
+            assert(nextComponentTypeId < MAX_COMPONENT_TYPES && "Too many component types");
+            return nextComponentTypeId++;
+        }
+    }
+
+    // The id of the component type T. Each instantiation of this variable template is initialized once with a new id.
+    template<typename T>
+    inline const ComponentTypeId componentTypeId = internal::generateComponentTypeId();
+
+    // Returns a mask with the bits of all the given component types set
+    template<typename... T>
+    inline ComponentMask componentMask() {
+        return (ComponentMask(0) | ... | (ComponentMask(1) << componentTypeId<T>));
+    }
+
     // A component is a data container that can be added to an entity.
     // The role of the entity in the world is defined by the components it holds.
     // For example, an entity with a camera component specifies that this entity should be used as a camera
     // Thus any renderer system should look for an entity holding a camera component in order to compute the camera related uniforms (e.g. VP matrix)
     class Component {
         Entity* owner; // A pointer to the entity that owns this component
+        // The change version of the world when this component was added or last changed (see "Entity::getMutableComponent")
+        uint32_t changeVersion = 0;
         friend Entity; // The entity is a friend since it is the only one allowed to set itself as an owner of a certain component.
     public:
         // This static method returns a unique string that identifies each type of components
@@ -24,6 +56,10 @@ namespace our {
         virtual void deserialize(const nlohmann::json& data) = 0;
         // Returns the owner of this component
         Entity* getOwner() const { return owner; }
+        // Returns the change version of the world when this component was added or last changed
+        uint32_t getChangeVersion() const { return changeVersion; }
+        // Returns true if this component was added or changed after the given change version
+        bool changedSince(uint32_t version) const { return changeVersion > version; }
         // Define a virtual destructor
         virtual ~Component(){}
     };
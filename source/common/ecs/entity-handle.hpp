@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+namespace our {
+
+    // A handle is a stable reference to an entity which can be kept across frames.
+    // It holds the index of the entity's slot in its world's entity pool and the generation of that slot when the handle was made.
+    // Once the entity is destroyed, the generation of the slot changes, so the world returns nullptr for the handle
+    // (instead of a dangling pointer or the entity that reused the slot). Use "World::getEntity" to get the entity of a handle.
+    struct EntityHandle {
+        static constexpr uint32_t NULL_INDEX = UINT32_MAX;
+
+        uint32_t index = NULL_INDEX; // The index of the slot in the entity pool
+        uint32_t generation = 0;     // The generation of the slot when the handle was made
+
+        // A default constructed handle refers to no entity
+        bool isNull() const { return index == NULL_INDEX; }
+
+        bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+    };
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "entity.hpp"
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+#include <new>
+
+namespace our {
+
+    // The entity pool allocates the entities of a world in fixed-size pages (like the component pools do for the components).
+    // Each entity lives in a slot which is reused after the entity is destroyed, so creating and destroying entities
+    // does not go through the allocator, and deleting a whole world only releases its pages.
+    // Every slot has a generation which is incremented whenever its entity is destroyed, so the handles to the destroyed entity
+    // (see "EntityHandle") become invalid instead of pointing to whatever entity reuses the slot later.
+    class EntityPool {
+    public:
+        // Each page holds 2^PAGE_BITS entities
+        static constexpr size_t PAGE_BITS = 8;
+        static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    private:
+        using Storage = std::aligned_storage_t<sizeof(Entity), alignof(Entity)>;
+
+        struct Slot {
+            uint32_t generation = 0; // Incremented whenever the entity in this slot is destroyed
+            uint32_t denseIndex = 0; // The index of the entity in "entities" (if the slot is alive)
+            bool alive = false;
+        };
+
+        std::vector<std::unique_ptr<Storage[]>> pages; // The pages holding the entities
+        std::vector<Slot> slots;                        // The state of every slot in the pages
+        std::vector<uint32_t> freeSlots;                // The slots that can be reused
+        std::vector<Entity*> entities;                  // The alive entities (packed, in no particular order)
+
+        Entity* slot(uint32_t index) {
+            return std::launder(reinterpret_cast<Entity*>(&pages[index >> PAGE_BITS][index & (PAGE_SIZE - 1)]));
+        }
+        const Entity* slot(uint32_t index) const {
+            return std::launder(reinterpret_cast<const Entity*>(&pages[index >> PAGE_BITS][index & (PAGE_SIZE - 1)]));
+        }
+
+    public:
+        EntityPool() = default;
+
+        // Constructs a new entity in a free slot (or a new one) and returns a pointer to it
+        Entity* create() {
+            uint32_t index;
+            if(!freeSlots.empty()){
+                index = freeSlots.back();
+                freeSlots.pop_back();
+            } else {
+                index = static_cast<uint32_t>(slots.size());
+                slots.emplace_back();
+            }
+            // The pages are released by "clear", so the page of a reused slot may have to be allocated again
+            size_t page = index >> PAGE_BITS;
+            if(page >= pages.size()) pages.resize(page + 1);
+            if(!pages[page]) pages[page].reset(new Storage[PAGE_SIZE]);
+            Entity* entity = new (slot(index)) Entity();
+            entity->poolIndex = index;
+            entity->generation = slots[index].generation;
+            slots[index].alive = true;
+            slots[index].denseIndex = static_cast<uint32_t>(entities.size());
+            entities.push_back(entity);
+            return entity;
+        }
+
+        // Makes room for "count" more entities, so creating them does not reallocate the lists
+        void reserve(size_t count) {
+            size_t newSlots = count > freeSlots.size() ? count - freeSlots.size() : 0; // The free slots are reused first
+            slots.reserve(slots.size() + newSlots);
+            entities.reserve(entities.size() + count);
+        }
+
+        // Destroys the given entity and frees its slot
+        void destroy(Entity* entity) {
+            uint32_t index = entity->poolIndex;
+            Slot& freed = slots[index];
+            // The last entity in the packed list takes the place of the destroyed one
+            Entity* last = entities.back();
+            entities[freed.denseIndex] = last;
+            slots[last->poolIndex].denseIndex = freed.denseIndex;
+            entities.pop_back();
+
+            entity->~Entity();
+            freed.alive = false;
+            ++freed.generation;
+            freeSlots.push_back(index);
+        }
+
+        // Returns the entity referred to by the handle, or nullptr if that entity was destroyed (or the handle is null)
+        Entity* get(EntityHandle handle) {
+            if(handle.index >= slots.size()) return nullptr;
+            const Slot& target = slots[handle.index];
+            if(!target.alive || target.generation != handle.generation) return nullptr;
+            return slot(handle.index);
+        }
+
+        // Returns true if the entity is alive in this pool. The entity must belong to a pool (of any world),
+        // since its slot index is read: the entity is in this pool if that slot is alive and holds this very entity.
+        bool contains(const Entity* entity) const {
+            uint32_t index = entity->poolIndex;
+            return index < slots.size() && slots[index].alive && slot(index) == entity;
+        }
+
+        // Returns the alive entities
+        const std::vector<Entity*>& getEntities() const { return entities; }
+
+        // Destroys all the entities then releases the pages.
+        // The entities must not refer to each other anymore (no parent or children) and must not own any component,
+        // since they are destroyed in no particular order (see "World::clear").
+        // The generations of the slots are kept, so the handles to the destroyed entities stay invalid when the slots are reused.
+        void clear() {
+            for(auto entity : entities){
+                Slot& freed = slots[entity->poolIndex];
+                freed.alive = false;
+                ++freed.generation;
+                entity->~Entity();
+            }
+            entities.clear();
+            pages.clear();
+            // The slots are reused in order, so the first entities created afterwards are packed in the first pages
+            freeSlots.clear();
+            for(size_t index = slots.size(); index > 0; --index) freeSlots.push_back(static_cast<uint32_t>(index - 1));
+        }
+
+        ~EntityPool() { clear(); }
+
+        // Pools should not be copyable
+        EntityPool(const EntityPool&) = delete;
+        EntityPool& operator=(EntityPool const&) = delete;
+    };
+
+}
@@ -1,4 +1,6 @@
 #include "entity.hpp"
+#include "world.hpp"
+#include "transform-kernel.hpp"
 #include "../deserialize-utils.hpp"
 #include "../components/component-deserializer.hpp"
 
@@ -10,21 +12,94 @@ namespace our {
     // Remember that you can get the transformation matrix from this entity to its parent from "localTransform"
     // To get the local to world matrix, you need to combine this entities matrix with its parent's matrix and
     // its parent's parent's matrix and so on till you reach the root.
-    glm::mat4 Entity::getLocalToWorldMatrix() const {
+    // The ancestors are brought up to date first (root first), then the cached matrix of this entity is refreshed if needed.
+    // Once "World::updateTransforms" ran for the frame, this only compares the cached values and returns.
+    const glm::mat4& Entity::getLocalToWorldMatrix() const {
         //TODO: (Req 8) Write this function
-        glm::mat4 localToWorldMatrix=localTransform.toMat4();
-        Entity* entityParent = parent;
-        while(entityParent != nullptr){
-            localToWorldMatrix= entityParent->localTransform.toMat4() * localToWorldMatrix;
-            entityParent=entityParent->parent;
-        } 
-        return localToWorldMatrix;
+        if(parent) parent->getLocalToWorldMatrix();
+        updateWorldMatrix();
+        return worldMatrix;
+    }
+
+    // Updates the composed transform if the local transform changed and returns true if it did
+    bool Entity::refreshComposedTransform() const {
+        if(localTransform == composedTransform) return false;
+        if(!localTransform.hasSameRotation(composedTransform))
+            composedOrientation = localTransform.getOrientation();
+        composedTransform = localTransform;
+        return true;
+    }
+
+    // Recomputes the cached matrices if needed, assuming that the parent's matrices are already up to date
+    void Entity::updateWorldMatrix() const {
+        if(!isWorldMatrixStale(refreshComposedTransform())) return;
+        composeTransform(composedTransform.position, composedOrientation, composedTransform.scale,
+                         parent ? &parent->worldMatrix : nullptr, localMatrix, worldMatrix);
+        onWorldMatrixComposed();
+    }
+
+    // Changes the parent of this entity and moves it to the child list of its new parent
+    void Entity::setParent(Entity* newParent){
+        if(newParent == parent) return;
+        if(parent) parent->children.erase(std::find(parent->children.begin(), parent->children.end(), this));
+        parent = newParent;
+        if(parent) parent->children.push_back(this);
+        transformDirty = true;
+    }
+
+    // Tells the world that the component types held by this entity changed (so it can update its views)
+    void Entity::onComponentMaskChanged(ComponentMask oldMask){
+        world->updateViews(this, oldMask, mask);
+        world->onBoundsSourceChanged(this, oldMask, mask);
+    }
+
+    // Renames this entity and moves it to its new name in the world's name index
+    void Entity::setName(Symbol newName){
+        if(newName == name) return;
+        world->onNameChanged(this, name, newName);
+        name = newName;
+    }
+
+    // Adds a tag to this entity and to the world's tag index
+    void Entity::addTag(Symbol tag){
+        if(hasTag(tag)) return;
+        tags.push_back(tag);
+        world->onTagAdded(this, tag);
+    }
+
+    // Removes a tag from this entity and from the world's tag index
+    void Entity::removeTag(Symbol tag){
+        auto it = std::find(tags.begin(), tags.end(), tag);
+        if(it == tags.end()) return;
+        tags.erase(it);
+        world->onTagRemoved(this, tag);
+    }
+
+    Entity::~Entity(){
+        for(auto type : components) removeComponentByType(type);
+        components.clear();
+        for(auto child : children){
+            child->parent = nullptr;
+            child->transformDirty = true;
+        }
+        if(parent) parent->children.erase(std::find(parent->children.begin(), parent->children.end(), this));
+        world->spatialGrid.remove(this);
+        if(boundsLeaf >= 0) world->boundsHierarchy.remove(boundsLeaf);
+        setName(Symbol());
+        for(auto tag : tags) world->onTagRemoved(this, tag);
+        tags.clear();
     }
 
     // Deserializes the entity data and components from a json object
     void Entity::deserialize(const nlohmann::json& data){
         if(!data.is_object()) return;
-        name = data.value("name", name);
+        if(data.contains("name")) setName(data["name"].get<std::string>());
+        // The tags are given as an array of strings, e.g. "tags": ["block"]
+        if(data.contains("tags")){
+            if(const auto& tagsData = data["tags"]; tagsData.is_array()){
+                for(auto& tag : tagsData) addTag(tag.get<std::string>());
+            }
+        }
         localTransform.deserialize(data);
         if(data.contains("components")){
             if(const auto& components = data["components"]; components.is_array()){
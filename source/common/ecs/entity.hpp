@@ -1,8 +1,13 @@
 #pragma once
 
 #include "component.hpp"
+#include "component-storage.hpp"
 #include "transform.hpp"
-#include <list>
+#include "entity-handle.hpp"
+#include "symbol.hpp"
+#include <vector>
+#include <array>
+#include <algorithm>
 #include <iterator>
 #include <string>
 #include <glm/glm.hpp>
@@ -13,107 +18,239 @@ namespace our {
 
     class Entity{
         World *world; // This defines what world own this entity
-        std::list<Component*> components; // A list of components that are owned by this entity
+        uint32_t poolIndex = 0;  // The index of the slot in which the entity is allocated in the world's entity pool
+        uint32_t generation = 0; // The generation of that slot when the entity was created (see "EntityHandle")
+        ComponentStorage* storage; // The storage (owned by the world) in which the components of this entity are packed
+        ComponentMask mask = 0; // Bit i is set if the entity has a component whose type id is i
+        std::array<uint32_t, MAX_COMPONENT_TYPES> slots; // slots[i] is the index of the entity's component of type id i in its pool
+        std::vector<ComponentTypeId> components; // The type ids of the components of this entity (in the order the components were added)
+
+        Entity* parent = nullptr;       // The parent of the entity. The transform of the entity is relative to its parent.
+                                        // If parent is null, the entity is a root entity (has no parent).
+        std::vector<Entity*> children;  // The entities whose parent is this entity
+
+        // The transform cache: composing a transform is expensive, so each entity keeps its local and world matrices
+        // and only recomputes them when its local transform or one of its ancestors changed.
+        // A change is detected by comparing "localTransform" against the values from which the matrices were composed,
+        // and by comparing the version of the parent's world matrix against the one this entity's world matrix was built from.
+        // The rotation is cached as a quaternion, so the euler angles are only converted (3 sin/cos pairs) when they change.
+        mutable Transform composedTransform;            // The local transform from which "localMatrix" was composed
+        mutable glm::quat composedOrientation = glm::quat(1, 0, 0, 0); // The rotation of "composedTransform" as a quaternion
+        mutable glm::mat4 localMatrix = glm::mat4(1.0f); // The cached local to parent matrix
+        mutable glm::mat4 worldMatrix = glm::mat4(1.0f); // The cached local to world matrix
+        mutable uint32_t worldVersion = 0;              // Incremented whenever "worldMatrix" is recomputed
+        mutable uint32_t parentVersion = 0;             // The parent's "worldVersion" when "worldMatrix" was last computed
+        mutable bool transformDirty = true;             // Forces the world matrix to be recomputed (e.g. after a change of parent)
+        uint32_t indexedVersion = 0;                    // The "worldVersion" of the position stored in the world's spatial grid
+        int32_t boundsLeaf = -1;                        // The leaf of this entity in the world's bounds hierarchy (-1 if it has none)
+        bool boundsStale = false;                       // Forces the bounds to be recomputed (e.g. after a mesh renderer was added)
+        mutable uint32_t transformChangeVersion = 0;    // The change version of the world when "worldMatrix" was last recomputed
+
+        // Updates "composedTransform" (and "composedOrientation") if the local transform changed and returns true if it did
+        bool refreshComposedTransform() const;
+        // Returns true if the world matrix must be recomputed (assuming "refreshComposedTransform" was already called)
+        bool isWorldMatrixStale(bool localChanged) const {
+            return localChanged || transformDirty || (parent ? parent->worldVersion : 0) != parentVersion;
+        }
+        // Marks the matrices as up to date after they were recomputed
+        void onWorldMatrixComposed() const {
+            parentVersion = parent ? parent->worldVersion : 0;
+            transformDirty = false;
+            ++worldVersion; // This tells the children that they have to recompute their world matrices
+            transformChangeVersion = storage->getChangeVersion();
+        }
+        // Recomputes the cached matrices if needed, assuming that the parent's matrices are already up to date
+        void updateWorldMatrix() const;
 
         friend World; // The world is a friend since it is the only class that is allowed to instantiate an entity
+        friend class ComponentRegistry; // The registry copies the components of the prefabs (see "addComponentCopy")
+        friend class EntityPool; // The entities are constructed in the pages of the world's entity pool
         Entity() = default; // The entity constructor is private since only the world is allowed to instantiate an entity
+
+        // Returns the component with the given type id (the entity must have a component of that type)
+        Component* getComponentByType(ComponentTypeId type) const {
+            return storage->findPool(type)->at(slots[type]);
+        }
+
+        // Removes the component with the given type id from its pool (the entity must have a component of that type)
+        // If the pool moved another component to fill the freed slot, the owner of the moved component is told about its new slot
+        void removeComponentByType(ComponentTypeId type){
+            if(Component* moved = storage->findPool(type)->removeAt(slots[type]); moved)
+                moved->getOwner()->slots[type] = slots[type];
+            ComponentMask oldMask = mask;
+            mask &= ~(ComponentMask(1) << type);
+            onComponentMaskChanged(oldMask);
+        }
+
+        // Tells the world that the component types held by this entity changed (so it can update its views)
+        void onComponentMaskChanged(ComponentMask oldMask);
+
+        // Adds a copy of the given component without telling the world (the entity must not have a component of type T).
+        // It is used to build the entities of a prefab (see "World::instantiate") which tells the world once all the components are added.
+        template<typename T>
+        T* addComponentCopy(const T& prototype){
+            const ComponentTypeId type = componentTypeId<T>;
+            ComponentPool<T>& pool = storage->getPool<T>();
+            slots[type] = static_cast<uint32_t>(pool.size());
+            T* newComponent = pool.emplace(prototype);
+            newComponent->owner = this;
+            newComponent->changeVersion = storage->getChangeVersion();
+            components.push_back(type);
+            mask |= ComponentMask(1) << type;
+            return newComponent;
+        }
+
+        Symbol name;              // The name of the entity. It could be useful to refer to an entity by its name
+        std::vector<Symbol> tags; // The tags of the entity. Many entities can share a tag (e.g. all the walls could be tagged "block")
+        // The world indexes the entities by name and by tag, so the name & tags can only be changed through the methods below
+        // which keep the indices up to date.
+
     public:
-        std::string name; // The name of the entity. It could be useful to refer to an entity by its name
-        Entity* parent;   // The parent of the entity. The transform of the entity is relative to its parent.
-                          // If parent is null, the entity is a root entity (has no parent).
         Transform localTransform; // The transform of this entity relative to its parent.
 
         World* getWorld() const { return world; } // Returns the world to which this entity belongs
 
-        glm::mat4 getLocalToWorldMatrix() const; // Computes and returns the transformation from the entities local space to the world space
+        const std::string& getName() const { return name.str(); } // Returns the name of this entity
+        Symbol getNameSymbol() const { return name; } // Returns the name of this entity as a symbol (cheaper to compare)
+        void setName(Symbol newName); // Renames this entity
+        void setName(std::string_view newName) { setName(Symbol(newName)); }
+
+        const std::vector<Symbol>& getTags() const { return tags; } // Returns the tags of this entity
+        bool hasTag(Symbol tag) const { return std::find(tags.begin(), tags.end(), tag) != tags.end(); }
+        bool hasTag(std::string_view tag) const { return hasTag(Symbol::find(tag)); }
+        void addTag(Symbol tag); // Adds a tag to this entity (if it does not have it already)
+        void addTag(std::string_view tag) { addTag(Symbol(tag)); }
+        void removeTag(Symbol tag); // Removes a tag from this entity (if it has it)
+        void removeTag(std::string_view tag) { removeTag(Symbol::find(tag)); }
+        EntityHandle getHandle() const { return {poolIndex, generation}; } // Returns a stable reference to this entity (see "EntityHandle")
+        ComponentMask getComponentMask() const { return mask; } // Returns the mask of the component types held by this entity
+
+        Entity* getParent() const { return parent; } // Returns the parent of this entity (or nullptr if it is a root entity)
+        const std::vector<Entity*>& getChildren() const { return children; } // Returns the entities whose parent is this entity
+        // Changes the parent of this entity (nullptr makes it a root entity). The entity is moved to the child list of its new parent.
+        // The parent must belong to the same world and must not be a descendant of this entity.
+        void setParent(Entity* newParent);
+
+        // Returns the transformation from the entities local space to the world space
+        // The matrix is cached, so it is only recomputed if the transform of the entity or one of its ancestors changed
+        const glm::mat4& getLocalToWorldMatrix() const;
+        // Returns the local to world matrix computed by the last update (e.g. "World::updateTransforms") without recomputing it.
+        // Unlike "getLocalToWorldMatrix", it never writes to the entity, so many threads can read it at once
+        // (as long as nothing changes the transforms meanwhile). Check "isLocalToWorldMatrixCurrent" in debug builds.
+        const glm::mat4& getCachedLocalToWorldMatrix() const { return worldMatrix; }
+        // Returns true if neither the transform of the entity nor those of its ancestors changed since the matrix was computed
+        bool isLocalToWorldMatrixCurrent() const {
+            return !isWorldMatrixStale(!(localTransform == composedTransform)) && (!parent || parent->isLocalToWorldMatrixCurrent());
+        }
+        // Returns true if the local to world matrix was recomputed after the given change version of the world
+        // (the transforms are checked for changes when the matrices are updated, e.g. by "World::updateTransforms")
+        bool transformChangedSince(uint32_t version) const { return transformChangeVersion > version; }
         void deserialize(const nlohmann::json&); // Deserializes the entity data and components from a json object
         
         // This template method create a component of type T,
         // adds it to the components map and returns a pointer to it 
+        // The component is constructed inside the world's pool of T components (not allocated individually)
+        // An entity holds at most one component of each type, so if a component of type T already exists, it is returned
         template<typename T>
         T* addComponent(){
             static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
-            //TODO: (Req 8) Create an component of type T, set its "owner" to be this entity, then push it into the component's list
-            // Don't forget to return a pointer to the new component
-            T* newComponent=new T();
-            newComponent->owner=this;
-            components.push_back(newComponent);
-
+            if(T* existing = getComponent<T>()) return existing;
+            const ComponentTypeId type = componentTypeId<T>;
+            ComponentPool<T>& pool = storage->getPool<T>();
+            slots[type] = static_cast<uint32_t>(pool.size());
+            T* newComponent = pool.emplace();
+            newComponent->owner = this;
+            newComponent->changeVersion = storage->getChangeVersion();
+            components.push_back(type);
+            ComponentMask oldMask = mask;
+            mask |= ComponentMask(1) << type;
+            onComponentMaskChanged(oldMask);
             return newComponent;
         }
 
+        // This template method returns true if the entity has a component of type T
+        template<typename T>
+        bool hasComponent() const {
+            return (mask >> componentTypeId<T>) & 1;
+        }
+
+        // This template method returns true if the entity has a component of every one of the given types
+        template<typename... T>
+        bool hasComponents() const {
+            const ComponentMask required = componentMask<T...>();
+            return (mask & required) == required;
+        }
+
         // This template method searhes for a component of type T and returns a pointer to it
         // If no component of type T was found, it returns a nullptr 
         template<typename T>
-        T* getComponent(){
-            //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
-            // Return the component you found, or return null of nothing was found.
-            for(auto component=components.begin();component!=components.end();std::advance(component,1)){
-                if (dynamic_cast<T*>(*component) != nullptr) return dynamic_cast<T*>(*component);
-            }
-            return nullptr;
+        T* getComponent() const {
+            const ComponentTypeId type = componentTypeId<T>;
+            if(!((mask >> type) & 1)) return nullptr;
+            return static_cast<T*>(getComponentByType(type));
         }
 
-        // This template method dynami and returns a pointer to it
-        // If no component of type T was found, it returns a nullptr 
+        // This template method returns the component of type T (or nullptr) and marks it as changed.
+        // It should be used instead of "getComponent" by the code that modifies the component, so the systems that
+        // only process the changed components (see "Component::changedSince" and "View::changedSince") can see the change.
         template<typename T>
-        T* getComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end())
-                return dynamic_cast<T*>(*it);
-            return nullptr;
+        T* getMutableComponent() const {
+            T* component = getComponent<T>();
+            if(component) component->changeVersion = storage->getChangeVersion();
+            return component;
         }
 
-        // This template method searhes for a component of type T and deletes it
+        // This template method marks the component of type T as changed (if the entity has one)
         template<typename T>
-        void deleteComponent(){
-            //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
-            // If found, delete the found component and remove it from the components list
-            auto component = components.begin();
-            while(component != components.end()&& dynamic_cast<T*>(*component)==nullptr  ){
-                std::advance(component,1);
-            }
-            if(component != components.end()) {
-                delete *component;
-                components.erase(component);
+        void markChanged() const {
+            getMutableComponent<T>();
+        }
+
+        // This template method returns the component at the given index (in the order the components were added)
+        // If no component was found at this index or it is not of type T, it returns a nullptr 
+        template<typename T>
+        T* getComponent(size_t index) const {
+            if(index >= components.size()) return nullptr;
+            if constexpr (std::is_same<T, Component>::value) {
+                return getComponentByType(components[index]);
+            } else {
+                if(components[index] != componentTypeId<T>) return nullptr;
+                return static_cast<T*>(getComponentByType(components[index]));
             }
         }
 
         // This template method searhes for a component of type T and deletes it
+        template<typename T>
+        void deleteComponent(){
+            const ComponentTypeId type = componentTypeId<T>;
+            if(!((mask >> type) & 1)) return;
+            removeComponentByType(type);
+            components.erase(std::find(components.begin(), components.end(), type));
+        }
+
+        // This method deletes the component at the given index (in the order the components were added)
         void deleteComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end()) {
-                delete *it;
-                components.erase(it);
+            if(index < components.size()) {
+                removeComponentByType(components[index]);
+                components.erase(components.begin() + index);
             }
         }
 
         // This template method searhes for the given component and deletes it
         template<typename T>
         void deleteComponent(T const* component){
-            //TODO: (Req 8) Go through the components list and find the given component "component".
-            // If found, delete the found component and remove it from the components list
-            for(auto comp=components.begin();comp!=components.end();std::advance(comp,1)){
-                T* it=dynamic_cast<T*>(*comp);
-                if(it!=nullptr && it == component){
-                    delete it;
-                    components.erase(comp);
+            for(auto type = components.begin(); type != components.end(); std::advance(type, 1)){
+                if(getComponentByType(*type) == component){
+                    removeComponentByType(*type);
+                    components.erase(type);
                     break;
                 }
             }
-            
         }
 
         // Since the entity owns its components, they should be deleted alongside the entity
-        ~Entity(){
-            //TODO: (Req 8) Delete all the components in "components".
-            for(auto component=components.begin();component != components.end();std::advance(component,1)){
-                delete *component;
-            }
-            components.clear();
-        }
+        // The entity is also removed from its parent's child list (its children become root entities) and from the world's indices
+        ~Entity();
 
         // Entities should not be copyable
         Entity(const Entity&) = delete;
@@ -0,0 +1,48 @@
+#include "prefab.hpp"
+#include "../components/component-deserializer.hpp"
+
+namespace our {
+
+    // Reads an entity and then its children (so the nodes are stored parent first)
+    void Prefab::deserializeNode(const nlohmann::json& data, uint32_t parent){
+        if(!data.is_object()) return;
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        Node& node = nodes.emplace_back();
+        node.parent = parent;
+        if(data.contains("name")) node.name = Symbol(data["name"].get<std::string>());
+        if(data.contains("tags")){
+            if(const auto& tagsData = data["tags"]; tagsData.is_array()){
+                for(auto& tag : tagsData) node.tags.push_back(Symbol(tag.get<std::string>()));
+            }
+        }
+        node.transform.deserialize(data);
+        if(data.contains("components")){
+            if(const auto& components = data["components"]; components.is_array()){
+                for(auto& componentData : components){
+                    ComponentTypeId type;
+                    std::unique_ptr<Component> component = getComponentRegistry().create(componentData.value("type", ""), type);
+                    if(!component) continue;
+                    // An entity holds at most one component of each type, so (like "Entity::deserialize") a repeated type
+                    // is read again into the same component
+                    Component* target = component.get();
+                    for(auto& existing : node.components)
+                        if(existing.type == type) target = existing.component.get();
+                    if(target == component.get()) node.components.push_back({type, std::move(component)});
+                    target->deserialize(componentData);
+                }
+            }
+        }
+        // "node" may be invalidated when the children are added
+        if(data.contains("children")){
+            if(const auto& children = data["children"]; children.is_array()){
+                for(auto& child : children) deserializeNode(child, index);
+            }
+        }
+    }
+
+    void Prefab::deserialize(const nlohmann::json& data){
+        nodes.clear();
+        deserializeNode(data, NO_PARENT);
+    }
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "component.hpp"
+#include "transform.hpp"
+#include "symbol.hpp"
+#include <json/json.hpp>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace our {
+
+    // A prefab is an entity template (with its children) which is read from json once then instantiated many times
+    // (see "World::instantiate"). The json has the same format as an entity in a world (see "World::deserialize").
+    // The components are deserialized once into prototypes, so instantiating a prefab only copies them into the pools
+    // instead of parsing the json again for every entity.
+    class Prefab {
+    public:
+        static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+        // A component prototype along with its type id
+        struct ComponentPrototype {
+            ComponentTypeId type;
+            std::unique_ptr<Component> component;
+        };
+
+        // An entity of the prefab. The nodes are stored parent first, so the parent of a node is always before it.
+        struct Node {
+            uint32_t parent = NO_PARENT; // The index of the parent node (NO_PARENT for the root)
+            Symbol name;
+            std::vector<Symbol> tags;
+            Transform transform;
+            std::vector<ComponentPrototype> components;
+        };
+
+    private:
+        std::vector<Node> nodes;
+
+        void deserializeNode(const nlohmann::json& data, uint32_t parent);
+
+    public:
+        Prefab() = default;
+
+        // Reads the prefab from an entity json object (with its children if any)
+        void deserialize(const nlohmann::json& data);
+
+        // Returns the nodes of the prefab (the first node is the root)
+        const std::vector<Node>& getNodes() const { return nodes; }
+        // Returns the root node of the prefab (the prefab must not be empty)
+        const Node& getRoot() const { return nodes.front(); }
+        bool empty() const { return nodes.empty(); }
+
+        // Prefabs should not be copyable
+        Prefab(const Prefab&) = delete;
+        Prefab& operator=(Prefab const&) = delete;
+    };
+
+}
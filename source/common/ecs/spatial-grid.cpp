@@ -0,0 +1,119 @@
+#include "spatial-grid.hpp"
+#include "entity.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    bool SpatialGrid::matches(const Entry& entry, Symbol tag){
+        return tag == Symbol() || entry.entity->hasTag(tag);
+    }
+
+    // Removes the entry at the given location (the last entry of the cell takes its place)
+    void SpatialGrid::removeFromCell(const Location& location){
+        auto it = cells.find(location.cell);
+        std::vector<Entry>& cell = it->second;
+        cell[location.index] = cell.back();
+        cell.pop_back();
+        if(location.index < cell.size()) locations[cell[location.index].entity].index = location.index;
+        if(cell.empty()) cells.erase(it);
+    }
+
+    void SpatialGrid::update(Entity* entity, glm::vec2 position){
+        glm::ivec2 cell = cellOf(position);
+        int64_t key = keyOf(cell);
+        auto [it, inserted] = locations.try_emplace(entity);
+        Location& location = it->second;
+        if(!inserted){
+            // Most updates move the entity inside its cell, so only its position changes
+            if(location.cell == key){
+                cells[key][location.index].position = position;
+                return;
+            }
+            Location old = location;
+            removeFromCell(old);
+        }
+        std::vector<Entry>& entries = cells[key];
+        location = {key, entries.size()};
+        entries.push_back({entity, position});
+        minCell = glm::min(minCell, cell);
+        maxCell = glm::max(maxCell, cell);
+    }
+
+    void SpatialGrid::remove(Entity* entity){
+        auto it = locations.find(entity);
+        if(it == locations.end()) return;
+        Location location = it->second;
+        locations.erase(it);
+        removeFromCell(location);
+    }
+
+    void SpatialGrid::clear(){
+        cells.clear();
+        locations.clear();
+        minCell = glm::ivec2(INT32_MAX);
+        maxCell = glm::ivec2(INT32_MIN);
+    }
+
+    void SpatialGrid::queryBox(glm::vec2 min, glm::vec2 max, std::vector<Entity*>& results, Symbol tag) const {
+        visitBox(min, max, tag, [&](const Entry& entry){ results.push_back(entry.entity); return false; });
+    }
+
+    void SpatialGrid::queryRadius(glm::vec2 center, float radius, std::vector<Entity*>& results, Symbol tag) const {
+        visitRadius(center, radius, tag, [&](const Entry& entry){ results.push_back(entry.entity); return false; });
+    }
+
+    // Visits the rings of cells around the center cell one by one (the ring "r" holds the cells at a Chebyshev distance "r").
+    // Every entity outside the rings visited so far is at least "r * cellSize" away from the center, so the search ends
+    // as soon as the farthest of the best candidates is closer than that (or the rings leave the occupied cells).
+    void SpatialGrid::queryNearest(glm::vec2 center, size_t count, std::vector<Entity*>& results, Symbol tag, float maxDistance) const {
+        if(count == 0 || cells.empty()) return;
+        const float maxDistanceSquared = maxDistance * maxDistance;
+        // The best candidates so far as a max heap on the squared distance
+        std::vector<std::pair<float, Entity*>> best;
+        auto visitCell = [&](int x, int z){
+            if(x < minCell.x || x > maxCell.x || z < minCell.y || z > maxCell.y) return;
+            auto it = cells.find(keyOf({x, z}));
+            if(it == cells.end()) return;
+            for(const Entry& entry : it->second){
+                glm::vec2 offset = entry.position - center;
+                float distanceSquared = glm::dot(offset, offset);
+                if(distanceSquared > maxDistanceSquared || !matches(entry, tag)) continue;
+                if(best.size() < count){
+                    best.emplace_back(distanceSquared, entry.entity);
+                    std::push_heap(best.begin(), best.end());
+                } else if(distanceSquared < best.front().first){
+                    std::pop_heap(best.begin(), best.end());
+                    best.back() = {distanceSquared, entry.entity};
+                    std::push_heap(best.begin(), best.end());
+                }
+            }
+        };
+
+        glm::ivec2 origin = cellOf(center);
+        // The last ring that can hold an occupied cell
+        glm::ivec2 farthest = glm::max(glm::abs(minCell - origin), glm::abs(maxCell - origin));
+        int lastRing = std::max(farthest.x, farthest.y);
+        for(int ring = 0; ring <= lastRing; ++ring){
+            if(ring == 0){
+                visitCell(origin.x, origin.y);
+            } else {
+                for(int x = origin.x - ring; x <= origin.x + ring; ++x){
+                    visitCell(x, origin.y - ring);
+                    visitCell(x, origin.y + ring);
+                }
+                for(int z = origin.y - ring + 1; z <= origin.y + ring - 1; ++z){
+                    visitCell(origin.x - ring, z);
+                    visitCell(origin.x + ring, z);
+                }
+            }
+            float reached = ring * cellSize;
+            if(reached * reached > maxDistanceSquared) break;
+            if(best.size() == count && best.front().first <= reached * reached) break;
+        }
+
+        std::sort_heap(best.begin(), best.end());
+        for(auto& [distanceSquared, entity] : best) results.push_back(entity);
+    }
+
+}
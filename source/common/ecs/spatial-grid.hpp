@@ -0,0 +1,108 @@
+#pragma once
+
+#include "symbol.hpp"
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+
+    // A uniform grid which partitions the entities of a world by their position on the XZ plane.
+    // It answers proximity queries (in a radius, in a box or the nearest entities to a point) by only visiting the cells
+    // that overlap the query, so their cost depends on the number of nearby entities instead of the size of the world.
+    // Only the occupied cells are stored (in a hash map), so the grid has no bounds.
+    // The world keeps the grid in sync with the entities' world positions (see "World::updateTransforms").
+    class SpatialGrid {
+    public:
+        // An entity stored in a cell along with its position on the XZ plane (so the queries do not need to read the entities)
+        struct Entry {
+            Entity* entity;
+            glm::vec2 position;
+        };
+
+    private:
+        // The location of an entity in the grid: its cell and its index in the cell's list
+        struct Location {
+            int64_t cell;
+            size_t index;
+        };
+
+        float cellSize;
+        std::unordered_map<int64_t, std::vector<Entry>> cells;
+        std::unordered_map<Entity*, Location> locations;
+        // The range of the cell coordinates that were ever occupied (used to bound the queries)
+        glm::ivec2 minCell = glm::ivec2(INT32_MAX), maxCell = glm::ivec2(INT32_MIN);
+
+        glm::ivec2 cellOf(glm::vec2 position) const {
+            return glm::ivec2((int)std::floor(position.x / cellSize), (int)std::floor(position.y / cellSize));
+        }
+        static int64_t keyOf(glm::ivec2 cell) {
+            return int64_t((uint64_t(uint32_t(cell.x)) << 32) | uint64_t(uint32_t(cell.y)));
+        }
+        // Returns true if the entry's entity has the tag (an empty symbol matches every entity)
+        static bool matches(const Entry& entry, Symbol tag);
+
+        void removeFromCell(const Location& location);
+
+    public:
+        // The cell size should be close to the usual query radius: smaller cells waste time on empty cells,
+        // bigger cells visit more entities that are too far.
+        explicit SpatialGrid(float cellSize = 2.0f) : cellSize(cellSize) {}
+
+        // Inserts the entity at the given position or moves it there if it is already in the grid
+        void update(Entity* entity, glm::vec2 position);
+        // Removes the entity from the grid (nothing happens if it is not in the grid)
+        void remove(Entity* entity);
+        // Removes all the entities
+        void clear();
+
+        size_t size() const { return locations.size(); }
+        float getCellSize() const { return cellSize; }
+
+        // Calls "visit(entry)" for each entity inside the box [min, max] (on the XZ plane) which has the tag (if given).
+        // If "visit" returns true, the search stops and this function returns true.
+        // Example: bool blocked = grid.visitBox(p - 1.0f, p + 1.0f, Symbol("block"), [&](const SpatialGrid::Entry& entry){ return true; });
+        template<typename Visitor>
+        bool visitBox(glm::vec2 min, glm::vec2 max, Symbol tag, Visitor&& visit) const {
+            // The cells outside the occupied range are skipped (so a big box does not visit lots of empty cells)
+            glm::ivec2 first = glm::max(cellOf(min), minCell), last = glm::min(cellOf(max), maxCell);
+            for(int x = first.x; x <= last.x; ++x){
+                for(int z = first.y; z <= last.y; ++z){
+                    auto it = cells.find(keyOf({x, z}));
+                    if(it == cells.end()) continue;
+                    for(const Entry& entry : it->second){
+                        if(entry.position.x < min.x || entry.position.x > max.x || entry.position.y < min.y || entry.position.y > max.y) continue;
+                        if(!matches(entry, tag)) continue;
+                        if(visit(entry)) return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Calls "visit(entry)" for each entity within "radius" of "center" (on the XZ plane) which has the tag (if given).
+        // If "visit" returns true, the search stops and this function returns true.
+        template<typename Visitor>
+        bool visitRadius(glm::vec2 center, float radius, Symbol tag, Visitor&& visit) const {
+            const float radiusSquared = radius * radius;
+            return visitBox(center - radius, center + radius, tag, [&](const Entry& entry){
+                glm::vec2 offset = entry.position - center;
+                return glm::dot(offset, offset) <= radiusSquared && visit(entry);
+            });
+        }
+
+        // These append the matching entities to "results"
+        void queryBox(glm::vec2 min, glm::vec2 max, std::vector<Entity*>& results, Symbol tag = Symbol()) const;
+        void queryRadius(glm::vec2 center, float radius, std::vector<Entity*>& results, Symbol tag = Symbol()) const;
+        // Appends the (up to) "count" entities nearest to "center" which have the tag (if given) and are within "maxDistance".
+        // The results are sorted from the nearest to the farthest.
+        void queryNearest(glm::vec2 center, size_t count, std::vector<Entity*>& results, Symbol tag = Symbol(),
+                          float maxDistance = INFINITY) const;
+    };
+
+}
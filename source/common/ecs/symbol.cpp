@@ -0,0 +1,55 @@
+#include "symbol.hpp"
+
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+
+namespace our {
+
+    namespace {
+        // The table of interned strings.
+        // The strings are stored in a deque so that the references returned by "Symbol::str" are never invalidated.
+        // The table is guarded by a mutex since symbols may be interned by systems running on different threads.
+        struct SymbolTable {
+            std::deque<std::string> strings;
+            std::unordered_map<std::string_view, uint32_t> ids; // The views refer to the strings in "strings"
+            std::mutex mutex;
+
+            SymbolTable() {
+                strings.emplace_back();
+                ids.emplace(strings.back(), 0);
+            }
+        };
+
+        SymbolTable& getTable() {
+            static SymbolTable table;
+            return table;
+        }
+    }
+
+    Symbol::Symbol(std::string_view text) {
+        SymbolTable& table = getTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        if(auto it = table.ids.find(text); it != table.ids.end()){
+            id = it->second;
+        } else {
+            id = static_cast<uint32_t>(table.strings.size());
+            table.strings.emplace_back(text);
+            table.ids.emplace(table.strings.back(), id);
+        }
+    }
+
+    Symbol Symbol::find(std::string_view text) {
+        SymbolTable& table = getTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        if(auto it = table.ids.find(text); it != table.ids.end()) return Symbol(it->second);
+        return Symbol(INVALID);
+    }
+
+    const std::string& Symbol::str() const {
+        SymbolTable& table = getTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        return table.strings[id == INVALID ? 0 : id];
+    }
+
+}
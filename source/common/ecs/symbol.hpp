@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <functional>
+
+namespace our {
+
+    // A symbol is an interned string: every distinct string is stored once in a global table and is referred to by its index.
+    // Comparing or hashing two symbols only compares their indices, which makes them cheap keys for the world's name & tag indices.
+    class Symbol {
+        static constexpr uint32_t INVALID = UINT32_MAX;
+        uint32_t id = 0; // The index of the string in the table (0 is the empty string)
+
+        explicit Symbol(uint32_t id) : id(id) {}
+    public:
+        // The default symbol is the empty string
+        Symbol() = default;
+        // Interns the given string (adding it to the table if it is not there yet)
+        explicit Symbol(std::string_view text);
+
+        // Returns the symbol of the given string if it was already interned, otherwise, an invalid symbol is returned
+        // This never modifies the table, so it is the one to use for lookups (a string that was never interned can not match anything)
+        static Symbol find(std::string_view text);
+
+        bool isValid() const { return id != INVALID; }
+        uint32_t getId() const { return id; }
+        // Returns the interned string (the reference stays valid for the lifetime of the program)
+        const std::string& str() const;
+
+        bool operator==(const Symbol& other) const { return id == other.id; }
+        bool operator!=(const Symbol& other) const { return id != other.id; }
+    };
+
+}
+
+// This allows symbols to be used as keys in unordered containers
+template<>
+struct std::hash<our::Symbol> {
+    size_t operator()(const our::Symbol& symbol) const { return std::hash<uint32_t>()(symbol.getId()); }
+};
@@ -0,0 +1,29 @@
+// The AVX2 version of the transform kernel.
+// This file (and only this file) is compiled with AVX2 & FMA enabled (see CMakeLists.txt), so it must stay free of any code
+// that could be shared with the other translation units. The kernel is only called if the CPU supports AVX2 (see transform-kernel.cpp).
+
+#include "transform-kernel-lanes.hpp"
+
+namespace our::internal {
+
+#if defined(OUR_TRANSFORM_KERNEL_AVX2)
+    namespace {
+        const TransformKernels avx2Kernels = {
+            "AVX2",
+            composeRange<AVX2Lanes>,
+            drawMatricesRange<AVX2Lanes>,
+            cullingMarginsRange<AVX2Lanes>
+        };
+    }
+
+    const TransformKernels* getAVX2TransformKernels(){
+        return &avx2Kernels;
+    }
+#else
+    // This file was compiled without AVX2, so only the SSE & scalar versions are available
+    const TransformKernels* getAVX2TransformKernels(){
+        return nullptr;
+    }
+#endif
+
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+// This header is private to the transform kernel (transform-kernel.cpp & transform-kernel-avx2.cpp).
+// It contains the kernel code written once against a "lanes" type which is either a single float, an SSE register or an AVX register.
+// Each translation unit instantiates it for the instruction sets it was compiled for. Everything except the stream
+// descriptions has internal linkage, so the AVX2 instantiations can never be picked by the linker in place of the others.
+// Only raw floats are used here (no glm) for the same reason.
+
+#include <cstddef>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OUR_TRANSFORM_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// The AVX2 lanes are only available in translation units compiled with AVX2 & FMA enabled (MSVC enables FMA with /arch:AVX2)
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define OUR_TRANSFORM_KERNEL_AVX2 1
+#endif
+
+namespace our::internal {
+
+    // The inputs & outputs of the transform composition (see "TransformBatch")
+    // The matrices are column major (like glm): element e is at column e / 4 and row e % 4
+    struct TransformStreams {
+        const float *positionX, *positionY, *positionZ;
+        const float *rotationX, *rotationY, *rotationZ, *rotationW;
+        const float *scaleX, *scaleY, *scaleZ;
+        const float* const* parents; // nullptr if no transform has a parent
+        float* const* locals;
+        float* const* worlds;
+    };
+
+    // The inputs & outputs of the draw matrices computation (see "computeDrawMatrices")
+    struct DrawMatrixStreams {
+        const char* localToWorld;
+        char* localToClip;
+        char* normalMatrix;
+        size_t stride; // In bytes
+    };
+
+    // The inputs & outputs of the frustum culling test (see "computeCullingMargins")
+    struct CullingStreams {
+        const char* localToWorld;
+        const char* boundingSphere; // The local center (xyz) & radius (w) of each draw
+        char* margin;
+        size_t stride; // In bytes
+    };
+
+    // The versions of the kernel compiled for a certain instruction set
+    struct TransformKernels {
+        const char* name;
+        void (*compose)(const TransformStreams& streams, size_t begin, size_t end);
+        void (*computeDrawMatrices)(const float* viewProjection, const DrawMatrixStreams& streams, size_t begin, size_t end);
+        void (*computeCullingMargins)(const float* planes, const CullingStreams& streams, size_t begin, size_t end);
+    };
+
+    // Defined in transform-kernel-avx2.cpp. Returns nullptr if that file was not compiled with AVX2 enabled.
+    const TransformKernels* getAVX2TransformKernels();
+
+    namespace {
+
+        struct ScalarLanes {
+            static constexpr size_t width = 1;
+            float value;
+            static ScalarLanes load(const float* pointer) { return {*pointer}; }
+            static ScalarLanes splat(float scalar) { return {scalar}; }
+            void store(float* pointer) const { *pointer = value; }
+            friend ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return {a.value + b.value}; }
+            friend ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return {a.value - b.value}; }
+            friend ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return {a.value * b.value}; }
+            friend ScalarLanes operator/(ScalarLanes a, ScalarLanes b) { return {a.value / b.value}; }
+            static ScalarLanes mulAdd(ScalarLanes a, ScalarLanes b, ScalarLanes c) { return {a.value * b.value + c.value}; }
+            // std::min, std::max & std::sqrt are inline functions with external linkage, so the AVX2 translation unit could emit
+            // the copy the linker keeps. The same operations are written here without calling them.
+            static ScalarLanes min(ScalarLanes a, ScalarLanes b) { return {b.value < a.value ? b.value : a.value}; }
+            static ScalarLanes max(ScalarLanes a, ScalarLanes b) { return {a.value < b.value ? b.value : a.value}; }
+#if defined(OUR_TRANSFORM_KERNEL_X86)
+            static ScalarLanes sqrt(ScalarLanes a) { return {_mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(a.value)))}; }
+#else
+            // Only the x86 builds have an AVX2 translation unit
+            static ScalarLanes sqrt(ScalarLanes a) { return {std::sqrt(a.value)}; }
+#endif
+        };
+
+#if defined(OUR_TRANSFORM_KERNEL_X86)
+        // SSE2 is part of the x86-64 baseline, so this needs no special compiler flags
+        struct SSELanes {
+            static constexpr size_t width = 4;
+            __m128 value;
+            static SSELanes load(const float* pointer) { return {_mm_loadu_ps(pointer)}; }
+            static SSELanes splat(float scalar) { return {_mm_set1_ps(scalar)}; }
+            void store(float* pointer) const { _mm_storeu_ps(pointer, value); }
+            friend SSELanes operator+(SSELanes a, SSELanes b) { return {_mm_add_ps(a.value, b.value)}; }
+            friend SSELanes operator-(SSELanes a, SSELanes b) { return {_mm_sub_ps(a.value, b.value)}; }
+            friend SSELanes operator*(SSELanes a, SSELanes b) { return {_mm_mul_ps(a.value, b.value)}; }
+            friend SSELanes operator/(SSELanes a, SSELanes b) { return {_mm_div_ps(a.value, b.value)}; }
+            static SSELanes mulAdd(SSELanes a, SSELanes b, SSELanes c) { return {_mm_add_ps(_mm_mul_ps(a.value, b.value), c.value)}; }
+            static SSELanes min(SSELanes a, SSELanes b) { return {_mm_min_ps(a.value, b.value)}; }
+            static SSELanes max(SSELanes a, SSELanes b) { return {_mm_max_ps(a.value, b.value)}; }
+            static SSELanes sqrt(SSELanes a) { return {_mm_sqrt_ps(a.value)}; }
+        };
+#endif
+
+#if defined(OUR_TRANSFORM_KERNEL_AVX2)
+        struct AVX2Lanes {
+            static constexpr size_t width = 8;
+            __m256 value;
+            static AVX2Lanes load(const float* pointer) { return {_mm256_loadu_ps(pointer)}; }
+            static AVX2Lanes splat(float scalar) { return {_mm256_set1_ps(scalar)}; }
+            void store(float* pointer) const { _mm256_storeu_ps(pointer, value); }
+            friend AVX2Lanes operator+(AVX2Lanes a, AVX2Lanes b) { return {_mm256_add_ps(a.value, b.value)}; }
+            friend AVX2Lanes operator-(AVX2Lanes a, AVX2Lanes b) { return {_mm256_sub_ps(a.value, b.value)}; }
+            friend AVX2Lanes operator*(AVX2Lanes a, AVX2Lanes b) { return {_mm256_mul_ps(a.value, b.value)}; }
+            friend AVX2Lanes operator/(AVX2Lanes a, AVX2Lanes b) { return {_mm256_div_ps(a.value, b.value)}; }
+            static AVX2Lanes mulAdd(AVX2Lanes a, AVX2Lanes b, AVX2Lanes c) { return {_mm256_fmadd_ps(a.value, b.value, c.value)}; }
+            static AVX2Lanes min(AVX2Lanes a, AVX2Lanes b) { return {_mm256_min_ps(a.value, b.value)}; }
+            static AVX2Lanes max(AVX2Lanes a, AVX2Lanes b) { return {_mm256_max_ps(a.value, b.value)}; }
+            static AVX2Lanes sqrt(AVX2Lanes a) { return {_mm256_sqrt_ps(a.value)}; }
+        };
+#endif
+
+        // Writes the 16 elements of L::width matrices (held in lanes) to the given matrices
+        template<typename L>
+        void scatterMatrices(const L (&matrix)[16], float* const* targets){
+            alignas(32) float elements[16][L::width];
+            for(int element = 0; element < 16; ++element) matrix[element].store(elements[element]);
+            for(size_t lane = 0; lane < L::width; ++lane)
+                for(int element = 0; element < 16; ++element)
+                    targets[lane][element] = elements[element][lane];
+        }
+
+        // Reads the 16 elements of L::width matrices into lanes
+        template<typename L>
+        void gatherMatrices(const float* const* sources, L (&matrix)[16]){
+            alignas(32) float elements[16][L::width];
+            for(size_t lane = 0; lane < L::width; ++lane)
+                for(int element = 0; element < 16; ++element)
+                    elements[element][lane] = sources[lane][element];
+            for(int element = 0; element < 16; ++element) matrix[element] = L::load(elements[element]);
+        }
+
+        // result = left * right (all the matrices are column major)
+        template<typename L>
+        void multiplyMatrices(const L (&left)[16], const L (&right)[16], L (&result)[16]){
+            for(int column = 0; column < 4; ++column){
+                for(int row = 0; row < 4; ++row){
+                    L sum = left[row] * right[column * 4];
+                    for(int k = 1; k < 4; ++k) sum = L::mulAdd(left[k * 4 + row], right[column * 4 + k], sum);
+                    result[column * 4 + row] = sum;
+                }
+            }
+        }
+
+        // Composes the transforms [index, index + L::width)
+        // The local matrix is Translation * Rotation * Scale where the rotation matrix is computed from the quaternion (x, y, z, w)
+        template<typename L>
+        void composeBlock(const TransformStreams& streams, size_t index){
+            const L one = L::splat(1.0f), two = L::splat(2.0f), zero = L::splat(0.0f);
+            L x = L::load(streams.rotationX + index), y = L::load(streams.rotationY + index);
+            L z = L::load(streams.rotationZ + index), w = L::load(streams.rotationW + index);
+            L sx = L::load(streams.scaleX + index), sy = L::load(streams.scaleY + index), sz = L::load(streams.scaleZ + index);
+
+            L xx = x * x, yy = y * y, zz = z * z;
+            L xy = x * y, xz = x * z, yz = y * z;
+            L wx = w * x, wy = w * y, wz = w * z;
+
+            L local[16];
+            local[0]  = sx * (one - two * (yy + zz));
+            local[1]  = sx * (two * (xy + wz));
+            local[2]  = sx * (two * (xz - wy));
+            local[3]  = zero;
+            local[4]  = sy * (two * (xy - wz));
+            local[5]  = sy * (one - two * (xx + zz));
+            local[6]  = sy * (two * (yz + wx));
+            local[7]  = zero;
+            local[8]  = sz * (two * (xz + wy));
+            local[9]  = sz * (two * (yz - wx));
+            local[10] = sz * (one - two * (xx + yy));
+            local[11] = zero;
+            local[12] = L::load(streams.positionX + index);
+            local[13] = L::load(streams.positionY + index);
+            local[14] = L::load(streams.positionZ + index);
+            local[15] = one;
+
+            scatterMatrices<L>(local, streams.locals + index);
+            if(streams.parents){
+                L parent[16], world[16];
+                gatherMatrices<L>(streams.parents + index, parent);
+                multiplyMatrices<L>(parent, local, world);
+                scatterMatrices<L>(world, streams.worlds + index);
+            } else {
+                scatterMatrices<L>(local, streams.worlds + index);
+            }
+        }
+
+        // Computes the draw matrices of the draws [index, index + L::width)
+        template<typename L>
+        void drawMatricesBlock(const L (&viewProjection)[16], const DrawMatrixStreams& streams, size_t index){
+            const float* sources[L::width];
+            float* clipTargets[L::width];
+            float* normalTargets[L::width];
+            for(size_t lane = 0; lane < L::width; ++lane){
+                size_t offset = (index + lane) * streams.stride;
+                sources[lane] = reinterpret_cast<const float*>(streams.localToWorld + offset);
+                clipTargets[lane] = reinterpret_cast<float*>(streams.localToClip + offset);
+                normalTargets[lane] = reinterpret_cast<float*>(streams.normalMatrix + offset);
+            }
+
+            L world[16], clip[16];
+            gatherMatrices<L>(sources, world);
+            multiplyMatrices<L>(viewProjection, world, clip);
+            scatterMatrices<L>(clip, clipTargets);
+
+            // If the columns of the upper 3x3 matrix are a, b & c, its inverse transpose has the columns
+            // (b x c, c x a, a x b) / det where det = a . (b x c)
+            const L ax = world[0], ay = world[1], az = world[2];
+            const L bx = world[4], by = world[5], bz = world[6];
+            const L cx = world[8], cy = world[9], cz = world[10];
+            L bcx = by * cz - bz * cy, bcy = bz * cx - bx * cz, bcz = bx * cy - by * cx;
+            L cax = cy * az - cz * ay, cay = cz * ax - cx * az, caz = cx * ay - cy * ax;
+            L abx = ay * bz - az * by, aby = az * bx - ax * bz, abz = ax * by - ay * bx;
+            L inverseDeterminant = L::splat(1.0f) / (ax * bcx + ay * bcy + az * bcz);
+
+            const L zero = L::splat(0.0f);
+            L normal[16] = {
+                bcx * inverseDeterminant, bcy * inverseDeterminant, bcz * inverseDeterminant, zero,
+                cax * inverseDeterminant, cay * inverseDeterminant, caz * inverseDeterminant, zero,
+                abx * inverseDeterminant, aby * inverseDeterminant, abz * inverseDeterminant, zero,
+                zero, zero, zero, L::splat(1.0f)
+            };
+            scatterMatrices<L>(normal, normalTargets);
+        }
+
+        // Computes the culling margins of the draws [index, index + L::width)
+        // The planes are given as 6 x (a, b, c, d) splatted lanes where (a, b, c) is the unit normal pointing inside the frustum
+        template<typename L>
+        void cullingMarginsBlock(const L (&planes)[6][4], const CullingStreams& streams, size_t index){
+            const float* sources[L::width];
+            alignas(32) float sphere[4][L::width];
+            alignas(32) float margins[L::width];
+            for(size_t lane = 0; lane < L::width; ++lane){
+                size_t offset = (index + lane) * streams.stride;
+                sources[lane] = reinterpret_cast<const float*>(streams.localToWorld + offset);
+                const float* localSphere = reinterpret_cast<const float*>(streams.boundingSphere + offset);
+                for(int element = 0; element < 4; ++element) sphere[element][lane] = localSphere[element];
+            }
+
+            L world[16];
+            gatherMatrices<L>(sources, world);
+            L x = L::load(sphere[0]), y = L::load(sphere[1]), z = L::load(sphere[2]), radius = L::load(sphere[3]);
+
+            // The center is moved to the world space and the radius is scaled by the longest axis of the matrix
+            L centerX = L::mulAdd(world[0], x, L::mulAdd(world[4], y, L::mulAdd(world[8], z, world[12])));
+            L centerY = L::mulAdd(world[1], x, L::mulAdd(world[5], y, L::mulAdd(world[9], z, world[13])));
+            L centerZ = L::mulAdd(world[2], x, L::mulAdd(world[6], y, L::mulAdd(world[10], z, world[14])));
+            L axisX = world[0] * world[0] + world[1] * world[1] + world[2] * world[2];
+            L axisY = world[4] * world[4] + world[5] * world[5] + world[6] * world[6];
+            L axisZ = world[8] * world[8] + world[9] * world[9] + world[10] * world[10];
+            L worldRadius = radius * L::sqrt(L::max(axisX, L::max(axisY, axisZ)));
+
+            // The margin is the distance from the center to the nearest plane (negative if the center is outside) plus the radius
+            L distance = L::mulAdd(planes[0][0], centerX, L::mulAdd(planes[0][1], centerY, L::mulAdd(planes[0][2], centerZ, planes[0][3])));
+            for(int plane = 1; plane < 6; ++plane){
+                L planeDistance = L::mulAdd(planes[plane][0], centerX,
+                                  L::mulAdd(planes[plane][1], centerY, L::mulAdd(planes[plane][2], centerZ, planes[plane][3])));
+                distance = L::min(distance, planeDistance);
+            }
+            (distance + worldRadius).store(margins);
+            for(size_t lane = 0; lane < L::width; ++lane)
+                *reinterpret_cast<float*>(streams.margin + (index + lane) * streams.stride) = margins[lane];
+        }
+
+        // Composes the transforms [begin, end) using full blocks of L, then the scalar code for the rest
+        template<typename L>
+        void composeRange(const TransformStreams& streams, size_t begin, size_t end){
+            size_t index = begin;
+            for(; index + L::width <= end; index += L::width) composeBlock<L>(streams, index);
+            for(; index < end; ++index) composeBlock<ScalarLanes>(streams, index);
+        }
+
+        // Computes the draw matrices of the draws [begin, end) using full blocks of L, then the scalar code for the rest
+        template<typename L>
+        void drawMatricesRange(const float* viewProjection, const DrawMatrixStreams& streams, size_t begin, size_t end){
+            L splatted[16];
+            ScalarLanes scalar[16];
+            for(int element = 0; element < 16; ++element){
+                splatted[element] = L::splat(viewProjection[element]);
+                scalar[element] = ScalarLanes::splat(viewProjection[element]);
+            }
+            size_t index = begin;
+            for(; index + L::width <= end; index += L::width) drawMatricesBlock<L>(splatted, streams, index);
+            for(; index < end; ++index) drawMatricesBlock<ScalarLanes>(scalar, streams, index);
+        }
+
+
+        // Computes the culling margins of the draws [begin, end) using full blocks of L, then the scalar code for the rest
+        template<typename L>
+        void cullingMarginsRange(const float* planes, const CullingStreams& streams, size_t begin, size_t end){
+            L splatted[6][4];
+            ScalarLanes scalar[6][4];
+            for(int plane = 0; plane < 6; ++plane){
+                for(int element = 0; element < 4; ++element){
+                    splatted[plane][element] = L::splat(planes[plane * 4 + element]);
+                    scalar[plane][element] = ScalarLanes::splat(planes[plane * 4 + element]);
+                }
+            }
+            size_t index = begin;
+            for(; index + L::width <= end; index += L::width) cullingMarginsBlock<L>(splatted, streams, index);
+            for(; index < end; ++index) cullingMarginsBlock<ScalarLanes>(scalar, streams, index);
+        }
+
+    }
+
+}
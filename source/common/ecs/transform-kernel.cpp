@@ -0,0 +1,157 @@
+#include "transform-kernel.hpp"
+#include "transform-kernel-lanes.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(OUR_TRANSFORM_KERNEL_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace our {
+
+    namespace {
+
+        const internal::TransformKernels scalarKernels = {
+            "Scalar",
+            internal::composeRange<internal::ScalarLanes>,
+            internal::drawMatricesRange<internal::ScalarLanes>,
+            internal::cullingMarginsRange<internal::ScalarLanes>
+        };
+
+#if defined(OUR_TRANSFORM_KERNEL_X86)
+        const internal::TransformKernels sseKernels = {
+            "SSE",
+            internal::composeRange<internal::SSELanes>,
+            internal::drawMatricesRange<internal::SSELanes>,
+            internal::cullingMarginsRange<internal::SSELanes>
+        };
+
+        // Returns true if both the CPU and the operating system support AVX2 & FMA
+        bool supportsAVX2(){
+#if defined(_MSC_VER)
+            int registers[4];
+            __cpuid(registers, 0);
+            if(registers[0] < 7) return false;
+            __cpuid(registers, 1);
+            bool fma = (registers[2] & (1 << 12)) != 0;
+            bool osxsave = (registers[2] & (1 << 27)) != 0;
+            bool avx = (registers[2] & (1 << 28)) != 0;
+            if(!(fma && osxsave && avx)) return false;
+            // The operating system must save the AVX registers on context switches
+            if((_xgetbv(0) & 0x6) != 0x6) return false;
+            __cpuidex(registers, 7, 0);
+            return (registers[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        }
+#endif
+
+        // Picks the fastest version of the kernel supported by this CPU (this is done once)
+        const internal::TransformKernels& getKernels(){
+            static const internal::TransformKernels* kernels = [](){
+#if defined(OUR_TRANSFORM_KERNEL_X86)
+                if(const internal::TransformKernels* avx2 = internal::getAVX2TransformKernels(); avx2 && supportsAVX2()) return avx2;
+                return &sseKernels;
+#else
+                return &scalarKernels;
+#endif
+            }();
+            return *kernels;
+        }
+
+        // Roots use this as their parent when they are in the same batch as entities that have a parent
+        const glm::mat4 identity = glm::mat4(1.0f);
+
+    }
+
+    void TransformBatch::add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+                             const glm::mat4* parent, glm::mat4* local, glm::mat4* world){
+        positionX.push_back(position.x); positionY.push_back(position.y); positionZ.push_back(position.z);
+        rotationX.push_back(rotation.x); rotationY.push_back(rotation.y); rotationZ.push_back(rotation.z); rotationW.push_back(rotation.w);
+        scaleX.push_back(scale.x); scaleY.push_back(scale.y); scaleZ.push_back(scale.z);
+        parents.push_back(glm::value_ptr(parent ? *parent : identity));
+        hasParents |= parent != nullptr;
+        locals.push_back(glm::value_ptr(*local));
+        worlds.push_back(glm::value_ptr(*world));
+    }
+
+    void TransformBatch::compose(){
+        if(locals.empty()) return;
+        internal::TransformStreams streams = {
+            positionX.data(), positionY.data(), positionZ.data(),
+            rotationX.data(), rotationY.data(), rotationZ.data(), rotationW.data(),
+            scaleX.data(), scaleY.data(), scaleZ.data(),
+            hasParents ? parents.data() : nullptr,
+            locals.data(), worlds.data()
+        };
+        getKernels().compose(streams, 0, locals.size());
+    }
+
+    void TransformBatch::clear(){
+        positionX.clear(); positionY.clear(); positionZ.clear();
+        rotationX.clear(); rotationY.clear(); rotationZ.clear(); rotationW.clear();
+        scaleX.clear(); scaleY.clear(); scaleZ.clear();
+        parents.clear(); locals.clear(); worlds.clear();
+        hasParents = false;
+    }
+
+    void composeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+                          const glm::mat4* parent, glm::mat4& local, glm::mat4& world){
+        const float* parentPointer = parent ? glm::value_ptr(*parent) : nullptr;
+        float* localPointer = glm::value_ptr(local);
+        float* worldPointer = glm::value_ptr(world);
+        internal::TransformStreams streams = {
+            &position.x, &position.y, &position.z,
+            &rotation.x, &rotation.y, &rotation.z, &rotation.w,
+            &scale.x, &scale.y, &scale.z,
+            parent ? &parentPointer : nullptr,
+            &localPointer, &worldPointer
+        };
+        scalarKernels.compose(streams, 0, 1);
+    }
+
+    void computeDrawMatrices(const glm::mat4& viewProjection, size_t count, size_t stride,
+                             const glm::mat4* localToWorld, glm::mat4* localToClip, glm::mat4* normalMatrix){
+        if(count == 0) return;
+        internal::DrawMatrixStreams streams = {
+            reinterpret_cast<const char*>(localToWorld),
+            reinterpret_cast<char*>(localToClip),
+            reinterpret_cast<char*>(normalMatrix),
+            stride
+        };
+        getKernels().computeDrawMatrices(glm::value_ptr(viewProjection), streams, 0, count);
+    }
+
+    void extractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 (&planes)[6]){
+        // A point p is inside the clip volume if -w <= x, y, z <= w where (x, y, z, w) = VP * p,
+        // so each plane is the sum or the difference of the last row of VP and one of the other rows
+        glm::mat4 rows = glm::transpose(viewProjection);
+        planes[0] = rows[3] + rows[0]; // Left
+        planes[1] = rows[3] - rows[0]; // Right
+        planes[2] = rows[3] + rows[1]; // Bottom
+        planes[3] = rows[3] - rows[1]; // Top
+        planes[4] = rows[3] + rows[2]; // Near
+        planes[5] = rows[3] - rows[2]; // Far
+        // The planes are normalized so that the plane equation gives the distance to the plane
+        for(auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+    }
+
+    void computeCullingMargins(const glm::vec4 (&planes)[6], size_t count, size_t stride,
+                               const glm::mat4* localToWorld, const glm::vec4* boundingSphere, float* margins){
+        if(count == 0) return;
+        internal::CullingStreams streams = {
+            reinterpret_cast<const char*>(localToWorld),
+            reinterpret_cast<const char*>(boundingSphere),
+            reinterpret_cast<char*>(margins),
+            stride
+        };
+        getKernels().computeCullingMargins(glm::value_ptr(planes[0]), streams, 0, count);
+    }
+
+    const char* getTransformKernelName(){
+        return getKernels().name;
+    }
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace our {
+
+    // The transform kernel composes many transforms at once.
+    // The inputs are stored as a structure of arrays (one array per component of the position, rotation & scale) so that
+    // the kernel can process 4 (SSE) or 8 (AVX2) transforms per instruction. The best version supported by the CPU is picked
+    // at runtime and a scalar version is used as a fallback (and for the transforms left over after the last full batch).
+    // The rotations are given as quaternions, so composing a transform needs no trigonometry.
+
+    // A batch of transforms to compose. Each transform produces a local matrix and a world matrix (parent * local).
+    class TransformBatch {
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+        std::vector<float> scaleX, scaleY, scaleZ;
+        std::vector<const float*> parents; // The parent world matrix of each transform (an identity matrix for roots)
+        std::vector<float*> locals, worlds; // Where the results of each transform are written
+        bool hasParents = false; // If no transform in the batch has a parent, the world matrices are copies of the local matrices
+    public:
+        // Adds a transform to the batch. The results will be written to "local" and "world" when "compose" is called.
+        // If "parent" is not null, it must still be valid (and up to date) when "compose" is called.
+        void add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+                 const glm::mat4* parent, glm::mat4* local, glm::mat4* world);
+        // Composes all the transforms in the batch
+        void compose();
+        // Removes all the transforms from the batch (the memory is kept to be reused by the next batch)
+        void clear();
+
+        size_t size() const { return locals.size(); }
+        bool empty() const { return locals.empty(); }
+    };
+
+    // Composes a single transform (using the scalar version of the same code as the batches)
+    void composeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+                          const glm::mat4* parent, glm::mat4& local, glm::mat4& world);
+
+    // For each of the "count" draws, computes localToClip = viewProjection * localToWorld and the normal matrix
+    // (the inverse transpose of the upper 3x3 part of localToWorld, stored in a mat4 whose last row & column are (0,0,0,1)).
+    // The matrices of consecutive draws are "stride" bytes apart, so they can be members of an array of structs (e.g. render commands).
+    void computeDrawMatrices(const glm::mat4& viewProjection, size_t count, size_t stride,
+                             const glm::mat4* localToWorld, glm::mat4* localToClip, glm::mat4* normalMatrix);
+
+    // Extracts the 6 planes of the view frustum (left, right, bottom, top, near & far) from a view projection matrix.
+    // Each plane is stored as (a, b, c, d) where (a, b, c) is the unit normal pointing inside the frustum,
+    // so "dot(plane, vec4(p, 1))" is the signed distance of the point p to the plane.
+    void extractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 (&planes)[6]);
+
+    // For each of the "count" draws, transforms its local bounding sphere (center in xyz, radius in w) by localToWorld
+    // and writes how deep the sphere is inside the frustum: the signed distance from its center to the nearest plane plus its radius.
+    // A negative margin means that the sphere is completely outside the frustum (so the draw can be culled).
+    // Like "computeDrawMatrices", the inputs & outputs of consecutive draws are "stride" bytes apart.
+    void computeCullingMargins(const glm::vec4 (&planes)[6], size_t count, size_t stride,
+                               const glm::mat4* localToWorld, const glm::vec4* boundingSphere, float* margins);
+
+    // Returns the name of the instruction set used by the kernel on this CPU ("AVX2", "SSE" or "Scalar")
+    const char* getTransformKernelName();
+
+}
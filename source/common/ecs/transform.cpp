@@ -12,16 +12,31 @@ namespace our {
         //TODO: (Req 3) Write this function
         glm::mat4 scalingMatrix=glm::scale(glm::mat4(1.0f),scale);
         glm::mat4 translationMatrix=glm::translate(glm::mat4(1.0f),position);
-        glm::mat4 rotationMatrix=glm::yawPitchRoll(rotation.y,rotation.x,rotation.z);
+        glm::mat4 rotationMatrix=useQuaternion ? glm::mat4_cast(orientation) : glm::yawPitchRoll(rotation.y,rotation.x,rotation.z);
 
         return translationMatrix*rotationMatrix*scalingMatrix; 
     }
 
+    // Returns the rotation as a quaternion
+    // The euler angles are applied in the same order as glm::yawPitchRoll: yaw (around y), then pitch (around x), then roll (around z)
+    glm::quat Transform::getOrientation() const {
+        if(useQuaternion) return orientation;
+        return glm::angleAxis(rotation.y, glm::vec3(0, 1, 0))
+             * glm::angleAxis(rotation.x, glm::vec3(1, 0, 0))
+             * glm::angleAxis(rotation.z, glm::vec3(0, 0, 1));
+    }
+
      // Deserializes the entity data and components from a json object
     void Transform::deserialize(const nlohmann::json& data){
         position = data.value("position", position);
         rotation = glm::radians(data.value("rotation", glm::degrees(rotation)));
         scale    = data.value("scale", scale);
+        // If an orientation is given (as a quaternion [x, y, z, w]), it is used instead of the euler angles
+        if(data.contains("orientation")){
+            glm::vec4 quaternion = data["orientation"].get<glm::vec4>();
+            orientation = glm::normalize(glm::quat(quaternion.w, quaternion.x, quaternion.y, quaternion.z));
+            useQuaternion = true;
+        }
     }
 
 }
\ No newline at end of file
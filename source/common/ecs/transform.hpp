@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <json/json.hpp>
 
 namespace our {
@@ -11,9 +12,27 @@ namespace our {
         glm::vec3 position = glm::vec3(0, 0, 0); // The position is defined as a vec3. (0,0,0) means no translation
         glm::vec3 rotation = glm::vec3(0, 0, 0); // The rotation is defined using euler angles (y: yaw, x: pitch, z: roll). (0,0,0) means no rotation
         glm::vec3 scale = glm::vec3(1, 1, 1); // The scale is defined as a vec3. (1,1,1) means no scaling.
+        // Optionally, the rotation can be stored as a quaternion. If "useQuaternion" is true, "orientation" is used and "rotation" is ignored.
+        // Composing a quaternion rotation needs no trigonometry, while the euler angles need 3 sin/cos pairs whenever they change.
+        bool useQuaternion = false;
+        glm::quat orientation = glm::quat(1, 0, 0, 0);
+
+        // Returns the rotation as a quaternion (the euler angles are converted if the rotation is not stored as a quaternion)
+        glm::quat getOrientation() const;
 
         // This function computes and returns a matrix that represents this transform
         glm::mat4 toMat4() const;
+        // Two transforms are equal if they have the same position, rotation & scale
+        // (the entities use it to detect that their local transform was modified since their matrices were cached)
+        bool operator==(const Transform& other) const {
+            return position == other.position && scale == other.scale && hasSameRotation(other);
+        }
+        bool operator!=(const Transform& other) const { return !(*this == other); }
+        // Returns true if both transforms store the same rotation (in the same form)
+        bool hasSameRotation(const Transform& other) const {
+            if(useQuaternion != other.useQuaternion) return false;
+            return useQuaternion ? orientation == other.orientation : rotation == other.rotation;
+        }
          // Deserializes the entity data and components from a json object
         void deserialize(const nlohmann::json&);
     };
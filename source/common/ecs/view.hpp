@@ -0,0 +1,71 @@
+#pragma once
+
+#include "entity.hpp"
+#include <vector>
+#include <iterator>
+
+namespace our {
+
+    // A view is the list of entities that hold all the component types T... (a query result).
+    // The list is owned and kept up to date by the world (see "World::view"), so creating a view is cheap and
+    // iterating over it only touches the matching entities.
+    // WARNING: Adding or removing components of the viewed types while iterating over a view changes the list being iterated.
+    template<typename... T>
+    class View {
+        const std::vector<Entity*>* entities;
+    public:
+        explicit View(const std::vector<Entity*>& entities) : entities(&entities) {}
+
+        auto begin() const { return entities->begin(); }
+        auto end() const { return entities->end(); }
+        size_t size() const { return entities->size(); }
+        bool empty() const { return entities->empty(); }
+        // Returns the first matching entity or nullptr if there is none
+        Entity* front() const { return entities->empty() ? nullptr : entities->front(); }
+
+        // Calls "function(entity, components...)" for each matching entity where "components" are references to its T... components
+        template<typename Function>
+        void each(Function&& function) const {
+            for(Entity* entity : *entities)
+                function(entity, *entity->getComponent<T>()...);
+        }
+
+        // The entities of a view in which at least one of the T... components changed after a certain change version.
+        // The unchanged entities are skipped while iterating (see "View::changedSince").
+        class Changed {
+            const std::vector<Entity*>* entities;
+            uint32_t version;
+        public:
+            class iterator {
+                std::vector<Entity*>::const_iterator current, last;
+                uint32_t version;
+                void skipUnchanged() {
+                    while(current != last && !(... || (*current)->template getComponent<T>()->changedSince(version))) ++current;
+                }
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = Entity*;
+                using difference_type = std::ptrdiff_t;
+                using pointer = Entity* const*;
+                using reference = Entity* const&;
+
+                iterator(std::vector<Entity*>::const_iterator current, std::vector<Entity*>::const_iterator last, uint32_t version)
+                    : current(current), last(last), version(version) { skipUnchanged(); }
+                Entity* operator*() const { return *current; }
+                iterator& operator++() { ++current; skipUnchanged(); return *this; }
+                iterator operator++(int) { iterator old = *this; ++*this; return old; }
+                bool operator==(const iterator& other) const { return current == other.current; }
+                bool operator!=(const iterator& other) const { return current != other.current; }
+            };
+
+            Changed(const std::vector<Entity*>& entities, uint32_t version) : entities(&entities), version(version) {}
+            iterator begin() const { return iterator(entities->begin(), entities->end(), version); }
+            iterator end() const { return iterator(entities->end(), entities->end(), version); }
+        };
+
+        // Returns the entities of this view in which at least one of the T... components was added or changed after "version"
+        // Example: for(auto entity : world->view<LightComponent>().changedSince(lastVersion)) {...}
+        Changed changedSince(uint32_t version) const { return Changed(*entities, version); }
+    };
+
+}
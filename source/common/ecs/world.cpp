@@ -1,4 +1,7 @@
 #include "world.hpp"
+#include "../components/component-deserializer.hpp"
+#include "../components/mesh-renderer.hpp"
+#include "../asset-loader.hpp"
 #include <iostream>
 namespace our {
 
@@ -8,10 +11,14 @@ namespace our {
     void World::deserialize(const nlohmann::json& data, Entity* parent){
         if(!data.is_array()) return;
         for(const auto& entityData : data){
+            if(entityData.contains("prefab")){
+                deserializePrefabInstances(entityData, parent);
+                continue;
+            }
             //TODO: (Req 8) Create an entity, make its parent "parent" and call its deserialize with "entityData".
             Entity* newEntity= add();
             newEntity->deserialize(entityData);
-            newEntity->parent=parent;
+            newEntity->setParent(parent);
 
             if(entityData.contains("children")){
                 //TODO: (Req 8) Recursively call this world's "deserialize" using the children data
@@ -21,4 +28,133 @@ namespace our {
         }
     }
 
-}
\ No newline at end of file
+    // Creates the instances of the prefab named in the entity data then applies the rest of the data to each of them
+    void World::deserializePrefabInstances(const nlohmann::json& entityData, Entity* parent){
+        Prefab* prefab = AssetLoader<Prefab>::get(entityData["prefab"].get<std::string>());
+        if(!prefab || prefab->empty()) return;
+        const nlohmann::json* instancesData = nullptr;
+        if(entityData.contains("instances") && entityData["instances"].is_array()) instancesData = &entityData["instances"];
+        // Each instance starts from the prefab's root transform and overrides the parts it specifies
+        std::vector<Transform> transforms(instancesData ? instancesData->size() : 1, prefab->getRoot().transform);
+        if(instancesData)
+            for(size_t index = 0; index < transforms.size(); ++index) transforms[index].deserialize((*instancesData)[index]);
+
+        std::vector<Entity*> roots;
+        roots.reserve(transforms.size());
+        instantiate(*prefab, transforms, parent, &roots);
+        for(size_t index = 0; index < roots.size(); ++index){
+            Entity* root = roots[index];
+            root->deserialize(entityData);
+            // The transform of the instance has the last word
+            if(instancesData) root->localTransform.deserialize((*instancesData)[index]);
+            if(entityData.contains("children")) this->deserialize(entityData["children"], root);
+        }
+    }
+
+    void World::instantiate(const Prefab& prefab, const std::vector<Transform>& rootTransforms, Entity* parent, std::vector<Entity*>* roots){
+        if(prefab.empty() || rootTransforms.empty()) return;
+        const std::vector<Prefab::Node>& nodes = prefab.getNodes();
+        const ComponentRegistry& registry = getComponentRegistry();
+        const size_t count = rootTransforms.size();
+        // The entity & component pools are grown once for all the copies
+        entities.reserve(count * nodes.size());
+        for(auto& node : nodes)
+            for(auto& prototype : node.components) registry.reserve(prototype.type, components, count);
+
+        std::vector<Entity*> created(nodes.size()); // The entities of the current copy (indexed like the nodes)
+        for(size_t instance = 0; instance < count; ++instance){
+            for(size_t index = 0; index < nodes.size(); ++index){
+                const Prefab::Node& node = nodes[index];
+                Entity* entity = add();
+                entity->localTransform = index == 0 ? rootTransforms[instance] : node.transform;
+                for(auto& prototype : node.components) registry.copyComponent(prototype.type, entity, *prototype.component);
+                // The views are updated once per entity instead of once per component
+                entity->onComponentMaskChanged(0);
+                if(node.name != Symbol()) entity->setName(node.name);
+                for(auto tag : node.tags) entity->addTag(tag);
+                entity->setParent(index == 0 ? parent : created[node.parent]);
+                created[index] = entity;
+            }
+            if(roots) roots->push_back(created[0]);
+        }
+    }
+
+    Entity* World::instantiate(const Prefab& prefab, Entity* parent){
+        if(prefab.empty()) return nullptr;
+        std::vector<Entity*> roots;
+        instantiate(prefab, {prefab.getRoot().transform}, parent, &roots);
+        return roots.front();
+    }
+
+    // Adds the entity (and its subtree) to "staleTransforms" if its matrices must be recomputed
+    void World::collectStaleTransforms(Entity* entity, size_t depth, bool parentStale){
+        bool stale = entity->isWorldMatrixStale(entity->refreshComposedTransform()) || parentStale;
+        if(stale){
+            if(staleTransforms.size() <= depth) staleTransforms.resize(depth + 1);
+            staleTransforms[depth].push_back(entity);
+        }
+        // The matrices may also have been recomputed by "getLocalToWorldMatrix" since the entity was indexed
+        if(stale || entity->indexedVersion != entity->worldVersion || entity->boundsStale) movedEntities.push_back(entity);
+        for(auto child : entity->children) collectStaleTransforms(child, depth + 1, stale);
+    }
+
+    // Recomputes the stale matrices depth by depth, so the parents of each batch are already up to date
+    void World::updateTransforms(){
+        for(auto& level : staleTransforms) level.clear();
+        movedEntities.clear();
+        for(auto entity : entities.getEntities())
+            if(entity->parent == nullptr) collectStaleTransforms(entity, 0, false);
+
+        for(auto& level : staleTransforms){
+            if(level.empty()) continue;
+            transformBatch.clear();
+            for(auto entity : level){
+                transformBatch.add(entity->composedTransform.position, entity->composedOrientation, entity->composedTransform.scale,
+                                   entity->parent ? &entity->parent->worldMatrix : nullptr, &entity->localMatrix, &entity->worldMatrix);
+            }
+            transformBatch.compose();
+            for(auto entity : level) entity->onWorldMatrixComposed();
+        }
+
+        for(auto entity : movedEntities){
+            const glm::mat4& worldMatrix = entity->worldMatrix;
+            spatialGrid.update(entity, glm::vec2(worldMatrix[3].x, worldMatrix[3].z));
+            entity->indexedVersion = entity->worldVersion;
+            updateBounds(entity);
+        }
+        // The moved leaves were only refitted, so the hierarchy is rebuilt once enough of them changed
+        boundsHierarchy.commit();
+    }
+
+    // Only the entities with a mesh renderer have bounds, so they join (or leave) the hierarchy when they gain (or lose) one.
+    // The mesh is usually set after the component is added (e.g. by its deserialize), so the leaf is created by the next update.
+    void World::onBoundsSourceChanged(Entity* entity, ComponentMask oldMask, ComponentMask newMask){
+        const ComponentMask meshRendererBit = ComponentMask(1) << componentTypeId<MeshRendererComponent>;
+        if(((oldMask ^ newMask) & meshRendererBit) == 0) return;
+        if(newMask & meshRendererBit){
+            entity->boundsStale = true;
+        } else if(entity->boundsLeaf >= 0){
+            boundsHierarchy.remove(entity->boundsLeaf);
+            entity->boundsLeaf = BoundingVolumeHierarchy::NULL_NODE;
+        }
+    }
+
+    void World::markBoundsChanged(Entity* entity){
+        entity->boundsStale = true;
+    }
+
+    void World::updateBounds(Entity* entity){
+        entity->boundsStale = false;
+        MeshRendererComponent* meshRenderer = entity->getComponent<MeshRendererComponent>();
+        if(!meshRenderer || !meshRenderer->mesh){
+            if(entity->boundsLeaf >= 0) boundsHierarchy.remove(entity->boundsLeaf);
+            entity->boundsLeaf = BoundingVolumeHierarchy::NULL_NODE;
+            return;
+        }
+        const Mesh* mesh = meshRenderer->mesh;
+        AABB bounds = AABB(mesh->getBoundsMin(), mesh->getBoundsMax()).transformed(entity->worldMatrix);
+        if(entity->boundsLeaf >= 0) boundsHierarchy.update(entity->boundsLeaf, bounds);
+        else entity->boundsLeaf = boundsHierarchy.insert(entity, bounds);
+    }
+
+}
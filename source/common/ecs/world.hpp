@@ -1,15 +1,112 @@
 #pragma once
 
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <string_view>
+#include <algorithm>
 #include "entity.hpp"
+#include "entity-pool.hpp"
+#include "view.hpp"
+#include "transform-kernel.hpp"
+#include "command-buffer.hpp"
+#include "spatial-grid.hpp"
+#include "bounding-volume-hierarchy.hpp"
+#include "prefab.hpp"
 #include <iostream>
 namespace our {
 
     // This class holds a set of entities
     class World {
-        std::unordered_set<Entity*> entities; // These are the entities held by this world
+        EntityPool entities; // These are the entities held by this world (allocated in the pages of the pool)
         std::unordered_set<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
                                                       // when deleteMarkedEntities is called
+        ComponentStorage components; // The pools in which the components of all the entities are packed by type
+
+        // A cached query result: the list of entities holding all the component types in "required"
+        struct ViewCache {
+            ComponentMask required;
+            std::vector<Entity*> entities; // The matching entities
+            std::unordered_map<Entity*, size_t> positions; // The index of each matching entity in "entities"
+        };
+        // The views requested so far (indexed by their component mask). They are updated whenever an entity gains or loses a component.
+        std::unordered_map<ComponentMask, ViewCache> views;
+
+        // Called by the entities when the component types they hold change.
+        // Every cached view that the entity joined or left is updated in O(1).
+        void updateViews(Entity* entity, ComponentMask oldMask, ComponentMask newMask){
+            for(auto& [required, view] : views){
+                bool wasMatching = (oldMask & required) == required;
+                bool isMatching = (newMask & required) == required;
+                if(wasMatching == isMatching) continue;
+                if(isMatching){
+                    view.positions[entity] = view.entities.size();
+                    view.entities.push_back(entity);
+                } else {
+                    // The last entity takes the place of the removed one
+                    auto it = view.positions.find(entity);
+                    size_t index = it->second;
+                    view.entities[index] = view.entities.back();
+                    view.positions[view.entities[index]] = index;
+                    view.entities.pop_back();
+                    view.positions.erase(entity);
+                }
+            }
+        }
+        friend Entity; // The entities notify the world through "updateViews" and the index callbacks below
+
+        // The entities indexed by name and by tag. Each list holds the entities (in no particular order) which have this name or tag.
+        // The entities without a name are not indexed by name.
+        std::unordered_map<Symbol, std::vector<Entity*>> namesIndex;
+        std::unordered_map<Symbol, std::vector<Entity*>> tagsIndex;
+
+        static void addToIndex(std::unordered_map<Symbol, std::vector<Entity*>>& index, Symbol key, Entity* entity){
+            index[key].push_back(entity);
+        }
+        static void removeFromIndex(std::unordered_map<Symbol, std::vector<Entity*>>& index, Symbol key, Entity* entity){
+            auto it = index.find(key);
+            if(it == index.end()) return;
+            std::vector<Entity*>& list = it->second;
+            auto position = std::find(list.begin(), list.end(), entity);
+            if(position == list.end()) return;
+            *position = list.back();
+            list.pop_back();
+        }
+
+        // Called by the entities when their name or tags change
+        void onNameChanged(Entity* entity, Symbol oldName, Symbol newName){
+            if(oldName != Symbol()) removeFromIndex(namesIndex, oldName, entity);
+            if(newName != Symbol()) addToIndex(namesIndex, newName, entity);
+        }
+        void onTagAdded(Entity* entity, Symbol tag){ addToIndex(tagsIndex, tag, entity); }
+        void onTagRemoved(Entity* entity, Symbol tag){ removeFromIndex(tagsIndex, tag, entity); }
+
+        // Returns the list of the given key in the index (or an empty list)
+        static const std::vector<Entity*>& findInIndex(const std::unordered_map<Symbol, std::vector<Entity*>>& index, Symbol key){
+            static const std::vector<Entity*> empty;
+            auto it = index.find(key);
+            return it == index.end() ? empty : it->second;
+        }
+
+        // The entities whose cached matrices must be recomputed, grouped by their depth in the hierarchy
+        std::vector<std::vector<Entity*>> staleTransforms;
+        TransformBatch transformBatch; // The batch in which the transforms of one depth are composed together
+        // The entities whose position in the spatial grid is out of date (their world matrix changed since they were indexed)
+        std::vector<Entity*> movedEntities;
+        SpatialGrid spatialGrid; // The entities partitioned by their world position on the XZ plane
+        BoundingVolumeHierarchy boundsHierarchy; // The world bounds of the entities that have a mesh renderer
+        // Called by the entities when their component types change (to add or remove them from the bounds hierarchy)
+        void onBoundsSourceChanged(Entity* entity, ComponentMask oldMask, ComponentMask newMask);
+        // Moves the entity's leaf in the bounds hierarchy to the current world bounds of its mesh (or adds or removes the leaf)
+        void updateBounds(Entity* entity);
+        // Creates the instances of a prefab described in the json of an entity (see "deserialize")
+        void deserializePrefabInstances(const nlohmann::json& entityData, Entity* parent);
+
+        // Adds the entity (and its subtree) to "staleTransforms" if its matrices must be recomputed
+        // and to "movedEntities" if its position in the spatial grid (or its bounds) must be updated
+        void collectStaleTransforms(Entity* entity, size_t depth, bool parentStale);
+
+        CommandBuffer commands{this}; // The structural changes recorded by the systems (applied by "flushCommands")
     public:
 
         World() = default;
@@ -17,45 +114,162 @@ namespace our {
         // This will deserialize a json array of entities and add the new entities to the current world
         // If parent pointer is not null, the new entities will be have their parent set to that given pointer
         // If any of the entities has children, this function will be called recursively for these children
+        // An entity can also be created from a prefab (see "AssetLoader<Prefab>") by giving its name in "prefab".
+        // The rest of the entity's data is then applied on top of the prefab (e.g. its position, more components or children).
+        // To create many copies of a prefab, an array of transforms can be given in "instances", e.g.
+        //     { "prefab": "block", "instances": [ { "position": [1, 0, 2] }, { "position": [3, 0, 2], "rotation": [0, 90, 0] } ] }
         void deserialize(const nlohmann::json& data, Entity* parent = nullptr);
 
-        // This adds an entity to the entities set and returns a pointer to that entity
+        // This creates a copy of the prefab for each of the given root transforms (the transforms replace the prefab's root transform)
+        // and appends the root of each copy to "roots" (if given). The roots are parented to "parent".
+        // The components are copied from the prefab's prototypes and the pools are grown once for all the copies,
+        // so it is much faster than deserializing the entities one by one.
+        void instantiate(const Prefab& prefab, const std::vector<Transform>& rootTransforms, Entity* parent = nullptr,
+                         std::vector<Entity*>* roots = nullptr);
+        // This creates a single copy of the prefab and returns its root
+        Entity* instantiate(const Prefab& prefab, Entity* parent = nullptr);
+
+        // This adds an entity to the entity pool and returns a pointer to that entity
         // WARNING The entity is owned by this world so don't use "delete" to delete it, instead, call "markForRemoval"
         // to put it in the "markedForRemoval" set. The elements in the "markedForRemoval" set will be removed and
         // deleted when "deleteMarkedEntities" is called.
         Entity* add() {
             //TODO: (Req 8) Create a new entity, set its world member variable to this,
             // and don't forget to insert it in the suitable container.
-            Entity* newEntity=new Entity();
+            Entity* newEntity=entities.create();
             newEntity->world=this;
-            entities.insert(newEntity);
+            newEntity->storage=&components;
             return newEntity;
         }
 
-        // This returns and immutable reference to the set of all entites in the world.
-        const std::unordered_set<Entity*>& getEntities() {
-            return entities;
+        // This returns and immutable reference to the list of all entites in the world.
+        const std::vector<Entity*>& getEntities() {
+            return entities.getEntities();
+        }
+
+        // This returns the entity referred to by the given handle.
+        // If the entity was deleted since the handle was made (or the handle is null), nullptr is returned.
+        Entity* getEntity(EntityHandle handle) {
+            return entities.get(handle);
+        }
+
+        // These return the entities with the given name or tag (in no particular order).
+        // The world keeps an index of the names & tags, so a lookup only costs as much as the number of matches.
+        // The symbol versions should be preferred in code that runs every frame since they skip looking up the string.
+        // Example: for(auto block : world->findByTag("block")) {...}
+        const std::vector<Entity*>& findByName(Symbol name) const { return findInIndex(namesIndex, name); }
+        const std::vector<Entity*>& findByName(std::string_view name) const { return findByName(Symbol::find(name)); }
+        const std::vector<Entity*>& findByTag(Symbol tag) const { return findInIndex(tagsIndex, tag); }
+        const std::vector<Entity*>& findByTag(std::string_view tag) const { return findByTag(Symbol::find(tag)); }
+        // Returns one of the entities with the given name, or nullptr if there is none
+        Entity* findFirstByName(std::string_view name) const {
+            const std::vector<Entity*>& matches = findByName(name);
+            return matches.empty() ? nullptr : matches.front();
+        }
+
+        // This returns the pool holding all the components of type T in this world.
+        // Iterating over the pool walks linearly over the packed components, so systems that only care
+        // about a single component type should prefer it over looping on all the entities.
+        template<typename T>
+        ComponentPool<T>& getComponents() {
+            return components.getPool<T>();
+        }
+
+        // This returns a view over all the entities that hold every one of the component types T...
+        // The first call for a certain set of types scans the entities once, then the world keeps the result up to date
+        // as components are added or removed, so the systems only pay for the entities that match.
+        // Example: for(auto entity : world->view<CameraComponent, FreeCameraControllerComponent>()) {...}
+        template<typename... T>
+        View<T...> view() {
+            const ComponentMask required = componentMask<T...>();
+            auto [it, created] = views.try_emplace(required);
+            ViewCache& cache = it->second;
+            if(created){
+                cache.required = required;
+                for(auto entity : entities.getEntities()){
+                    if((entity->mask & required) == required){
+                        cache.positions[entity] = cache.entities.size();
+                        cache.entities.push_back(entity);
+                    }
+                }
+            }
+            return View<T...>(cache.entities);
+        }
+
+        // This brings the cached local to world matrices of all the entities up to date in one pass.
+        // The hierarchy is walked root first to find the entities whose transform (or one of their ancestors' transform) changed,
+        // then they are composed depth by depth using the batch transform kernel (so a parent is always composed before its children).
+        // It should be called once per frame after the systems moved the entities and before the matrices are read (e.g. before rendering).
+        // It also moves the entities whose world position changed to their new place in the spatial grid
+        // and refits their bounds in the bounds hierarchy.
+        void updateTransforms();
+
+        // This returns the command buffer of this world. The systems should record their structural changes into it
+        // (creating & deleting entities, adding & removing components) instead of applying them while other systems are running.
+        // Example: world->getCommands().destroy(entity);
+        CommandBuffer& getCommands() {
+            return commands;
+        }
+
+        // These return and advance the change version of this world.
+        // The components are stamped with the current version when they are added or changed, so a system can process only what changed
+        // since its last run by remembering the version at which it ran. The version must be advanced between the runs
+        // (the scheduler advances it before each stage), so the changes made after a run get a greater version.
+        // Example:
+        //     uint32_t since = lastVersion; lastVersion = world->getChangeVersion();
+        //     for(auto entity : world->view<LightComponent>().changedSince(since)) {...}
+        uint32_t getChangeVersion() const {
+            return components.getChangeVersion();
+        }
+        uint32_t advanceChangeVersion() {
+            return components.advanceChangeVersion();
+        }
+
+        // This returns the spatial grid which partitions the entities by their world position on the XZ plane.
+        // The grid is brought up to date by "updateTransforms", so the queries see the positions of the last update.
+        // Example: world->getSpatialGrid().queryRadius({x, z}, 2.0f, results, Symbol("block"));
+        const SpatialGrid& getSpatialGrid() const {
+            return spatialGrid;
+        }
+
+        // This returns the bounding volume hierarchy of the world bounds of the entities that have a mesh renderer
+        // (the box of the mesh transformed by the entity's local to world matrix). It is used for frustum culling,
+        // ray casts and overlap queries. Like the spatial grid, it is brought up to date by "updateTransforms".
+        // The bounds follow the entity's matrix and mesh renderer, so changing the mesh of an existing mesh renderer should
+        // be followed by "markBoundsChanged".
+        // Example: auto hit = world->getBoundsHierarchy().raycast(origin, forward, 10.0f, Symbol("block"));
+        const BoundingVolumeHierarchy& getBoundsHierarchy() const {
+            return boundsHierarchy;
+        }
+        // Tells the world to recompute the bounds of the entity in the next "updateTransforms"
+        void markBoundsChanged(Entity* entity);
+        // Rebuilds the bounds hierarchy from scratch (it is also rebuilt automatically once enough bounds changed)
+        void rebuildBoundsHierarchy() {
+            boundsHierarchy.rebuild();
+        }
+
+        // This applies the commands recorded in the command buffer (see "CommandBuffer::flush").
+        // It must be called from the main thread while no system is running (the scheduler calls it after each stage).
+        void flushCommands() {
+            commands.flush();
         }
 
         // This marks an entity for removal by adding it to the "markedForRemoval" set.
         // The elements in the "markedForRemoval" set will be removed and deleted when "deleteMarkedEntities" is called.
         void markForRemoval(Entity* entity){
             //TODO: (Req 8) If the entity is in this world, add it to the "markedForRemoval" set.
-            auto it=entities.find(entity);
-            if(it!= entities.end()){
+            if(entities.contains(entity)){
                 markedForRemoval.insert(entity);
             }
         }
 
-        // This removes the elements in "markedForRemoval" from the "entities" set.
-        // Then each of these elements are deleted.
+        // This removes the elements in "markedForRemoval" from the entity pool.
+        // Then each of these elements are deleted (their slots are reused by the next entities).
         void deleteMarkedEntities(){
             //TODO: (Req 8) Remove and delete all the entities that have been marked for removal
             for(auto markedEntity=markedForRemoval.begin();markedEntity!=markedForRemoval.end();std::advance(markedEntity,1)){
-                auto iter=entities.find(*markedEntity);
-                if(iter!=entities.end()){
-                    delete *iter;
-                    entities.erase(iter);
+                if(entities.contains(*markedEntity)){
+                    entities.destroy(*markedEntity);
                 }
             }
             markedForRemoval.clear();
@@ -64,11 +278,32 @@ namespace our {
         //This deletes all entities in the world
         void clear(){
             //TODO: (Req 8) Delete all the entites and make sure that the containers are empty
-            for(auto iter=entities.begin();iter!=entities.end();std::advance(iter,1)){
-                delete *iter;
+            // The pools are cleared first so all the components are released page by page,
+            // then the entities are told that they no longer own any component before they are deleted
+            // The hierarchy is also unlinked first so that no entity touches an already deleted parent or child
+            // Finally, the entity pool destroys the entities and releases its pages (instead of deleting the entities one by one)
+            components.clear();
+            spatialGrid.clear();
+            boundsHierarchy.clear();
+            for(auto entity : entities.getEntities()){
+                entity->boundsLeaf = BoundingVolumeHierarchy::NULL_NODE;
+                entity->components.clear();
+                entity->mask = 0;
+                entity->parent = nullptr;
+                entity->children.clear();
+                entity->name = Symbol();
+                entity->tags.clear();
             }
             entities.clear();
+            namesIndex.clear();
+            tagsIndex.clear();
             markedForRemoval.clear();
+            commands.discard();
+            movedEntities.clear();
+            for(auto& [required, view] : views){
+                view.entities.clear();
+                view.positions.clear();
+            }
         }
 
         //Since the world owns all of its entities, they should be deleted alongside it.
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstring>
+
+namespace our {
+
+    // The engine targets OpenGL 3.3, but some optimizations use the features of later versions when the driver has them.
+    // These functions check for them at runtime (the functions of these features are then loaded with glfwGetProcAddress).
+
+    // Returns true if the current context has at least the given OpenGL version
+    inline bool hasGLVersion(GLint major, GLint minor){
+        GLint contextMajor = 0, contextMinor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+        return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+    }
+
+    // Returns true if the current context has the extension (e.g. "GL_ARB_buffer_storage")
+    inline bool hasGLExtension(const char* name){
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for(GLint index = 0; index < extensionCount; ++index){
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, index));
+            if(extension && std::strcmp(extension, name) == 0) return true;
+        }
+        return false;
+    }
+
+}
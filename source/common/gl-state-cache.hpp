@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstddef>
+
+namespace our {
+
+    // The number of calls that went through the state cache since its counters were last reset
+    struct GLStateStats {
+        size_t issued = 0;  // The calls that changed the state so they were sent to OpenGL
+        size_t skipped = 0; // The calls that were dropped since the state already had the requested value
+    };
+
+    // This static class shadows the part of the OpenGL state that changes between draws (the pipeline options, the program,
+    // the vertex array, the textures & samplers and the draw framebuffer) and only calls OpenGL when a value actually changes.
+    // Every part of the engine that changes this state should go through it, otherwise the shadow values would not match
+    // the real state. Code that changes the state behind its back (e.g. ImGui) should be followed by a call to "invalidate".
+    class GLStateCache {
+        // A shadowed value. It is unknown until it is set for the first time (or after "invalidate"), so the first call is always issued.
+        // The shadows are only used as static members which start zeroed (so they start unknown).
+        template<typename T>
+        struct Shadow {
+            T value;
+            bool known;
+            // Returns true if the call has to be issued (and records the new value)
+            bool change(const T& newValue){
+                if(known && value == newValue){
+                    ++stats.skipped;
+                    return false;
+                }
+                value = newValue;
+                known = true;
+                ++stats.issued;
+                return true;
+            }
+        };
+        struct BlendFunction { GLenum source, destination; bool operator==(const BlendFunction& other) const { return source == other.source && destination == other.destination; } };
+        struct Color { GLfloat r, g, b, a; bool operator==(const Color& other) const { return r == other.r && g == other.g && b == other.b && a == other.a; } };
+        struct ColorMask { bool r, g, b, a; bool operator==(const ColorMask& other) const { return r == other.r && g == other.g && b == other.b && a == other.a; } };
+
+        // The texture units above this count are not shadowed (their calls are always issued)
+        static constexpr GLuint TEXTURE_UNITS = 16;
+
+        static inline Shadow<bool> cullFaceEnabled, depthTestEnabled, blendEnabled, depthMaskValue;
+        static inline Shadow<GLenum> culledFace, frontFaceValue, depthFunction, blendEquationValue;
+        static inline Shadow<BlendFunction> blendFunction;
+        static inline Shadow<Color> blendColorValue;
+        static inline Shadow<ColorMask> colorMaskValue;
+        static inline Shadow<GLuint> program, vertexArray, drawFramebuffer, activeTextureUnit;
+        static inline Shadow<GLuint> textures[TEXTURE_UNITS], samplers[TEXTURE_UNITS];
+        static inline GLStateStats stats;
+
+        static void setCapability(Shadow<bool>& shadow, GLenum capability, bool enabled){
+            if(shadow.change(enabled)){
+                if(enabled) glEnable(capability); else glDisable(capability);
+            }
+        }
+        // Returns the index of the active texture unit (or TEXTURE_UNITS if it is unknown or not shadowed)
+        static GLuint activeUnitIndex(){
+            if(!activeTextureUnit.known) return TEXTURE_UNITS;
+            GLuint index = activeTextureUnit.value - GL_TEXTURE0;
+            return index < TEXTURE_UNITS ? index : TEXTURE_UNITS;
+        }
+
+    public:
+        // The pipeline options (see "PipelineState")
+        static void setFaceCulling(bool enabled){ setCapability(cullFaceEnabled, GL_CULL_FACE, enabled); }
+        static void setDepthTesting(bool enabled){ setCapability(depthTestEnabled, GL_DEPTH_TEST, enabled); }
+        static void setBlending(bool enabled){ setCapability(blendEnabled, GL_BLEND, enabled); }
+        static void cullFace(GLenum face){ if(culledFace.change(face)) glCullFace(face); }
+        static void frontFace(GLenum orientation){ if(frontFaceValue.change(orientation)) glFrontFace(orientation); }
+        static void depthFunc(GLenum function){ if(depthFunction.change(function)) glDepthFunc(function); }
+        static void depthMask(bool enabled){ if(depthMaskValue.change(enabled)) glDepthMask(enabled); }
+        static void colorMask(bool r, bool g, bool b, bool a){ if(colorMaskValue.change({r, g, b, a})) glColorMask(r, g, b, a); }
+        static void blendEquation(GLenum equation){ if(blendEquationValue.change(equation)) glBlendEquation(equation); }
+        static void blendFunc(GLenum source, GLenum destination){ if(blendFunction.change({source, destination})) glBlendFunc(source, destination); }
+        static void blendColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a){ if(blendColorValue.change({r, g, b, a})) glBlendColor(r, g, b, a); }
+
+        // The bound objects
+        static void useProgram(GLuint name){ if(program.change(name)) glUseProgram(name); }
+        static void bindVertexArray(GLuint name){ if(vertexArray.change(name)) glBindVertexArray(name); }
+        static void bindDrawFramebuffer(GLuint name){ if(drawFramebuffer.change(name)) glBindFramebuffer(GL_DRAW_FRAMEBUFFER, name); }
+        static void activeTexture(GLenum unit){ if(activeTextureUnit.change(unit)) glActiveTexture(unit); }
+        // Binds the texture to GL_TEXTURE_2D of the active texture unit
+        static void bindTexture2D(GLuint name){
+            GLuint unit = activeUnitIndex();
+            if(unit == TEXTURE_UNITS){
+                ++stats.issued;
+                glBindTexture(GL_TEXTURE_2D, name);
+            } else if(textures[unit].change(name)) glBindTexture(GL_TEXTURE_2D, name);
+        }
+        static void bindSampler(GLuint unit, GLuint name){
+            if(unit >= TEXTURE_UNITS){
+                ++stats.issued;
+                glBindSampler(unit, name);
+            } else if(samplers[unit].change(name)) glBindSampler(unit, name);
+        }
+
+        // These should be called before deleting an object. OpenGL unbinds a deleted vertex array, texture or sampler
+        // from the current context, and a new object could later get the same name, so the shadow values are updated to match.
+        static void forgetProgram(GLuint name){ if(program.known && program.value == name) program.known = false; }
+        static void forgetVertexArray(GLuint name){ if(vertexArray.known && vertexArray.value == name) vertexArray.value = 0; }
+        static void forgetFramebuffer(GLuint name){ if(drawFramebuffer.known && drawFramebuffer.value == name) drawFramebuffer.value = 0; }
+        static void forgetTexture(GLuint name){
+            for(auto& texture : textures) if(texture.known && texture.value == name) texture.value = 0;
+        }
+        static void forgetSampler(GLuint name){
+            for(auto& sampler : samplers) if(sampler.known && sampler.value == name) sampler.value = 0;
+        }
+
+        // Marks the whole state as unknown, so the next call for each value is issued
+        static void invalidate(){
+            cullFaceEnabled.known = depthTestEnabled.known = blendEnabled.known = depthMaskValue.known = false;
+            culledFace.known = frontFaceValue.known = depthFunction.known = blendEquationValue.known = false;
+            blendFunction.known = blendColorValue.known = colorMaskValue.known = false;
+            program.known = vertexArray.known = drawFramebuffer.known = activeTextureUnit.known = false;
+            for(auto& texture : textures) texture.known = false;
+            for(auto& sampler : samplers) sampler.known = false;
+        }
+
+        static const GLStateStats& getStats(){ return stats; }
+        static void resetStats(){ stats = GLStateStats(); }
+    };
+
+}
@@ -1,15 +1,16 @@
 #include "material.hpp"
 
 #include "../asset-loader.hpp"
+#include "../shader/uniform-names.hpp"
 #include "deserialize-utils.hpp"
 
 namespace our {
 
     // This function should setup the pipeline state and set the shader to be used
-    void Material::setup() const {
+    void Material::setup(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
         pipelineState.setup();
-        shader->use();
+        program->use();
     }
 
     // This function read the material data from a json object
@@ -24,13 +25,13 @@ namespace our {
     }
 
     
-    void LitMaterial::setup() const {
-        Material::setup();
-        shader->set("material.diffuse",diffuse);
-        shader->set("material.specular",specular);
-        shader->set("material.ambient",ambient);
+    void LitMaterial::setup(ShaderProgram* program) const {
+        Material::setup(program);
+        program->set(uniforms::MATERIAL_DIFFUSE, diffuse);
+        program->set(uniforms::MATERIAL_SPECULAR, specular);
+        program->set(uniforms::MATERIAL_AMBIENT, ambient);
         //shader->set("material.emissive",emissive);
-        shader->set("material.shininess",shininess);
+        program->set(uniforms::MATERIAL_SHININESS, shininess);
     }
 
     // This function read the material data from a json object
@@ -46,10 +47,10 @@ namespace our {
 
     // This function should call the setup of its parent and
     // set the "tint" uniform to the value in the member variable tint 
-    void TintedMaterial::setup() const {
+    void TintedMaterial::setup(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
-        Material::setup();
-        shader->set("tint", tint);
+        Material::setup(program);
+        program->set(uniforms::TINT, tint);
     }
 
     // This function read the material data from a json object
@@ -59,10 +60,10 @@ namespace our {
         tint = data.value("tint", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
     }
 
-    void LitTintedMaterial::setup() const {
+    void LitTintedMaterial::setup(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
-        LitMaterial::setup();
-        shader->set("tint", tint);
+        LitMaterial::setup(program);
+        program->set(uniforms::TINT, tint);
     }
 
     // This function read the material data from a json object
@@ -75,18 +76,18 @@ namespace our {
     // This function should call the setup of its parent and
     // set the "alphaThreshold" uniform to the value in the member variable alphaThreshold
     // Then it should bind the texture and sampler to a texture unit and send the unit number to the uniform variable "tex" 
-    void TexturedMaterial::setup() const {
+    void TexturedMaterial::setup(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
-        TintedMaterial::setup();
-        shader->set("alphaThreshold",alphaThreshold);
+        TintedMaterial::setup(program);
+        program->set(uniforms::ALPHA_THRESHOLD, alphaThreshold);
         // bind the texture to the texture unit 0
-        glActiveTexture(GL_TEXTURE0);
+        GLStateCache::activeTexture(GL_TEXTURE0);
         texture->bind();
         // Then we bind the sampler to unit 0
         if(sampler)
             sampler->bind(0);
         // Then we send 0 (the index of the texture unit we used above) to the "tex" uniform
-        shader->set("tex", 0);
+        program->set(uniforms::TEX, 0);
     }
 
     // This function read the material data from a json object
@@ -97,18 +98,18 @@ namespace our {
         texture = AssetLoader<Texture2D>::get(data.value("texture", ""));
         sampler = AssetLoader<Sampler>::get(data.value("sampler", ""));
     }
-    void LitTexturedMaterial::setup() const {
+    void LitTexturedMaterial::setup(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
-        LitTintedMaterial::setup();
-        shader->set("alphaThreshold", alphaThreshold);
+        LitTintedMaterial::setup(program);
+        program->set(uniforms::ALPHA_THRESHOLD, alphaThreshold);
         // bind the texture to the texture unit 0
-        glActiveTexture(GL_TEXTURE0);
+        GLStateCache::activeTexture(GL_TEXTURE0);
         texture->bind();
         // Then we bind the sampler to unit 0
         if (sampler)
             sampler->bind(0);
         // Then we send 0 (the index of the texture unit we used above) to the "tex" uniform
-        shader->set("tex", 0);
+        program->set(uniforms::TEX, 0);
     }
 
     // This function read the material data from a json object
@@ -21,11 +21,21 @@ namespace our {
         PipelineState pipelineState;
         ShaderProgram* shader;
         bool transparent;
+        // A small number that identifies this material (the renderer sorts the draws by it to group those that share a material)
+        const uint32_t id = createId();
         
         // This function does 2 things: setup the pipeline state and set the shader program to be used
-        virtual void setup() const;
+        void setup() const { setup(shader); }
+        // Same as "setup" but it uses the given program instead of "shader" (e.g. the instanced variant of "shader")
+        // and sends the uniforms of the material to it
+        virtual void setup(ShaderProgram* program) const;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json& data);
+    private:
+        static uint32_t createId() {
+            static uint32_t nextId = 0;
+            return nextId++;
+        }
     };
 
     class LitMaterial :public Material {
@@ -33,7 +43,8 @@ namespace our {
         glm::vec3 diffuse, specular, ambient;
         float shininess;
 
-        virtual void setup() const;
+        using Material::setup;
+        void setup(ShaderProgram* program) const override;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json& data);
 
@@ -45,7 +56,8 @@ namespace our {
     public:
         glm::vec4 tint;
 
-        void setup() const override;
+        using Material::setup;
+        void setup(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
@@ -53,7 +65,8 @@ namespace our {
     public:
         glm::vec4 tint;
 
-        void setup() const override;
+        using LitMaterial::setup;
+        void setup(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
@@ -68,7 +81,8 @@ namespace our {
         Sampler* sampler;
         float alphaThreshold;
 
-        void setup() const override;
+        using TintedMaterial::setup;
+        void setup(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
     class LitTexturedMaterial : public LitTintedMaterial {
@@ -77,7 +91,8 @@ namespace our {
         Sampler* sampler;
         float alphaThreshold;
 
-        void setup() const override;
+        using LitTintedMaterial::setup;
+        void setup(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
@@ -1,6 +1,10 @@
 #include "pipeline-state.hpp"
 #include "../deserialize-utils.hpp"
 
+#include <array>
+#include <map>
+#include <cstring>
+
 namespace our {
 
     // Given a json object, this function deserializes a PipelineState structure
@@ -63,4 +67,26 @@ namespace our {
         depthMask = data.value("depthMask", depthMask);
     }
 
-}
\ No newline at end of file
+    // Every combination of options gets the next id the first time it is seen
+    uint32_t PipelineState::getId() const {
+        auto floatBits = [](float value){
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        };
+        using Options = std::array<uint32_t, 15>;
+        static std::map<Options, uint32_t> ids;
+        Options options = {
+            faceCulling.enabled, faceCulling.culledFace, faceCulling.frontFace,
+            depthTesting.enabled, depthTesting.function,
+            blending.enabled, blending.equation, blending.sourceFactor, blending.destinationFactor,
+            floatBits(blending.constantColor.r), floatBits(blending.constantColor.g),
+            floatBits(blending.constantColor.b), floatBits(blending.constantColor.a),
+            uint32_t(colorMask.r) | uint32_t(colorMask.g) << 1 | uint32_t(colorMask.b) << 2 | uint32_t(colorMask.a) << 3,
+            depthMask
+        };
+        auto it = ids.try_emplace(options, static_cast<uint32_t>(ids.size())).first;
+        return it->second;
+    }
+
+}
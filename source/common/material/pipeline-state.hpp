@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../gl-state-cache.hpp"
+
 #include <glad/gl.h>
 #include <glm/vec4.hpp>
 #include <json/json.hpp>
@@ -45,39 +47,39 @@ namespace our
 
         // This function should set the OpenGL options to the values specified by this structure
         // For example, if faceCulling.enabled is true, you should call glEnable(GL_CULL_FACE), otherwise, you should call glDisable(GL_CULL_FACE)
+        // The calls go through the GL state cache, so only the options that differ from the previous draw reach OpenGL
         void setup() const
         {
             // TODO: (Req 4) Write this function
             // faceCulling setup
-            glColorMask(colorMask.r,colorMask.g,colorMask.b,colorMask.a);
-            glDepthMask(depthMask);
+            GLStateCache::colorMask(colorMask.r,colorMask.g,colorMask.b,colorMask.a);
+            GLStateCache::depthMask(depthMask);
+            GLStateCache::setFaceCulling(faceCulling.enabled);
             if (faceCulling.enabled)
             {
-                glEnable(GL_CULL_FACE);
-                glCullFace(faceCulling.culledFace);
-                glFrontFace(faceCulling.frontFace);
+                GLStateCache::cullFace(faceCulling.culledFace);
+                GLStateCache::frontFace(faceCulling.frontFace);
             }
-            else glDisable(GL_CULL_FACE);
             // depthTest setup
+            GLStateCache::setDepthTesting(depthTesting.enabled);
             if (depthTesting.enabled)
-            {
-                glEnable(GL_DEPTH_TEST);
-                glDepthFunc(depthTesting.function);
-            }
-            else glDisable(GL_DEPTH_TEST);
+                GLStateCache::depthFunc(depthTesting.function);
             //blending setup
+            GLStateCache::setBlending(blending.enabled);
             if (blending.enabled)
             {
-                glEnable(GL_BLEND);  
-                glBlendEquation(blending.equation);
-                glBlendColor(blending.constantColor.r,blending.constantColor.g,blending.constantColor.b,blending.constantColor.a);
-                glBlendFunc(blending.sourceFactor,blending.destinationFactor);
+                GLStateCache::blendEquation(blending.equation);
+                GLStateCache::blendColor(blending.constantColor.r,blending.constantColor.g,blending.constantColor.b,blending.constantColor.a);
+                GLStateCache::blendFunc(blending.sourceFactor,blending.destinationFactor);
             }
-            else glDisable(GL_BLEND);
         }
 
         // Given a json object, this function deserializes a PipelineState structure
         void deserialize(const nlohmann::json &data);
+
+        // Returns a small number which is the same for all the pipeline states that have the same options
+        // (the renderer sorts the draws by it to group those that share a pipeline state)
+        uint32_t getId() const;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "geometry-arena.hpp"
+#include "vertex-layout.hpp"
+#include "../gl-state-cache.hpp"
+#include "../gl-features.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+// ARB_multi_draw_indirect is not part of OpenGL 3.3, so its constant & function are defined and loaded here
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+namespace our {
+
+    size_t RangeAllocator::allocate(size_t size){
+        if(size == 0) return 0;
+        for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it){
+            if(it->second < size) continue;
+            size_t offset = it->first, remaining = it->second - size;
+            freeRanges.erase(it);
+            if(remaining > 0) freeRanges.emplace(offset + size, remaining);
+            used += size;
+            return offset;
+        }
+        return INVALID;
+    }
+
+    void RangeAllocator::free(size_t offset, size_t size){
+        if(size == 0) return;
+        used -= size;
+        auto next = freeRanges.lower_bound(offset);
+        // Merge with the free range that ends where this one starts
+        if(next != freeRanges.begin()){
+            auto previous = std::prev(next);
+            if(previous->first + previous->second == offset){
+                offset = previous->first;
+                size += previous->second;
+                freeRanges.erase(previous);
+            }
+        }
+        // Merge with the free range that starts where this one ends
+        if(next != freeRanges.end() && offset + size == next->first){
+            size += next->second;
+            freeRanges.erase(next);
+        }
+        freeRanges.emplace(offset, size);
+    }
+
+    void RangeAllocator::grow(size_t newCapacity){
+        if(newCapacity <= capacity) return;
+        size_t oldCapacity = capacity;
+        capacity = newCapacity;
+        // "free" merges the new elements with the free range at the end (if any)
+        used += newCapacity - oldCapacity;
+        free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    typedef void (APIENTRY* MultiDrawElementsIndirectFunction)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+    // Returns glMultiDrawElementsIndirect if the driver supports it with base instances (nullptr otherwise). It is only looked up once.
+    static MultiDrawElementsIndirectFunction getMultiDrawElementsIndirect(){
+        static MultiDrawElementsIndirectFunction function =
+            hasGLVersion(4, 3) || (hasGLExtension("GL_ARB_draw_indirect") && hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance")) ?
+            reinterpret_cast<MultiDrawElementsIndirectFunction>(glfwGetProcAddress("glMultiDrawElementsIndirect")) : nullptr;
+        return function;
+    }
+
+    bool GeometryArena::isMultiDrawIndirectSupported(){
+        return getMultiDrawElementsIndirect() != nullptr;
+    }
+
+    GeometryArena::GeometryArena(size_t vertexCapacity, size_t indexCapacity){
+        vertexCapacity = std::max<size_t>(vertexCapacity, 1);
+        indexCapacity = std::max<size_t>(indexCapacity, 1);
+        growBuffer(VBO, 0, vertexCapacity * sizeof(Vertex));
+        growBuffer(positionVBO, 0, vertexCapacity * sizeof(glm::vec3));
+        growBuffer(EBO, 0, indexCapacity * sizeof(GLuint));
+        vertices.grow(vertexCapacity);
+        indices.grow(indexCapacity);
+        glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &positionVAO);
+        setupVertexArrays();
+    }
+
+    GeometryArena::~GeometryArena(){
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &positionVBO);
+        glDeleteBuffers(1, &EBO);
+        GLStateCache::forgetVertexArray(VAO);
+        glDeleteVertexArrays(1, &VAO);
+        GLStateCache::forgetVertexArray(positionVAO);
+        glDeleteVertexArrays(1, &positionVAO);
+    }
+
+    void GeometryArena::growBuffer(GLuint& buffer, size_t oldSize, size_t newSize){
+        // The copy targets are used so that no vertex array is changed by binding the buffers
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+        if(buffer){
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = newBuffer;
+    }
+
+    void GeometryArena::setupVertexArrays(){
+        GLStateCache::bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        setupVertexAttributes();
+        // The element buffer binding is part of the vertex array's state
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        // Both vertex arrays share the element buffer
+        GLStateCache::bindVertexArray(positionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        setupPositionAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    }
+
+    GeometryArena::Allocation GeometryArena::allocate(const std::vector<Vertex>& vertexData, const std::vector<GLuint>& elementData){
+        Allocation allocation;
+        allocation.vertexCount = vertexData.size();
+        allocation.indexCount = elementData.size();
+
+        allocation.firstVertex = vertices.allocate(allocation.vertexCount);
+        if(allocation.firstVertex == RangeAllocator::INVALID){
+            // The buffer at least doubles, so filling the arena copies each vertex a few times at most
+            size_t oldCapacity = vertices.getCapacity();
+            size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + allocation.vertexCount);
+            growBuffer(VBO, oldCapacity * sizeof(Vertex), newCapacity * sizeof(Vertex));
+            growBuffer(positionVBO, oldCapacity * sizeof(glm::vec3), newCapacity * sizeof(glm::vec3));
+            vertices.grow(newCapacity);
+            setupVertexArrays();
+            allocation.firstVertex = vertices.allocate(allocation.vertexCount);
+        }
+        allocation.firstIndex = indices.allocate(allocation.indexCount);
+        if(allocation.firstIndex == RangeAllocator::INVALID){
+            size_t oldCapacity = indices.getCapacity();
+            size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + allocation.indexCount);
+            growBuffer(EBO, oldCapacity * sizeof(GLuint), newCapacity * sizeof(GLuint));
+            indices.grow(newCapacity);
+            setupVertexArrays();
+            allocation.firstIndex = indices.allocate(allocation.indexCount);
+        }
+
+        if(allocation.vertexCount > 0){
+            glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * sizeof(Vertex), allocation.vertexCount * sizeof(Vertex), vertexData.data());
+            std::vector<glm::vec3> positions(allocation.vertexCount);
+            for(size_t index = 0; index < allocation.vertexCount; ++index) positions[index] = vertexData[index].position;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, positionVBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * sizeof(glm::vec3), allocation.vertexCount * sizeof(glm::vec3), positions.data());
+        }
+        if(allocation.indexCount > 0){
+            glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * sizeof(GLuint), allocation.indexCount * sizeof(GLuint), elementData.data());
+        }
+        return allocation;
+    }
+
+    void GeometryArena::free(const Allocation& allocation){
+        vertices.free(allocation.firstVertex, allocation.vertexCount);
+        indices.free(allocation.firstIndex, allocation.indexCount);
+    }
+
+    void GeometryArena::bindInstances(GLuint instanceBuffer, size_t instanceOffset, VertexStream stream){
+        GLStateCache::bindVertexArray(getVertexArray(stream));
+        setupInstanceAttributes(instanceBuffer, instanceOffset, stream == VertexStream::ALL ? instancingEnabled : positionInstancingEnabled);
+    }
+
+    void GeometryArena::multiDrawIndirect(GLuint commandBuffer, size_t commandOffset, GLsizei drawCount, VertexStream stream){
+        GLStateCache::bindVertexArray(getVertexArray(stream));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        getMultiDrawElementsIndirect()(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)commandOffset, drawCount, 0);
+    }
+
+    GeometryArena* GeometryArena::getShared(){
+        // It starts with room for a few average models (it grows as more are loaded)
+        if(shared == nullptr) shared = new GeometryArena(64 * 1024, 256 * 1024);
+        return shared;
+    }
+
+    void GeometryArena::releaseShared(){
+        if(shared && shared->isEmpty()){
+            delete shared;
+            shared = nullptr;
+        }
+    }
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glad/gl.h>
+#include "vertex.hpp"
+#include "vertex-layout.hpp"
+
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+
+namespace our {
+
+    // Hands out ranges of a buffer (measured in elements, e.g. vertices or indices).
+    // The free ranges are kept sorted by their offsets, so a freed range is merged with the free ranges around it.
+    class RangeAllocator {
+        std::map<size_t, size_t> freeRanges; // The size of each free range by its offset
+        size_t capacity = 0, used = 0;
+    public:
+        static constexpr size_t INVALID = SIZE_MAX;
+
+        // Returns the offset of a free range of "size" elements (the first one that fits) or INVALID if there is none
+        size_t allocate(size_t size);
+        // Returns the range to the free ranges
+        void free(size_t offset, size_t size);
+        // Adds the elements from the current capacity to "newCapacity" to the free ranges
+        void grow(size_t newCapacity);
+
+        size_t getCapacity() const { return capacity; }
+        size_t getUsed() const { return used; }
+    };
+
+    // A geometry arena stores many meshes in one vertex buffer & one element buffer read by a single vertex array.
+    // Each mesh is addressed by its first index & its base vertex, so drawing different meshes does not bind another
+    // vertex array and the draws of many meshes can be issued by a single multi-draw call (see "multiDrawIndirect").
+    // All the meshes of an arena share the vertex format "Vertex".
+    class GeometryArena {
+    public:
+        // The layout of a command read by glMultiDrawElementsIndirect
+        struct DrawCommand {
+            GLuint count;         // The number of indices
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;  // The index of the first instance in the instance attributes
+        };
+        // Where a mesh is stored in the arena (in vertices & indices)
+        struct Allocation {
+            size_t firstVertex = 0, vertexCount = 0;
+            size_t firstIndex = 0, indexCount = 0;
+        };
+
+    private:
+        GLuint VAO = 0, VBO = 0, EBO = 0;
+        // The positions of the vertices are also stored in their own buffer (at the same indices as the vertices)
+        // which is read by the position only vertex array (see "VertexStream")
+        GLuint positionVAO = 0, positionVBO = 0;
+        RangeAllocator vertices, indices;
+        // Whether the instance attributes are enabled in each vertex array (see "setupInstanceAttributes")
+        bool instancingEnabled = false, positionInstancingEnabled = false;
+
+        static inline GeometryArena* shared = nullptr;
+
+        // Moves the contents of the buffer to a new buffer of "newSize" bytes
+        static void growBuffer(GLuint& buffer, size_t oldSize, size_t newSize);
+        // Points the vertex arrays at the current buffers (they change when the arena grows)
+        void setupVertexArrays();
+
+    public:
+        // The capacities are the initial numbers of vertices & indices (the buffers grow when they are full)
+        GeometryArena(size_t vertexCapacity, size_t indexCapacity);
+        ~GeometryArena();
+
+        // Copies the vertices & elements of a mesh to the arena (the indices in "elements" are relative to the mesh's first vertex)
+        Allocation allocate(const std::vector<Vertex>& vertexData, const std::vector<GLuint>& elementData);
+        // Releases the space of a mesh (its contents are overwritten by the meshes allocated later)
+        void free(const Allocation& allocation);
+
+        GLuint getVertexArray(VertexStream stream = VertexStream::ALL) const { return stream == VertexStream::ALL ? VAO : positionVAO; }
+        bool isEmpty() const { return vertices.getUsed() == 0 && indices.getUsed() == 0; }
+
+        // Binds the vertex array of the stream and points its instance attributes at the instances stored in "instanceBuffer" from the byte "instanceOffset"
+        void bindInstances(GLuint instanceBuffer, size_t instanceOffset, VertexStream stream = VertexStream::ALL);
+        // Issues the "drawCount" draw commands (see "DrawCommand") stored in "commandBuffer" from the byte "commandOffset" in a single call.
+        // The instance attributes must have been pointed at the instances by "bindInstances" (the commands select them by their base instance).
+        void multiDrawIndirect(GLuint commandBuffer, size_t commandOffset, GLsizei drawCount, VertexStream stream = VertexStream::ALL);
+
+        // Returns true if the driver supports glMultiDrawElementsIndirect with base instances (OpenGL 4.3 or the ARB extensions)
+        static bool isMultiDrawIndirectSupported();
+
+        // Returns the arena shared by the static meshes of the assets (it is created by the first call)
+        static GeometryArena* getShared();
+        // Deletes the shared arena if no mesh is left in it
+        static void releaseShared();
+
+        GeometryArena(const GeometryArena&) = delete;
+        GeometryArena& operator=(const GeometryArena&) = delete;
+    };
+
+}
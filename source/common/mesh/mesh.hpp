@@ -2,22 +2,61 @@
 
 #include <glad/gl.h>
 #include "vertex.hpp"
+#include "vertex-layout.hpp"
+#include "geometry-arena.hpp"
+#include "../gl-state-cache.hpp"
 
-namespace our {
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 
-    #define ATTRIB_LOC_POSITION 0
-    #define ATTRIB_LOC_COLOR    1
-    #define ATTRIB_LOC_TEXCOORD 2
-    #define ATTRIB_LOC_NORMAL   3
+namespace our {
 
     class Mesh {
         // Here, we store the object names of the 3 main components of a mesh:
         // A vertex array object, A vertex buffer and an element buffer
-        unsigned int VBO, EBO;
+        // (if the mesh is stored in a geometry arena, the buffers belong to the arena and VAO is the arena's vertex array)
+        unsigned int VBO = 0, EBO = 0;
         unsigned int VAO;
+        // The positions are also stored in their own buffer, which is read by the position only vertex array (see "VertexStream")
+        unsigned int positionVBO = 0, positionVAO = 0;
         // We need to remember the number of elements that will be draw by glDrawElements 
         GLsizei elementCount;
+        // The arena that stores the mesh (if any) and where the mesh is in it
+        GeometryArena* arena = nullptr;
+        GeometryArena::Allocation allocation;
+        // Whether the instance attributes are enabled in each vertex array (they are enabled by the first instanced draw)
+        bool instancingEnabled = false, positionInstancingEnabled = false;
+        // The bounding volumes of the vertices in the local space of the mesh (used to skip the meshes that can not be seen)
+        glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+        glm::vec4 boundingSphere = glm::vec4(0.0f); // The center is stored in xyz and the radius in w
+
+        // Computes the axis aligned bounding box of the vertices then a bounding sphere centered on that box
+        void computeBounds(const std::vector<Vertex>& vertices){
+            if(vertices.empty()) return;
+            boundsMin = boundsMax = vertices[0].position;
+            for(const auto& vertex : vertices){
+                boundsMin = glm::min(boundsMin, vertex.position);
+                boundsMax = glm::max(boundsMax, vertex.position);
+            }
+            glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+            // The farthest vertex from the center gives a tighter sphere than the half diagonal of the box
+            float radiusSquared = 0.0f;
+            for(const auto& vertex : vertices){
+                glm::vec3 offset = vertex.position - center;
+                radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+            }
+            boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+        }
+        static uint32_t createId() {
+            static uint32_t nextId = 0;
+            return nextId++;
+        }
     public:
+        // A small number that identifies this mesh (the renderer sorts the draws by it to group those that share a mesh,
+        // since the meshes of a geometry arena share their vertex array)
+        const uint32_t id = createId();
 
         // The constructor takes two vectors:
         // - vertices which contain the vertex data.
@@ -27,55 +66,114 @@ namespace our {
         // an element buffer to store the element data on the VRAM,
         // a vertex array object to define how to read the vertex & element buffer during rendering 
 
-        Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements)
+        // If "arena" is given, the data is stored in the arena instead (see "GeometryArena").
+        Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements, GeometryArena* arena = nullptr) : arena(arena)
         {
             //TODO: (Req 2) Write this function
             // remember to store the number of elements in "elementCount" since you will need it for drawing
             // For the attribute locations, use the constants defined above: ATTRIB_LOC_POSITION, ATTRIB_LOC_COLOR, etc
 
             elementCount = elements.size();
+            computeBounds(vertices);
+
+            if(arena){
+                allocation = arena->allocate(vertices, elements);
+                VAO = arena->getVertexArray();
+                positionVAO = arena->getVertexArray(VertexStream::POSITION);
+                return;
+            }
 
             glGenBuffers(1, &VBO);
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
 
             glGenVertexArrays(1, &VAO);
-            glBindVertexArray(VAO);
+            GLStateCache::bindVertexArray(VAO);
 
-            glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-            glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
-
-            glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(offsetof(Vertex, color))); 
-            glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
-
-            glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, tex_coord)));
-            glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
-
-            glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, normal)));
-            glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
+            // The attribute locations are defined in "vertex-layout.hpp" (ATTRIB_LOC_POSITION, ATTRIB_LOC_COLOR, etc)
+            setupVertexAttributes();
 
             glGenBuffers(1, &EBO);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), elements.data(), GL_STATIC_DRAW);
 
+            // The position only vertex array reads the packed positions and shares the element buffer
+            std::vector<glm::vec3> positions(vertices.size());
+            for(size_t index = 0; index < vertices.size(); ++index) positions[index] = vertices[index].position;
+            glGenBuffers(1, &positionVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+            glGenVertexArrays(1, &positionVAO);
+            GLStateCache::bindVertexArray(positionVAO);
+            setupPositionAttributes();
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
             //glBindVertexArray(0); // not sure where this should be used, or if it should be used at all
         }
 
         // this function should render the mesh
-        void draw()
+        // (only the positions are read if "stream" is VertexStream::POSITION)
+        void draw(VertexStream stream = VertexStream::ALL)
         {
             //TODO: (Req 2) Write this function
-            glBindVertexArray(VAO);
+            // The vertex array stays bound after the draw, so consecutive draws of the same mesh do not bind it again
+            GLStateCache::bindVertexArray(stream == VertexStream::ALL ? VAO : positionVAO);
+            if(arena){
+                // The indices of the mesh are relative to its first vertex in the arena
+                glDrawElementsBaseVertex(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT,
+                                         (void*)(allocation.firstIndex * sizeof(GLuint)), (GLint)allocation.firstVertex);
+                return;
+            }
             glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, (void*)0);
-            glBindVertexArray(0);
+        }
+
+        // Draws "instanceCount" instances of the mesh in a single draw call.
+        // The instances read their data (see "InstanceData") from "instanceBuffer" starting at the byte "instanceOffset".
+        void drawInstanced(GLuint instanceBuffer, size_t instanceOffset, GLsizei instanceCount, VertexStream stream = VertexStream::ALL)
+        {
+            if(arena){
+                arena->bindInstances(instanceBuffer, instanceOffset, stream);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT,
+                                                  (void*)(allocation.firstIndex * sizeof(GLuint)), instanceCount, (GLint)allocation.firstVertex);
+                return;
+            }
+            bool positionsOnly = stream == VertexStream::POSITION;
+            GLStateCache::bindVertexArray(positionsOnly ? positionVAO : VAO);
+            // The attributes are pointed at the instances of this draw
+            setupInstanceAttributes(instanceBuffer, instanceOffset, positionsOnly ? positionInstancingEnabled : instancingEnabled);
+            glDrawElementsInstanced(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, (void*)0, instanceCount);
+        }
+
+        // The local space bounds of the mesh: an axis aligned box and a sphere (center in xyz, radius in w)
+        const glm::vec3& getBoundsMin() const { return boundsMin; }
+        const glm::vec3& getBoundsMax() const { return boundsMax; }
+        const glm::vec4& getBoundingSphere() const { return boundingSphere; }
+
+        // Returns the name of the vertex array object (the meshes of a geometry arena share the arena's vertex array)
+        GLuint getOpenGLName() const { return VAO; }
+
+        // The arena that stores the mesh (nullptr if the mesh has its own buffers)
+        GeometryArena* getArena() const { return arena; }
+        // Returns the command that draws "instanceCount" instances of the mesh from "baseInstance" (only for the meshes of an arena)
+        GeometryArena::DrawCommand getDrawCommand(GLuint instanceCount, GLuint baseInstance) const {
+            return {(GLuint)elementCount, instanceCount, (GLuint)allocation.firstIndex, (GLint)allocation.firstVertex, baseInstance};
         }
 
         // this function should delete the vertex & element buffers and the vertex array object
         ~Mesh(){
             //TODO: (Req 2) Write this function
+            if(arena){
+                // The vertex array belongs to the arena
+                arena->free(allocation);
+                return;
+            }
             glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &positionVBO);
             glDeleteBuffers(1, &EBO);
+            GLStateCache::forgetVertexArray(VAO);
             glDeleteVertexArrays(1, &VAO);
+            GLStateCache::forgetVertexArray(positionVAO);
+            glDeleteVertexArrays(1, &positionVAO);
         }
 
         Mesh(Mesh const &) = delete;
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glad/gl.h>
+#include "vertex.hpp"
+
+#include <cstddef>
+
+namespace our {
+
+    #define ATTRIB_LOC_POSITION 0
+    #define ATTRIB_LOC_COLOR    1
+    #define ATTRIB_LOC_TEXCOORD 2
+    #define ATTRIB_LOC_NORMAL   3
+    // The per-instance attributes of the instanced draws (each matrix takes 4 locations, one per column)
+    #define ATTRIB_LOC_INSTANCE_OBJECT_TO_WORLD 4
+    #define ATTRIB_LOC_INSTANCE_NORMAL_MATRIX   8
+
+    // The vertex attributes read by a draw: all the attributes of "Vertex", or only the positions.
+    // The positions are also stored in their own tightly packed buffer, so the draws that only need them
+    // (e.g. the depth pre-pass) fetch 12 bytes per vertex instead of a whole "Vertex".
+    enum class VertexStream {
+        ALL,
+        POSITION
+    };
+
+    // Defines how the bound vertex array reads "Vertex" from the buffer bound to GL_ARRAY_BUFFER
+    inline void setupVertexAttributes(){
+        glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+        glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
+
+        glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(offsetof(Vertex, color)));
+        glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
+
+        glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, tex_coord)));
+        glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
+
+        glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, normal)));
+        glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
+    }
+
+    // Defines how the bound vertex array reads the positions from a buffer of packed positions bound to GL_ARRAY_BUFFER
+    inline void setupPositionAttributes(){
+        glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+        glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
+    }
+
+    // Points the instance attributes of the bound vertex array at the instances (see "InstanceData") stored in
+    // "instanceBuffer" from the byte "instanceOffset". "enabled" tells whether the attributes of this vertex array
+    // are already enabled (they are enabled by the first instanced draw, since an enabled attribute needs a buffer).
+    inline void setupInstanceAttributes(GLuint instanceBuffer, size_t instanceOffset, bool& enabled){
+        // OpenGL 3.3 has no base instance, so the offset is given through the attribute pointers instead
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for(GLuint column = 0; column < 4; ++column){
+            size_t columnOffset = instanceOffset + column * sizeof(glm::vec4);
+            glVertexAttribPointer(ATTRIB_LOC_INSTANCE_OBJECT_TO_WORLD + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(columnOffset + offsetof(InstanceData, objectToWorld)));
+            glVertexAttribPointer(ATTRIB_LOC_INSTANCE_NORMAL_MATRIX + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(columnOffset + offsetof(InstanceData, normalMatrix)));
+        }
+        if(!enabled){
+            // The instance attributes advance once per instance instead of once per vertex
+            for(GLuint column = 0; column < 4; ++column){
+                glEnableVertexAttribArray(ATTRIB_LOC_INSTANCE_OBJECT_TO_WORLD + column);
+                glVertexAttribDivisor(ATTRIB_LOC_INSTANCE_OBJECT_TO_WORLD + column, 1);
+                glEnableVertexAttribArray(ATTRIB_LOC_INSTANCE_NORMAL_MATRIX + column);
+                glVertexAttribDivisor(ATTRIB_LOC_INSTANCE_NORMAL_MATRIX + column, 1);
+            }
+            enabled = true;
+        }
+    }
+
+}
@@ -24,6 +24,12 @@ namespace our {
         }
     };
 
+    // The per-instance data of an instanced draw (read by the "INSTANCED" variants of the shaders)
+    struct InstanceData {
+        glm::mat4 objectToWorld;
+        glm::mat4 normalMatrix; // The inverse transpose of objectToWorld
+    };
+
 }
 
 // We plan to use struct Vertex as a key for a map so we need to define a hash function for it
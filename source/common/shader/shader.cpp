@@ -1,24 +1,58 @@
 #include "shader.hpp"
+#include "uniform-names.hpp"
 
 #include <cassert>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 //Forward definition for error checking functions
 std::string checkForShaderCompilationErrors(GLuint shader);
 std::string checkForLinkingErrors(GLuint program);
 
-bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const {
-    // Here, we open the file and read a string from it containing the GLSL code of our shader
+// Reads the shader file into "source". GLSL doesn't support "#include" by default, so each line that starts with #include "name"
+// is replaced with the contents of the named file (relative to the directory of the file that includes it).
+// The included files guard themselves against being included twice (e.g. "light.glsl").
+static bool readShaderSource(const std::string &filename, std::string &source, int depth = 0){
     std::ifstream file(filename);
     if(!file){
         std::cerr << "ERROR: Couldn't open shader file: " << filename << std::endl;
         return false;
     }
-    std::string sourceString = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    std::string directory = filename.substr(0, filename.find_last_of("/\\") + 1);
+    std::string line;
+    while(std::getline(file, line)){
+        size_t start = line.find_first_not_of(" \t");
+        if(start == std::string::npos || line.compare(start, 8, "#include") != 0){
+            source += line;
+            source += '\n';
+            continue;
+        }
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+        // The depth limit stops the files that include each other without a guard
+        if(close == std::string::npos || depth >= 16){
+            std::cerr << "ERROR: Invalid #include in shader file: " << filename << std::endl;
+            return false;
+        }
+        if(!readShaderSource(directory + line.substr(open + 1, close - open - 1), source, depth + 1)) return false;
+    }
+    return true;
+}
+
+bool our::ShaderProgram::attach(const std::string &filename, GLenum type, const std::string &defines) const {
+    // Here, we open the file and read a string from it containing the GLSL code of our shader (with its included files)
+    std::string sourceString;
+    if(!readShaderSource(filename, sourceString)) return false;
+    if(!defines.empty()){
+        // The defines must come after the "#version" line (which must be the first line of the shader)
+        size_t versionLine = sourceString.find("#version");
+        size_t lineEnd = versionLine == std::string::npos ? std::string::npos : sourceString.find('\n', versionLine);
+        size_t insertion = lineEnd == std::string::npos ? 0 : lineEnd + 1;
+        sourceString.insert(insertion, defines);
+    }
     const char* sourceCStr = sourceString.c_str();
-    file.close();
 
     //TODO: Complete this function
     //Note: The function "checkForShaderCompilationErrors" checks if there is
@@ -52,7 +86,7 @@ bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const
 
 
 
-bool our::ShaderProgram::link() const {
+bool our::ShaderProgram::link() {
     //TODO: Complete this function
     //Note: The function "checkForLinkingErrors" checks if there is
     // an error in the given program. You should use it to check if there is a
@@ -75,10 +109,51 @@ bool our::ShaderProgram::link() const {
         return false;
     }
 
+    // The active uniforms are found once here, so "set" never has to query the locations while drawing
+    uniforms.clear();
+    GLint uniformCount = 0, maxNameLength = 0;
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<char> nameBuffer(maxNameLength + 1);
+    for(GLint index = 0; index < uniformCount; ++index){
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = GL_NONE;
+        glGetActiveUniform(this->program, index, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        GLint location = glGetUniformLocation(this->program, name.c_str());
+        // The members of uniform blocks have no location (they are not set through "set")
+        if(location < 0) continue;
+        addUniform(name, location, type, size);
+    }
+
+    // The shared uniform blocks are bound to their binding points (GLSL 3.3 can not give the binding in the shader)
+    GLuint frameBlock = glGetUniformBlockIndex(this->program, uniform_blocks::FRAME_NAME);
+    if(frameBlock != GL_INVALID_INDEX) glUniformBlockBinding(this->program, frameBlock, uniform_blocks::FRAME);
+    // Likewise, the shared buffer textures are read from their fixed units
+    use();
+    set(uniforms::LIGHTS, (GLint)texture_units::LIGHTS);
+    set(uniforms::LIGHT_CLUSTERS, (GLint)texture_units::LIGHT_CLUSTERS);
+    set(uniforms::LIGHT_INDICES, (GLint)texture_units::LIGHT_INDICES);
 
     return true;
 }
 
+void our::ShaderProgram::addUniform(const std::string& name, GLint location, GLenum type, GLint size) {
+    uniforms[UniformName::hashName(name.c_str())] = Uniform{location, type};
+    // An array of a basic type is listed once as "name[0]" (the elements of an array of structs are listed one by one),
+    // so "name" and the other elements "name[i]" are registered too
+    const std::string firstElement = "[0]";
+    if(name.size() <= firstElement.size() || name.compare(name.size() - firstElement.size(), firstElement.size(), firstElement) != 0) return;
+    std::string arrayName = name.substr(0, name.size() - firstElement.size());
+    uniforms[UniformName::hashName(arrayName.c_str())] = Uniform{location, type};
+    for(GLint element = 1; element < size; ++element){
+        std::string elementName = arrayName + "[" + std::to_string(element) + "]";
+        GLint elementLocation = glGetUniformLocation(this->program, elementName.c_str());
+        if(elementLocation >= 0) uniforms[UniformName::hashName(elementName.c_str())] = Uniform{elementLocation, type};
+    }
+}
+
 ////////////////////////////////////////////////////////////////////
 // Function to check for compilation and linking error in shaders //
 ////////////////////////////////////////////////////////////////////
@@ -2,6 +2,11 @@
 #define SHADER_HPP
 
 #include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+
+#include "../gl-state-cache.hpp"
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
@@ -9,11 +14,58 @@
 
 namespace our {
 
+    // The name of a uniform along with its hash. The uniforms of a program are looked up by the hash, so no strings are
+    // built or compared while drawing. The hash of a constexpr name (e.g. "static constexpr UniformName TINT("tint")")
+    // is computed at compile time, and so are those of the literals passed to "set" when the compiler folds them.
+    struct UniformName {
+        uint64_t hash;
+
+        constexpr UniformName(const char* name) : hash(hashName(name)) {}
+        UniformName(const std::string& name) : hash(hashName(name.c_str())) {}
+
+        // The 64-bit FNV-1a hash of the name
+        static constexpr uint64_t hashName(const char* name) {
+            uint64_t hash = 14695981039346656037ull;
+            for(; *name; ++name) hash = (hash ^ static_cast<unsigned char>(*name)) * 1099511628211ull;
+            return hash;
+        }
+    };
+
     class ShaderProgram {
 
     private:
         //Shader Program Handle (OpenGL object name)
         GLuint program;
+        // The same shaders compiled with "INSTANCED" defined (nullptr if the shaders have no instanced variant).
+        // It is owned by this program.
+        ShaderProgram* instancedVariant = nullptr;
+
+        // An active uniform of the program along with the last value sent to it
+        struct Uniform {
+            GLint location;
+            GLenum type;
+            bool hasValue = false;
+            alignas(16) unsigned char value[sizeof(glm::mat4)]; // The bytes of the last value (valid if "hasValue" is true)
+        };
+        // The active uniforms found when the program was linked (by the hashes of their names)
+        std::unordered_map<uint64_t, Uniform> uniforms;
+
+        // Registers an active uniform (the elements of an array are also registered by their own names)
+        void addUniform(const std::string& name, GLint location, GLenum type, GLint size);
+
+        // Returns the uniform if it has to be sent (the program has it and the value differs from the last value sent to it).
+        // The new value is recorded as the last value.
+        template<typename T>
+        Uniform* change(UniformName name, const T& value) {
+            static_assert(sizeof(T) <= sizeof(Uniform::value), "The value is larger than the largest uniform type");
+            auto it = uniforms.find(name.hash);
+            if(it == uniforms.end()) return nullptr;
+            Uniform& uniform = it->second;
+            if(uniform.hasValue && std::memcmp(uniform.value, &value, sizeof(T)) == 0) return nullptr;
+            std::memcpy(uniform.value, &value, sizeof(T));
+            uniform.hasValue = true;
+            return &uniform;
+        }
 
     public:
         ShaderProgram(){
@@ -22,55 +74,88 @@ namespace our {
         }
         ~ShaderProgram(){
             //TODO: (Req 1) Delete a shader program
+            GLStateCache::forgetProgram(this->program);
             glDeleteProgram(this->program);
+            delete instancedVariant;
         }
 
-        bool attach(const std::string &filename, GLenum type) const;
+        // Compiles the shader file and attaches it to the program.
+        // "defines" (e.g. "#define INSTANCED\n") is inserted right after the "#version" line of the file.
+        bool attach(const std::string &filename, GLenum type, const std::string &defines = "") const;
 
-        bool link() const;
+        // Links the program then finds its active uniforms (their locations and types)
+        bool link();
 
         void use() { 
-            glUseProgram(program);
+            GLStateCache::useProgram(program);
         }
 
-        GLuint getUniformLocation(const std::string &name) {
+        // The variant of this program that draws many instances at once (see "Mesh::drawInstanced").
+        // The renderer only draws instances with programs that have this variant.
+        ShaderProgram* getInstancedVariant() const {
+            return instancedVariant;
+        }
+        // Gives the ownership of the variant to this program (and deletes its previous variant)
+        void setInstancedVariant(ShaderProgram* variant) {
+            delete instancedVariant;
+            instancedVariant = variant;
+        }
+
+        // Returns the name of the program object (it also identifies the shader when the draws are sorted)
+        GLuint getOpenGLName() const {
+            return program;
+        }
+
+        // Returns the location of the uniform with the given name (-1 if the program has no such active uniform).
+        // The locations are found once when the program is linked (see "link")
+        GLint getUniformLocation(UniformName name) const {
             //TODO: (Req 1) Return the location of the uniform with the given name
-            return glGetUniformLocation(this->program, name.c_str());
+            auto it = uniforms.find(name.hash);
+            return it == uniforms.end() ? -1 : it->second.location;
+        }
+
+        // Returns the type of the uniform with the given name (GL_NONE if the program has no such active uniform)
+        GLenum getUniformType(UniformName name) const {
+            auto it = uniforms.find(name.hash);
+            return it == uniforms.end() ? GL_NONE : it->second.type;
         }
 
-        void set(const std::string &uniform, GLfloat value) {
+        // The "set" functions skip the uniforms that the program does not have and the values that were already sent
+        // (the program keeps the values of its uniforms, so sending the same value again would not change anything).
+        // Like glUniform*, they must be called while the program is in use.
+        void set(UniformName uniform, GLfloat value) {
             //TODO: (Req 1) Send the given float value to the given uniform
-            glUniform1f(this->getUniformLocation(uniform), value);
+            if(Uniform* target = change(uniform, value)) glUniform1f(target->location, value);
         }
 
-        void set(const std::string &uniform, GLuint value) {
+        void set(UniformName uniform, GLuint value) {
             //TODO: (Req 1) Send the given unsigned integer value to the given uniform
-            glUniform1ui(this->getUniformLocation(uniform), value);
+            if(Uniform* target = change(uniform, value)) glUniform1ui(target->location, value);
         }
 
-        void set(const std::string &uniform, GLint value) {
+        void set(UniformName uniform, GLint value) {
             //TODO: (Req 1) Send the given integer value to the given uniform
-            glUniform1i(this->getUniformLocation(uniform), value);
+            if(Uniform* target = change(uniform, value)) glUniform1i(target->location, value);
         }
 
-        void set(const std::string &uniform, glm::vec2 value) {
+        void set(UniformName uniform, glm::vec2 value) {
             //TODO: (Req 1) Send the given 2D vector value to the given uniform
-            glUniform2fv(this->getUniformLocation(uniform),1 ,glm::value_ptr(value));
+            if(Uniform* target = change(uniform, value)) glUniform2fv(target->location, 1, glm::value_ptr(value));
         }
 
-        void set(const std::string &uniform, glm::vec3 value) {
+        void set(UniformName uniform, glm::vec3 value) {
             //TODO: (Req 1) Send the given 3D vector value to the given uniform
-            glUniform3fv(this->getUniformLocation(uniform), 1, glm::value_ptr(value));
+            if(Uniform* target = change(uniform, value)) glUniform3fv(target->location, 1, glm::value_ptr(value));
         }
 
-        void set(const std::string &uniform, glm::vec4 value) {
+        void set(UniformName uniform, glm::vec4 value) {
             //TODO: (Req 1) Send the given 4D vector value to the given uniform
-            glUniform4fv(this->getUniformLocation(uniform), 1, glm::value_ptr(value));
+            if(Uniform* target = change(uniform, value)) glUniform4fv(target->location, 1, glm::value_ptr(value));
         }
 
-        void set(const std::string &uniform, glm::mat4 matrix) {
+        void set(UniformName uniform, glm::mat4 matrix) {
             //TODO: (Req 1) Send the given matrix 4x4 value to the given uniform
-            glUniformMatrix4fv(this->getUniformLocation(uniform), 1, GL_FALSE, glm::value_ptr(matrix));
+            if(Uniform* target = change(uniform, matrix)) glUniformMatrix4fv(target->location, 1, GL_FALSE, glm::value_ptr(matrix));
         }
 
         //TODO: (Req 1) Delete the copy constructor and assignment operator.
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "shader.hpp"
+
+namespace our {
+
+    // The names of the uniforms set by the engine. Their hashes are computed at compile time,
+    // so setting them while drawing does not hash (or build) any string.
+    namespace uniforms {
+        constexpr UniformName TRANSFORM("transform");
+        constexpr UniformName TINT("tint");
+        constexpr UniformName ALPHA_THRESHOLD("alphaThreshold");
+        constexpr UniformName TEX("tex");
+
+        constexpr UniformName OBJECT_TO_WORLD("object_to_world");
+        constexpr UniformName OBJECT_TO_WORLD_INV_TRANSPOSE("object_to_world_inv_transpose");
+
+        constexpr UniformName MATERIAL_DIFFUSE("material.diffuse");
+        constexpr UniformName MATERIAL_SPECULAR("material.specular");
+        constexpr UniformName MATERIAL_AMBIENT("material.ambient");
+        constexpr UniformName MATERIAL_SHININESS("material.shininess");
+
+        // The buffer textures of the lit programs (see "texture_units")
+        constexpr UniformName LIGHTS("lights");
+        constexpr UniformName LIGHT_CLUSTERS("light_clusters");
+        constexpr UniformName LIGHT_INDICES("light_indices");
+
+        // The lighting pass of the deferred renderer reads the surfaces from the G-buffer (see "DeferredRenderer")
+        constexpr UniformName GBUFFER_DIFFUSE("gbuffer_diffuse");
+        constexpr UniformName GBUFFER_SPECULAR("gbuffer_specular");
+        constexpr UniformName GBUFFER_NORMAL("gbuffer_normal");
+        constexpr UniformName GBUFFER_DEPTH("gbuffer_depth");
+        constexpr UniformName INVERSE_VIEW_PROJECTION("inverse_view_projection");
+    }
+
+    // The uniform blocks shared by the programs. When a program is linked, each of these blocks it declares
+    // is bound to its fixed binding point, where the renderer keeps the buffer that backs it.
+    namespace uniform_blocks {
+        constexpr const char* FRAME_NAME = "Frame";
+        constexpr GLuint FRAME = 0; // The per-frame camera & light data (see "FrameData")
+    }
+
+    // The texture units of the buffer textures shared by the programs. When a program is linked, each of these samplers
+    // it declares is set to its fixed unit, where the renderer keeps the texture that backs it (the materials use the first units).
+    namespace texture_units {
+        constexpr GLuint LIGHTS = 13;         // The lights of the frame (see "LightData")
+        constexpr GLuint LIGHT_CLUSTERS = 14; // The range of each cluster in the light indices (see "LightClusters")
+        constexpr GLuint LIGHT_INDICES = 15;  // The indices of the lights of each cluster
+    }
+
+}
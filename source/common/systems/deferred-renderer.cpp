@@ -0,0 +1,145 @@
+#include "deferred-renderer.hpp"
+#include "../texture/texture-utils.hpp"
+#include "../shader/uniform-names.hpp"
+
+namespace our {
+
+    void DeferredRenderer::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
+        ForwardRenderer::initialize(windowSize, config);
+        // The lighting pass already shades each pixel once, so the lit objects are never drawn by the depth pre-pass
+        depthPrepass = false;
+
+        // The light is accumulated in a floating point target, so the sum of many lights is not clamped before it is shown
+        accumulationTarget = texture_utils::empty(GL_RGBA16F, windowSize);
+        diffuseTarget = texture_utils::empty(GL_RGBA16F, windowSize);
+        specularTarget = texture_utils::empty(GL_RGBA16F, windowSize);
+        normalTarget = texture_utils::empty(GL_RGBA16F, windowSize);
+        gbufferDepthTarget = texture_utils::empty(GL_DEPTH_COMPONENT24, windowSize);
+
+        const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+        Texture2D* colorTargets[] = { accumulationTarget, diffuseTarget, specularTarget, normalTarget };
+        // The G-buffer pass writes all the targets
+        glGenFramebuffers(1, &gbufferFrameBuffer);
+        GLStateCache::bindDrawFramebuffer(gbufferFrameBuffer);
+        for(int index = 0; index < 4; ++index)
+            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachments[index], GL_TEXTURE_2D, colorTargets[index]->getOpenGLName(), 0);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbufferDepthTarget->getOpenGLName(), 0);
+        glDrawBuffers(4, attachments);
+        // The lighting pass reads the depth, so its framebuffer only has the accumulated light
+        // (a texture that is read while it is attached to the framebuffer would give undefined results)
+        glGenFramebuffers(1, &lightingFrameBuffer);
+        GLStateCache::bindDrawFramebuffer(lightingFrameBuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulationTarget->getOpenGLName(), 0);
+        // The forward passes are depth tested against the lit objects
+        glGenFramebuffers(1, &forwardFrameBuffer);
+        GLStateCache::bindDrawFramebuffer(forwardFrameBuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulationTarget->getOpenGLName(), 0);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbufferDepthTarget->getOpenGLName(), 0);
+        GLStateCache::bindDrawFramebuffer(0);
+
+        // The G-buffer program reads the same vertices & materials as the lit programs
+        gbufferProgram = new ShaderProgram();
+        gbufferProgram->attach("assets/shaders/light.vert", GL_VERTEX_SHADER);
+        gbufferProgram->attach("assets/shaders/deferred/gbuffer.frag", GL_FRAGMENT_SHADER);
+        gbufferProgram->link();
+        ShaderProgram* instancedVariant = new ShaderProgram();
+        instancedVariant->attach("assets/shaders/light.vert", GL_VERTEX_SHADER, "#define INSTANCED\n");
+        instancedVariant->attach("assets/shaders/deferred/gbuffer.frag", GL_FRAGMENT_SHADER, "#define INSTANCED\n");
+        instancedVariant->link();
+        gbufferProgram->setInstancedVariant(instancedVariant);
+
+        lightingProgram = new ShaderProgram();
+        lightingProgram->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
+        lightingProgram->attach("assets/shaders/deferred/lighting.frag", GL_FRAGMENT_SHADER);
+        lightingProgram->link();
+        // The G-buffer is always bound to the first units while the lighting pass draws
+        lightingProgram->use();
+        lightingProgram->set(uniforms::GBUFFER_DIFFUSE, 0);
+        lightingProgram->set(uniforms::GBUFFER_SPECULAR, 1);
+        lightingProgram->set(uniforms::GBUFFER_NORMAL, 2);
+        lightingProgram->set(uniforms::GBUFFER_DEPTH, 3);
+        glGenVertexArrays(1, &lightingVertexArray);
+        // The lights are added to the ambient light, and the fullscreen triangle neither tests nor writes the depth
+        lightingPipelineState = PipelineState();
+        lightingPipelineState.blending.enabled = true;
+        lightingPipelineState.blending.sourceFactor = GL_ONE;
+        lightingPipelineState.blending.destinationFactor = GL_ONE;
+        lightingPipelineState.depthMask = false;
+    }
+
+    void DeferredRenderer::destroy(){
+        ForwardRenderer::destroy();
+        for(GLuint* frameBuffer : { &gbufferFrameBuffer, &lightingFrameBuffer, &forwardFrameBuffer }){
+            GLStateCache::forgetFramebuffer(*frameBuffer);
+            glDeleteFramebuffers(1, frameBuffer);
+            *frameBuffer = 0;
+        }
+        GLStateCache::forgetVertexArray(lightingVertexArray);
+        glDeleteVertexArrays(1, &lightingVertexArray);
+        lightingVertexArray = 0;
+        delete accumulationTarget;
+        delete diffuseTarget;
+        delete specularTarget;
+        delete normalTarget;
+        delete gbufferDepthTarget;
+        accumulationTarget = diffuseTarget = specularTarget = normalTarget = gbufferDepthTarget = nullptr;
+        delete gbufferProgram;
+        delete lightingProgram;
+        gbufferProgram = lightingProgram = nullptr;
+        litCommands.clear();
+        litBatches.clear();
+    }
+
+    void DeferredRenderer::buildPassBatches(){
+        // The G-buffer program reads the textured lit materials
+        moveCommands(opaqueCommands, litCommands, [](const Material* material){
+            return dynamic_cast<const LitTexturedMaterial*>(material) != nullptr;
+        });
+
+        buildBatches(litCommands, litBatches, gbufferProgram);
+        ForwardRenderer::buildPassBatches();
+    }
+
+    void DeferredRenderer::drawPasses(CameraComponent* camera, const glm::mat4& VP){
+        glViewport(0, 0, windowSize.x, windowSize.y);
+        GLStateCache::colorMask(true, true, true, true);
+        GLStateCache::depthMask(true);
+
+        // The G-buffer pass: the lit objects write their surfaces (the accumulated light starts with their ambient light)
+        GLStateCache::bindDrawFramebuffer(gbufferFrameBuffer);
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClearDepth(1);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawBatches(litCommands, litBatches, gbufferProgram);
+
+        // The lighting pass: each pixel covered by a lit object adds the lights of its cluster
+        GLStateCache::bindDrawFramebuffer(lightingFrameBuffer);
+        lightingPipelineState.setup();
+        lightingProgram->use();
+        lightingProgram->set(uniforms::INVERSE_VIEW_PROJECTION, glm::inverse(VP));
+        Texture2D* gbufferTargets[] = { diffuseTarget, specularTarget, normalTarget, gbufferDepthTarget };
+        for(GLuint unit = 0; unit < 4; ++unit){
+            GLStateCache::activeTexture(GL_TEXTURE0 + unit);
+            gbufferTargets[unit]->bind();
+            // The G-buffer is read with texelFetch, so no sampler is needed
+            Sampler::unbind(unit);
+        }
+        GLStateCache::bindVertexArray(lightingVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        ++stats.drawCalls;
+
+        // The forward passes draw the rest of the scene on the lit objects (with their depth)
+        GLStateCache::bindDrawFramebuffer(forwardFrameBuffer);
+        drawBatches(opaqueCommands, opaqueBatches);
+        drawSky(camera, VP);
+        drawBatches(transparentCommands, transparentBatches);
+
+        // The result is copied to the postprocessing target if there is one (or to the window otherwise)
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, forwardFrameBuffer);
+        GLStateCache::bindDrawFramebuffer(postprocessMaterial ? postprocessFrameBuffer : 0);
+        glBlitFramebuffer(0, 0, windowSize.x, windowSize.y, 0, 0, windowSize.x, windowSize.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        drawPostprocess();
+    }
+
+}
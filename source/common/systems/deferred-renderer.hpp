@@ -0,0 +1,40 @@
+#pragma once
+
+#include "forward-renderer.hpp"
+
+namespace our
+{
+
+    // A deferred renderer draws the lit objects in two steps: the G-buffer pass writes their surfaces (colors & normals)
+    // to a set of textures, then the lighting pass evaluates the lights once per pixel over the whole screen.
+    // So the lights are never evaluated for the hidden fragments, which a forward renderer shades before they are covered.
+    // The lights are found through the same light clusters as the forward renderer (the lighting pass reads each pixel's cluster),
+    // and the extraction, culling, sorting & batching of the commands are those of the forward renderer too.
+    // The objects whose material is not lit, the sky & the transparent objects are then drawn forward on top of the lit result.
+    class DeferredRenderer : public ForwardRenderer {
+        // The G-buffer: the accumulated light, the diffuse & specular colors (with the shininess in alpha), the normals & the depth.
+        // The same textures are attached to 3 framebuffers: the G-buffer pass writes all of them, the lighting pass only adds
+        // to the accumulated light (without the depth, so it can read it), and the forward passes draw on the accumulated light.
+        GLuint gbufferFrameBuffer = 0, lightingFrameBuffer = 0, forwardFrameBuffer = 0;
+        Texture2D *accumulationTarget = nullptr, *diffuseTarget = nullptr, *specularTarget = nullptr, *normalTarget = nullptr;
+        Texture2D *gbufferDepthTarget = nullptr;
+        // Draws the lit commands to the G-buffer instead of the shaders of their materials (it has an instanced variant)
+        ShaderProgram* gbufferProgram = nullptr;
+        // Adds the lights of each pixel to the accumulated light (by drawing a fullscreen triangle)
+        ShaderProgram* lightingProgram = nullptr;
+        PipelineState lightingPipelineState;
+        GLuint lightingVertexArray = 0;
+        // The opaque commands whose material is lit are moved here (in their sorted order) and drawn to the G-buffer
+        std::vector<RenderCommand> litCommands;
+        std::vector<DrawBatch> litBatches;
+    public:
+        void initialize(glm::ivec2 windowSize, const nlohmann::json& config) override;
+        void destroy() override;
+    protected:
+        // Moves the lit commands out of the opaque commands, then batches them to be drawn by the G-buffer program
+        void buildPassBatches() override;
+        // Draws the G-buffer, the lights, then the forward passes, then copies the result to the window (or the postprocessing)
+        void drawPasses(CameraComponent* camera, const glm::mat4& VP) override;
+    };
+
+}
@@ -1,12 +1,65 @@
 #include "forward-renderer.hpp"
 #include "../mesh/mesh-utils.hpp"
 #include "../texture/texture-utils.hpp"
+#include "../shader/uniform-names.hpp"
+#include "../deserialize-utils.hpp"
+
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
 
 namespace our {
 
     void ForwardRenderer::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
         // First, we store the window size for later use
         this->windowSize = windowSize;
+        // The lights will be uploaded to every program in the first frame
+        renderVersion = lightsVersion = 0;
+        // The lights will be filled in the first frame
+        filledLightsVersion = UINT32_MAX;
+        frameData = FrameData();
+        // Instancing can be disabled to compare against one draw call per mesh renderer
+        instancingEnabled = config.value("instancing", true);
+        // The multi-draw calls draw the instances of many meshes, so they need instancing too
+        multiDrawEnabled = instancingEnabled && config.value("multiDraw", true) && GeometryArena::isMultiDrawIndirectSupported();
+        // The parallel extraction can be disabled to compare against the single threaded extraction
+        parallelExtraction = config.value("parallelExtraction", true);
+        // The regions start large enough for the frame data & a few thousand instances (they grow if a frame needs more)
+        streamBuffer = new StreamBuffer(GL_ARRAY_BUFFER, config.value("streamBufferSize", 256 * 1024));
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+        glGenBuffers(1, &frameUniformBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+        frameDataFallbacks = 0;
+        // The lights are assigned to a grid of clusters (tiles along x & y, then slices along the depth).
+        // The slices are spread over the depths where most of the lit fragments are (the first & last slices take the rest).
+        nlohmann::json clusterConfig = config.value("lightClusters", nlohmann::json::object());
+        lightClusters = new LightClusters(clusterConfig.value("size", glm::ivec3(16, 9, 24)),
+                                          clusterConfig.value("near", 0.5f), clusterConfig.value("far", 100.0f));
+        lightClusters->setMaxIndexCount(TextureBuffer::getMaxTexelCount());
+        lightCutoff = clusterConfig.value("cutoff", 0.02f);
+        lightsTexture = new TextureBuffer(GL_RGBA32F, texture_units::LIGHTS);
+        lightClustersTexture = new TextureBuffer(GL_RG32UI, texture_units::LIGHT_CLUSTERS);
+        lightIndicesTexture = new TextureBuffer(GL_R32UI, texture_units::LIGHT_INDICES);
+        // The depth pre-pass is enabled per scene (it pays off when the lit objects hide each other a lot)
+        depthPrepass = config.value("depthPrepass", false);
+        if(depthPrepass){
+            depthProgram = new ShaderProgram();
+            depthProgram->attach("assets/shaders/depth.vert", GL_VERTEX_SHADER);
+            depthProgram->attach("assets/shaders/depth.frag", GL_FRAGMENT_SHADER);
+            depthProgram->link();
+            ShaderProgram* instancedVariant = new ShaderProgram();
+            instancedVariant->attach("assets/shaders/depth.vert", GL_VERTEX_SHADER, "#define INSTANCED\n");
+            instancedVariant->attach("assets/shaders/depth.frag", GL_FRAGMENT_SHADER, "#define INSTANCED\n");
+            instancedVariant->link();
+            depthProgram->setInstancedVariant(instancedVariant);
+            glGenQueries(PREPASS_QUERY_FRAMES * 2, &prepassQueries[0][0]);
+            std::fill(std::begin(prepassQueriesPending), std::end(prepassQueriesPending), false);
+            prepassQueryFrame = 0;
+            prepassSamples = shadedSamples = 0;
+        }
 
         // Then we check if there is a sky texture in the configuration
         if(config.contains("sky")){
@@ -58,7 +111,7 @@ namespace our {
             //TODO: (Req 11) Create a framebuffer
             GLuint framebuffer;
             glGenFramebuffers(1, &framebuffer);
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+            GLStateCache::bindDrawFramebuffer(framebuffer);
             postprocessFrameBuffer = framebuffer; // save the framebuffer in the member variable for the ForwardRenderer class
 
             //TODO: (Req 11) Create a color and a depth texture and attach them to the framebuffer
@@ -71,7 +124,7 @@ namespace our {
             glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
 
             //TODO: (Req 11) Unbind the framebuffer just to be safe
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            GLStateCache::bindDrawFramebuffer(0);
 
             // Create a vertex array to use for drawing the texture
             glGenVertexArrays(1, &postProcessVertexArray);
@@ -101,6 +154,24 @@ namespace our {
     }
 
     void ForwardRenderer::destroy(){
+        lightSources.clear();
+        previousLightSources.clear();
+        delete streamBuffer;
+        streamBuffer = nullptr;
+        glDeleteBuffers(1, &frameUniformBuffer);
+        frameUniformBuffer = 0;
+        delete lightClusters;
+        delete lightsTexture;
+        delete lightClustersTexture;
+        delete lightIndicesTexture;
+        lightClusters = nullptr;
+        lightsTexture = lightClustersTexture = lightIndicesTexture = nullptr;
+        if(depthProgram){
+            delete depthProgram;
+            depthProgram = nullptr;
+            glDeleteQueries(PREPASS_QUERY_FRAMES * 2, &prepassQueries[0][0]);
+        }
+        prepassCommands.clear();
         // Delete all objects related to the sky
         if(skyMaterial){
             delete skySphere;
@@ -111,7 +182,9 @@ namespace our {
         }
         // Delete all objects related to post processing
         if(postprocessMaterial){
+            GLStateCache::forgetFramebuffer(postprocessFrameBuffer);
             glDeleteFramebuffers(1, &postprocessFrameBuffer);
+            GLStateCache::forgetVertexArray(postProcessVertexArray);
             glDeleteVertexArrays(1, &postProcessVertexArray);
             delete colorTarget;
             delete depthTarget;
@@ -121,101 +194,481 @@ namespace our {
         }
     }
 
-    void ForwardRenderer::addLight(our::ShaderProgram* program)
-    {
-        int light_index = 0;
-        
-        std::string prefix = "lights[" + std::to_string(light_index) + "].";
-        for(auto& light:lightSources)
-        {
-            if(light->enabled){
-                program->set(prefix + "diffuse", light->diffuse);
-                program->set(prefix + "specular", light->specular);
-                program->set(prefix + "ambient", light->ambient);
-                program->set(prefix + "type", static_cast<int>(light->lightType));
-                program->set(prefix + "color", (light->color));
-                program->set(prefix + "direction", glm::normalize(glm::vec3((light->getOwner()->getLocalToWorldMatrix() * glm::vec4(light->direction, 0)))));
-                switch (light->lightType) {
-                    case LightType::DIRECTIONAL:
-                        break;
-                    case LightType::POINT:
-                        
-                        program->set(prefix + "position", light->position);
-                        program->set(prefix + "attenuation_constant", light->attenuation.constant);
-                        program->set(prefix + "attenuation_linear", light->attenuation.linear);
-                        program->set(prefix + "attenuation_quadratic", light->attenuation.quadratic);
-                        break;
-                    case LightType::SPOT:
-                        program->set(prefix + "position", light->position);
-                        program->set(prefix + "attenuation_constant", light->attenuation.constant);
-                        program->set(prefix + "attenuation_linear", light->attenuation.linear);
-                        program->set(prefix + "attenuation_quadratic", light->attenuation.quadratic);
-                        program->set(prefix + "inner_angle", light->spot_angle.inner);
-                        program->set(prefix + "outer_angle", light->spot_angle.outer);
-                        break;
+    // Fills the data of a light as the shaders read it. Returns its range: the distance at which its intensity falls below
+    // the cutoff (0 if it reaches every fragment, or a negative value if it never reaches the cutoff so it can be skipped).
+    static float makeLightData(const LightComponent* light, float cutoff, LightData& data){
+        data.type = static_cast<float>(light->lightType);
+        data.diffuse = light->color * light->diffuse;
+        data.specular = light->color * light->specular;
+        data.direction = glm::normalize(glm::vec3((light->getOwner()->getLocalToWorldMatrix() * glm::vec4(light->direction, 0))));
+        // The position & attenuation are only read for point and spot lights, and the angles for spot lights
+        data.position = light->position;
+        data.attenuationConstant = light->attenuation.constant;
+        data.attenuationLinear = light->attenuation.linear;
+        data.attenuationQuadratic = light->attenuation.quadratic;
+        data.innerAngle = light->spot_angle.inner;
+        data.outerAngle = light->spot_angle.outer;
+        data.radius = data.padding = 0;
+        if(light->lightType == LightType::DIRECTIONAL) return 0;
+
+        // The attenuated intensity reaches the cutoff at the distance d where: constant + linear * d + quadratic * d^2 = intensity / cutoff
+        float intensity = std::max({data.diffuse.r, data.diffuse.g, data.diffuse.b, data.specular.r, data.specular.g, data.specular.b});
+        if(intensity <= 0.0f) return -1;
+        float target = intensity / cutoff, range = INFINITY;
+        float constant = data.attenuationConstant, linear = data.attenuationLinear, quadratic = data.attenuationQuadratic;
+        if(quadratic > 0.0f)
+            range = (-linear + std::sqrt(std::max(0.0f, linear * linear - 4.0f * quadratic * (constant - target)))) / (2.0f * quadratic);
+        else if(linear > 0.0f)
+            range = (target - constant) / linear;
+        // The range given to the light can only make it shorter
+        if(light->range > 0.0f) range = std::min(range, light->range);
+        // A light that does not fade reaches every fragment
+        if(std::isinf(range)) return 0;
+        if(range <= 0.0f) return -1;
+        data.radius = range;
+        return range;
+    }
+
+    void ForwardRenderer::fillLights(){
+        lights.clear();
+        lightSpheres.clear();
+        frameData.ambientLight = glm::vec3(0.0f);
+        // The ambient colors do not depend on the distance, so they are summed once here instead of being added by every light
+        for(auto& light : lightSources)
+            if(light->enabled) frameData.ambientLight += light->ambient;
+        // The lights that reach every fragment are listed first, then the lights that are assigned to the clusters
+        const size_t maxLightCount = TextureBuffer::getMaxTexelCount() / (sizeof(LightData) / sizeof(glm::vec4));
+        for(bool clustered : {false, true}){
+            for(auto& light : lightSources){
+                if(!light->enabled || lights.size() == maxLightCount) continue;
+                LightData data;
+                float range = makeLightData(light, lightCutoff, data);
+                if(range < 0.0f || (range > 0.0f) != clustered) continue;
+                lights.push_back(data);
+                if(clustered) lightSpheres.emplace_back(data.position, range);
+            }
+        }
+        frameData.lightCount = (int32_t)lights.size();
+        frameData.globalLightCount = (int32_t)(lights.size() - lightSpheres.size());
+    }
+
+    void ForwardRenderer::uploadFrameData(){
+        // Each frame writes the whole block to its own region of the stream buffer
+        size_t offset;
+        void* destination = streamBuffer->allocate(sizeof(FrameData), uniformBufferAlignment, offset);
+        if(destination == nullptr){
+            // The region is full (it grows at the next frame), so the block goes through its own buffer, whose storage is orphaned first
+            glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frameData);
+            glBindBufferRange(GL_UNIFORM_BUFFER, uniform_blocks::FRAME, frameUniformBuffer, 0, sizeof(FrameData));
+            ++frameDataFallbacks;
+            return;
+        }
+        std::memcpy(destination, &frameData, sizeof(FrameData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, uniform_blocks::FRAME, streamBuffer->getName(), offset, sizeof(FrameData));
+    }
+
+    void ForwardRenderer::assignLights(CameraComponent* camera, const glm::mat4& projection){
+        if(filledLightsVersion != lightsVersion){
+            fillLights();
+            filledLightsVersion = lightsVersion;
+        }
+        // The clusters follow the camera, so the lights are assigned to them every frame
+        lightClusters->build(camera->getViewMatrix(), projection, camera->near, camera->far,
+                             lightSpheres.data(), lightSpheres.size(), (uint32_t)frameData.globalLightCount);
+        const glm::ivec3& clusterCount = lightClusters->getCounts();
+        frameData.clusterCount = clusterCount;
+        frameData.clusterDepthScale = lightClusters->getDepthScale();
+        frameData.clusterDepthBias = lightClusters->getDepthBias();
+        frameData.clusterTileScale = glm::vec2(clusterCount.x / (float)windowSize.x, clusterCount.y / (float)windowSize.y);
+    }
+
+    void ForwardRenderer::uploadLights(){
+        const std::vector<LightClusters::Range>& ranges = lightClusters->getRanges();
+        const std::vector<uint32_t>& indices = lightClusters->getIndices();
+        lightsTexture->upload(streamBuffer, lights.data(), lights.size() * sizeof(LightData));
+        lightClustersTexture->upload(streamBuffer, ranges.data(), ranges.size() * sizeof(LightClusters::Range));
+        lightIndicesTexture->upload(streamBuffer, indices.data(), indices.size() * sizeof(uint32_t));
+        stats.globalLights = frameData.globalLightCount;
+        stats.clusteredLights = lightSpheres.size();
+        stats.clusterLightIndices = indices.size();
+    }
+
+    void ForwardRenderer::uploadInstances(){
+        if(instances.empty()) return;
+        size_t size = instances.size() * sizeof(InstanceData);
+        void* destination = streamBuffer->allocate(size, alignof(InstanceData), instancesOffset);
+        void* commandsDestination = nullptr;
+        if(destination != nullptr && !drawCommands.empty())
+            commandsDestination = streamBuffer->allocate(drawCommands.size() * sizeof(GeometryArena::DrawCommand), sizeof(GLuint), drawCommandsOffset);
+        if(destination == nullptr || (!drawCommands.empty() && commandsDestination == nullptr)){
+            // The region is too small for this frame (it grows at the next frame), so the batches are drawn one command at a time
+            for(std::vector<DrawBatch>* batches : builtBatches)
+                for(DrawBatch& batch : *batches) batch.instanced = batch.multiDraw = false;
+            return;
+        }
+        std::memcpy(destination, instances.data(), size);
+        if(commandsDestination)
+            std::memcpy(commandsDestination, drawCommands.data(), drawCommands.size() * sizeof(GeometryArena::DrawCommand));
+    }
+
+    void ForwardRenderer::buildBatches(const std::vector<RenderCommand>& commands, std::vector<DrawBatch>& batches, ShaderProgram* program){
+        batches.clear();
+        builtBatches.push_back(&batches);
+        // The commands are sorted, so those that share a mesh & a material are next to each other
+        // (the transparent ones stay in their back to front order since only neighbors are grouped)
+        for(size_t first = 0; first < commands.size();){
+            const RenderCommand& command = commands[first];
+            ShaderProgram* instancedVariant = (program ? program : command.material->shader)->getInstancedVariant();
+            GeometryArena* arena = command.mesh->getArena();
+            DrawBatch batch;
+            batch.first = first;
+            if(multiDrawEnabled && arena != nullptr && instancedVariant != nullptr){
+                // The neighbors that share the material are drawn by a single call if their meshes are in the same arena.
+                // Each run of the same mesh becomes a draw command whose instances start at its base instance.
+                batch.instanced = batch.multiDraw = true;
+                batch.firstInstance = instances.size();
+                batch.firstDrawCommand = drawCommands.size();
+                size_t end = first;
+                while(end < commands.size() && commands[end].material == command.material && commands[end].mesh->getArena() == arena){
+                    Mesh* mesh = commands[end].mesh;
+                    size_t runStart = end;
+                    for(; end < commands.size() && commands[end].material == command.material && commands[end].mesh == mesh; ++end)
+                        instances.push_back({commands[end].localToWorld, commands[end].normalMatrix});
+                    drawCommands.push_back(mesh->getDrawCommand((GLuint)(end - runStart), (GLuint)(batch.firstInstance + runStart - first)));
                 }
-                light_index++;
+                batch.count = end - first;
+                batch.drawCommandCount = drawCommands.size() - batch.firstDrawCommand;
+                batches.push_back(batch);
+                first = end;
+                continue;
+            }
+            size_t end = first + 1;
+            while(end < commands.size() && commands[end].mesh == command.mesh && commands[end].material == command.material) ++end;
+            batch.count = end - first;
+            // Instancing needs the instanced variant of the program (the other programs read the matrices from uniforms)
+            batch.instanced = instancingEnabled && batch.count >= 2 && instancedVariant != nullptr;
+            if(batch.instanced){
+                batch.firstInstance = instances.size();
+                for(size_t index = first; index < end; ++index)
+                    instances.push_back({commands[index].localToWorld, commands[index].normalMatrix});
+            }
+            batches.push_back(batch);
+            first = end;
+        }
+    }
+
+    void ForwardRenderer::setupPass(const Material* material, ShaderProgram* program, PassMode mode){
+        if(mode == PassMode::DEPTH_ONLY){
+            // The depth program reads none of the material's uniforms, so only the states that decide which depths are written are kept
+            PipelineState state = material->pipelineState;
+            state.colorMask = glm::bvec4(false);
+            state.blending.enabled = false;
+            state.setup();
+            program->use();
+            return;
+        }
+        material->setup(program);
+        if(mode == PassMode::DEPTH_EQUAL){
+            GLStateCache::depthFunc(GL_EQUAL);
+            GLStateCache::depthMask(false);
+        }
+    }
+
+    void ForwardRenderer::drawBatches(const std::vector<RenderCommand>& commands, const std::vector<DrawBatch>& batches, ShaderProgram* program,
+                                      PassMode mode){
+        // The depth only draws read the packed positions instead of the whole vertices
+        VertexStream stream = mode == PassMode::DEPTH_ONLY ? VertexStream::POSITION : VertexStream::ALL;
+        for(const DrawBatch& batch : batches){
+            const RenderCommand& first = commands[batch.first];
+            ShaderProgram* shader = program ? program : first.material->shader;
+            if(batch.multiDraw){
+                // The instance attributes point at the start of "instances" and each draw command selects its own by its base instance
+                GeometryArena* arena = first.mesh->getArena();
+                setupPass(first.material, shader->getInstancedVariant(), mode);
+                arena->bindInstances(streamBuffer->getName(), instancesOffset, stream);
+                arena->multiDrawIndirect(streamBuffer->getName(), drawCommandsOffset + batch.firstDrawCommand * sizeof(GeometryArena::DrawCommand),
+                                         (GLsizei)batch.drawCommandCount, stream);
+                ++stats.drawCalls;
+                continue;
+            }
+            if(batch.instanced){
+                // The instanced programs read the matrices of each instance from the instance buffer
+                // (and the view projection matrix from the frame uniform buffer)
+                setupPass(first.material, shader->getInstancedVariant(), mode);
+                first.mesh->drawInstanced(streamBuffer->getName(), instancesOffset + batch.firstInstance * sizeof(InstanceData), (GLsizei)batch.count, stream);
+                ++stats.drawCalls;
+                continue;
+            }
+            for(size_t index = batch.first; index < batch.first + batch.count; ++index){
+                const RenderCommand& command = commands[index];
+                // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
+                // (the lit programs read the object to world matrices instead and the other programs skip them)
+                // (the batch's program is the same for all its commands since they share their material)
+                setupPass(command.material, shader, mode);
+                shader->set(uniforms::OBJECT_TO_WORLD, command.localToWorld);
+                shader->set(uniforms::OBJECT_TO_WORLD_INV_TRANSPOSE, command.normalMatrix);
+                shader->set(uniforms::TRANSFORM, command.localToClip);
+                command.mesh->draw(stream);
+                ++stats.drawCalls;
+            }
+        }
+    }
+
+    size_t ForwardRenderer::cullCommands(std::vector<RenderCommand>& commands, const glm::vec4 (&frustumPlanes)[6]){
+        if(commands.empty()) return 0;
+        // The bounding spheres of all the commands are tested at once by the transform kernel
+        computeCullingMargins(frustumPlanes, commands.size(), sizeof(RenderCommand),
+                              &commands[0].localToWorld, &commands[0].boundingSphere, &commands[0].cullingMargin);
+        size_t count = commands.size();
+        commands.erase(std::remove_if(commands.begin(), commands.end(), [](const RenderCommand& command){
+            return command.cullingMargin < 0.0f;
+        }), commands.end());
+        return count - commands.size();
+    }
+
+    uint64_t ForwardRenderer::getStateKey(const Material* material){
+        std::lock_guard<std::mutex> lock(materialStateKeysMutex);
+        auto it = materialStateKeys.find(material);
+        if(it != materialStateKeys.end()) return it->second;
+        uint64_t stateKey = render_sort::makeStateKey(material->pipelineState.getId(), material->shader->getOpenGLName(), material->id);
+        materialStateKeys.emplace(material, stateKey);
+        return stateKey;
+    }
+
+    void ForwardRenderer::prepareCommands(std::vector<RenderCommand>& commands, uint64_t pass, const glm::mat4& VP, const glm::vec4 (&frustumPlanes)[6],
+                                          const glm::vec3& cameraPosition, const glm::vec3& cameraForward, std::unordered_map<const Material*, uint64_t>& stateKeys){
+        // Both extractions find the commands through the bounds hierarchy, whose boxes are axis aligned (so they may touch the frustum
+        // while the object does not). The bounding spheres tighten that result before the matrices of the commands are computed.
+        cullCommands(commands, frustumPlanes);
+        if(commands.empty()) return;
+        // The model-view-projection and normal matrices of all the commands are computed in batches by the transform kernel
+        // instead of multiplying and inverting the matrices one by one while drawing
+        computeDrawMatrices(VP, commands.size(), sizeof(RenderCommand),
+                            &commands[0].localToWorld, &commands[0].localToClip, &commands[0].normalMatrix);
+        for(RenderCommand& command : commands){
+            float depth = glm::dot(command.center - cameraPosition, cameraForward);
+            auto it = stateKeys.find(command.material);
+            if(it == stateKeys.end()) it = stateKeys.emplace(command.material, getStateKey(command.material)).first;
+            command.sortKey = pass == render_sort::TRANSPARENT_PASS ?
+                render_sort::makeTransparentKey(it->second, command.mesh->id, depth) :
+                render_sort::makeOpaqueKey(it->second, command.mesh->id, depth);
+        }
+    }
+
+    void ForwardRenderer::sortCommands(std::vector<RenderCommand>& commands){
+        if(commands.size() < 2) return;
+        sortItems.clear();
+        for(uint32_t index = 0; index < commands.size(); ++index)
+            sortItems.push_back({commands[index].sortKey, index});
+        radixSort(sortItems, sortScratch);
+        // The commands are large, so they are moved once to their sorted positions instead of being swapped while sorting
+        sortedCommands.clear();
+        for(const SortItem& item : sortItems) sortedCommands.push_back(commands[item.index]);
+        std::swap(commands, sortedCommands);
+    }
+
+    // Fills a command from a mesh renderer (its matrices & its sort key are computed by "prepareCommands").
+    // It may run on many threads at once, so it reads the matrix computed by "World::updateTransforms" at the start of "render"
+    // instead of recomputing it (which would write to the entity).
+    static void makeCommand(RenderCommand& command, Entity* entity, const MeshRendererComponent* meshRenderer){
+        assert(entity->isLocalToWorldMatrixCurrent() && "The transforms must be updated before the commands are extracted");
+        command.localToWorld = entity->getCachedLocalToWorldMatrix();
+        command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
+        command.mesh = meshRenderer->mesh;
+        command.boundingSphere = command.mesh->getBoundingSphere();
+        command.material = meshRenderer->material;
+    }
 
+    void ForwardRenderer::extractCommands(World* world, const glm::mat4& VP, const glm::vec4 (&frustumPlanes)[6],
+                                          const glm::vec3& cameraPosition, const glm::vec3& cameraForward){
+        // Only the mesh renderers whose bounds are inside the camera frustum are turned into commands.
+        // The world's bounds hierarchy skips the subtrees outside the frustum, so the culling cost grows with what can be seen.
+        world->getBoundsHierarchy().visitFrustum(frustumPlanes, [&](Entity* entity){
+            MeshRendererComponent* meshRenderer = entity->getComponent<MeshRendererComponent>();
+            // We construct a command from it
+            RenderCommand command;
+            makeCommand(command, entity, meshRenderer);
+            // if it is transparent, we add it to the transparent commands list
+            if(command.material->transparent){
+                transparentCommands.push_back(command);
+            } else {
+            // Otherwise, we add it to the opaque command list
+                opaqueCommands.push_back(command);
             }
+        });
+        // The state keys are cached in the first chunk (the single threaded extraction is a single chunk)
+        if(extractionChunks.empty()) extractionChunks.resize(1);
+        std::unordered_map<const Material*, uint64_t>& stateKeys = extractionChunks[0].stateKeys;
+        stateKeys.clear();
+        prepareCommands(opaqueCommands, render_sort::OPAQUE_PASS, VP, frustumPlanes, cameraPosition, cameraForward, stateKeys);
+        prepareCommands(transparentCommands, render_sort::TRANSPARENT_PASS, VP, frustumPlanes, cameraPosition, cameraForward, stateKeys);
+    }
 
+    void ForwardRenderer::extractCommandsParallel(World* world, WorkerPool* pool, const glm::mat4& VP, const glm::vec4 (&frustumPlanes)[6],
+                                                  const glm::vec3& cameraPosition, const glm::vec3& cameraForward){
+        // The hierarchy skips the subtrees outside the frustum, so only the entities that may be visible are split into chunks
+        // (walking it is cheap next to building the commands, so it stays on the calling thread)
+        visibleEntities.clear();
+        world->getBoundsHierarchy().queryFrustum(frustumPlanes, visibleEntities);
+        const size_t count = visibleEntities.size();
+        // A few chunks per thread balance the load (some chunks may cull everything while others keep everything)
+        // and each chunk is large enough to be worth its own lists
+        constexpr size_t MIN_CHUNK_SIZE = 1024;
+        size_t chunkCount = std::min((count + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE, pool->getThreadCount() * 4);
+        if(chunkCount == 0) return;
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        if(extractionChunks.size() < chunkCount) extractionChunks.resize(chunkCount);
+
+        // Each chunk builds, culls & prepares the commands of its mesh renderers in its own lists
+        pool->parallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk){
+            for(size_t chunkIndex = firstChunk; chunkIndex < lastChunk; ++chunkIndex){
+                ExtractionChunk& chunk = extractionChunks[chunkIndex];
+                chunk.opaqueCommands.clear();
+                chunk.transparentCommands.clear();
+                chunk.stateKeys.clear();
+                size_t end = std::min(count, (chunkIndex + 1) * chunkSize);
+                for(size_t index = chunkIndex * chunkSize; index < end; ++index){
+                    Entity* entity = visibleEntities[index];
+                    RenderCommand command;
+                    makeCommand(command, entity, entity->getComponent<MeshRendererComponent>());
+                    if(command.material->transparent) chunk.transparentCommands.push_back(command);
+                    else chunk.opaqueCommands.push_back(command);
+                }
+                prepareCommands(chunk.opaqueCommands, render_sort::OPAQUE_PASS, VP, frustumPlanes, cameraPosition, cameraForward, chunk.stateKeys);
+                prepareCommands(chunk.transparentCommands, render_sort::TRANSPARENT_PASS, VP, frustumPlanes, cameraPosition, cameraForward, chunk.stateKeys);
+            }
+        });
 
+        // Then each chunk copies its commands to its own range of the merged lists
+        size_t opaqueCount = 0, transparentCount = 0;
+        for(size_t chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex){
+            ExtractionChunk& chunk = extractionChunks[chunkIndex];
+            chunk.opaqueOffset = opaqueCount;
+            chunk.transparentOffset = transparentCount;
+            opaqueCount += chunk.opaqueCommands.size();
+            transparentCount += chunk.transparentCommands.size();
         }
-        program->set("light_count",light_index);
+        opaqueCommands.resize(opaqueCount);
+        transparentCommands.resize(transparentCount);
+        pool->parallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk){
+            for(size_t chunkIndex = firstChunk; chunkIndex < lastChunk; ++chunkIndex){
+                const ExtractionChunk& chunk = extractionChunks[chunkIndex];
+                std::copy(chunk.opaqueCommands.begin(), chunk.opaqueCommands.end(), opaqueCommands.begin() + chunk.opaqueOffset);
+                std::copy(chunk.transparentCommands.begin(), chunk.transparentCommands.end(), transparentCommands.begin() + chunk.transparentOffset);
+            }
+        });
     }
 
-    void ForwardRenderer::render(World* world){
+    void ForwardRenderer::render(World* world, WorkerPool* pool){
+        // The changes made after the last frame have a greater version than "since" (including those found by "updateTransforms" below)
+        uint32_t since = renderVersion;
+        renderVersion = world->advanceChangeVersion();
+        // The cached local to world matrices are brought up to date once, so the rest of the frame only reads them
+        world->updateTransforms();
+        stats = RenderStats();
         // First of all, we search for a camera and for all the mesh renderers
+        std::swap(previousLightSources, lightSources);
         lightSources.clear();
+        bool lightsChanged = false;
         CameraComponent* camera = nullptr;
         opaqueCommands.clear();
         transparentCommands.clear();
-        for(auto entity : world->getEntities()){
-            // If we hadn't found a camera yet, we look for a camera in this entity
-            if(!camera) camera = entity->getComponent<CameraComponent>();
-            if (const auto light = entity->getComponent<LightComponent>(); light)
-            {
-                //light->position=glm::vec3(light->getOwner()->getLocalToWorldMatrix() * glm::vec4(light->getOwner()->localTransform.position,1));
-                
-                if(light->lightType!=LightType::DIRECTIONAL)
-                    light->position = glm::vec3(light->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1));
-                lightSources.push_back(light);
-                
-            }
-            // If this entity has a mesh renderer component
-            if(auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer){
-                // We construct a command from it
-                RenderCommand command;
-                command.localToWorld = meshRenderer->getOwner()->getLocalToWorldMatrix();
-                command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
-                command.mesh = meshRenderer->mesh;
-                command.material = meshRenderer->material;
-                // if it is transparent, we add it to the transparent commands list
-                if(command.material->transparent){
-                    transparentCommands.push_back(command);
-                } else {
-                // Otherwise, we add it to the opaque command list
-                    opaqueCommands.push_back(command);
-                }
+        // The ids of the materials' states may change between frames (e.g. if a material is edited), so their keys are found again
+        materialStateKeys.clear();
+        // Each component type is packed in its own pool, so we walk over the pools we need instead of all the entities
+        // We pick the first camera we find
+        if(auto& cameras = world->getComponents<CameraComponent>(); cameras.size() > 0)
+            camera = &cameras[0];
+        for(auto& light : world->getComponents<LightComponent>()){
+            //light->position=glm::vec3(light->getOwner()->getLocalToWorldMatrix() * glm::vec4(light->getOwner()->localTransform.position,1));
+            
+            // Only the lights which changed or moved since the last frame need to be updated
+            if(!light.changedSince(since) && !light.getOwner()->transformChangedSince(since)){
+                lightSources.push_back(&light);
+                continue;
             }
+            lightsChanged = true;
+            if(light.lightType!=LightType::DIRECTIONAL)
+                light.position = glm::vec3(light.getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1));
+            lightSources.push_back(&light);
         }
+        if(lightsChanged || lightSources != previousLightSources) lightsVersion = renderVersion;
+        stats.submitted = world->getComponents<MeshRendererComponent>().size();
 
         // If there is no camera, we return (we cannot render without a camera)
         if(camera == nullptr) return;
 
+        //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
+        glm::mat4 projection = camera->getProjectionMatrix(windowSize);
+        glm::mat4 VP=projection*camera->getViewMatrix();
+
         //TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
         // HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
         glm::vec3 cameraForward =(camera->getOwner()->getLocalToWorldMatrix()*glm::vec4(0.0, 0.0, -1.0f,0.0));
-        std::sort(transparentCommands.begin(), transparentCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
-            //TODO: (Req 9) Finish this function
-            //HINT: the following return should return true "first" should be drawn before "second". 
-            //assuming the camera is at (0,0,0), and the foward direction is (0.0, 0.0, -1.0f)
-            // the criterion for sorting is which is closer
-            return glm::dot(first.center,cameraForward) > glm::dot(second.center,cameraForward);
-        });
+        glm::vec3 cameraPos = camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
 
-        //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
-        glm::mat4 VP=camera->getProjectionMatrix(windowSize)*camera->getViewMatrix();
-        
+        // The mesh renderers inside the camera frustum are turned into commands with their matrices & their sort keys
+        glm::vec4 frustumPlanes[6];
+        extractFrustumPlanes(VP, frustumPlanes);
+        if(pool && parallelExtraction)
+            extractCommandsParallel(world, pool, VP, frustumPlanes, cameraPos, cameraForward);
+        else
+            extractCommands(world, VP, frustumPlanes, cameraPos, cameraForward);
+        stats.drawn = opaqueCommands.size() + transparentCommands.size();
+        stats.culled = stats.submitted - stats.drawn;
+
+        // The opaque commands are grouped by their states (so the pipeline state, shader & material change as rarely as possible)
+        // and each group is drawn front to back. The transparent commands are drawn back to front (the states only break the ties).
+        sortCommands(opaqueCommands);
+        sortCommands(transparentCommands);
+
+        // The data of this frame is written to the next region of the stream buffer (waiting only if the GPU still reads it)
+        streamBuffer->begin();
+        // The camera & the light clusters are written once to the frame uniform block, which all the lit programs read
+        frameData.viewProjection = VP;
+        frameData.cameraPosition = cameraPos;
+        frameData.cameraForward = glm::normalize(cameraForward);
+        assignLights(camera, projection);
+        // The frame block is written before the lights, since the lights & clusters grow with the scene and may fill the region
+        // (the buffer textures have their own buffers to fall back to)
+        uploadFrameData();
+        uploadLights();
+
+        // The instances of all the batches are written at once, then the writes to the stream buffer end before the draws
+        instances.clear();
+        drawCommands.clear();
+        builtBatches.clear();
+        buildPassBatches();
+        uploadInstances();
+        streamBuffer->flush();
+
+        drawPasses(camera, VP);
+
+        // The region of this frame is written again once the GPU passes this fence
+        streamBuffer->fence();
+        stats.streamWaits = streamBuffer->getStats().fenceWaits;
+        stats.frameDataFallbacks = frameDataFallbacks;
+    }
+
+    void ForwardRenderer::buildPassBatches(){
+        prepassCommands.clear();
+        if(depthPrepass){
+            // The lit objects are drawn by "light.vert", whose positions are computed exactly like those of "depth.vert".
+            // Only those whose depth is tested & written as usual can be shaded where their depth is equal to the pre-pass depth.
+            moveCommands(opaqueCommands, prepassCommands, [](const Material* material){
+                const PipelineState& state = material->pipelineState;
+                return dynamic_cast<const LitMaterial*>(material) != nullptr && state.depthTesting.enabled && state.depthMask &&
+                       (state.depthTesting.function == GL_LESS || state.depthTesting.function == GL_LEQUAL);
+            });
+            buildBatches(prepassCommands, prepassBatches);
+        }
+        buildBatches(opaqueCommands, opaqueBatches);
+        buildBatches(transparentCommands, transparentBatches);
+    }
+
+    void ForwardRenderer::drawPasses(CameraComponent* camera, const glm::mat4& VP){
         //TODO: (Req 9) Set the OpenGL viewport using viewportStart and viewportSize
         glViewport(0,0,this->windowSize.x,this->windowSize.y);
         
@@ -224,42 +677,67 @@ namespace our {
         glClearDepth(1);
         
         //TODO: (Req 9) Set the color mask to true and the depth mask to true (to ensure the glClear will affect the framebuffer)
-        glColorMask(true, true, true, true);
-        glDepthMask(true);
+        GLStateCache::colorMask(true, true, true, true);
+        GLStateCache::depthMask(true);
 
         // If there is a postprocess material, bind the framebuffer
         if(postprocessMaterial){
             //TODO: (Req 11) bind the framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, postprocessFrameBuffer);
+            GLStateCache::bindDrawFramebuffer(postprocessFrameBuffer);
         }
        
         //TODO: (Req 9) Clear the color and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //TODO: (Req 9) Draw all the opaque commands
-        glm::vec3 cameraPos = camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for(auto opaqueCommand:opaqueCommands)
-        {
-            opaqueCommand.material->setup();
-            if(dynamic_cast<LitMaterial*>(opaqueCommand.material))
-            {
-                
-                addLight(opaqueCommand.material->shader);
-                opaqueCommand.material->shader->set("object_to_world",opaqueCommand.localToWorld);
-                opaqueCommand.material->shader->set("object_to_world_inv_transpose",glm::transpose(glm::inverse(opaqueCommand.localToWorld)));
-                opaqueCommand.material->shader->set("view_projection",VP);
-                opaqueCommand.material->shader->set("camera_position", cameraPos);
-                // opaqueCommand.material->shader->set("material.diffuse", ((LitMaterial*)opaqueCommand.material)->diffuse);
-                opaqueCommand.material->shader->set("material.diffuse", ((LitMaterial*)opaqueCommand.material)->diffuse);
-                opaqueCommand.material->shader->set("material.specular", ((LitMaterial*)opaqueCommand.material)->specular);
-                opaqueCommand.material->shader->set("material.ambient", ((LitMaterial*)opaqueCommand.material)->ambient);
-                opaqueCommand.material->shader->set("material.shininess",((LitMaterial*)opaqueCommand.material)->shininess);
-            }
+        // The commands that share a mesh & a material are drawn as instances of a single draw call (see "buildBatches")
+        // With the depth pre-pass, the depth of the lit objects is written first, then the other opaque objects are drawn
+        // (they may hide more of the lit objects), then the lit objects are shaded only where they are visible.
+        bool prepassed = depthPrepass && !prepassCommands.empty();
+        if(depthPrepass) readPrepassQueries();
+        // If the GPU has not finished the queries of the next slot yet, this frame is not counted (the slot waits for them)
+        bool counted = prepassed && !prepassQueriesPending[prepassQueryFrame];
+        if(counted) glBeginQuery(GL_SAMPLES_PASSED, prepassQueries[prepassQueryFrame][0]);
+        if(prepassed) drawBatches(prepassCommands, prepassBatches, depthProgram, PassMode::DEPTH_ONLY);
+        if(counted) glEndQuery(GL_SAMPLES_PASSED);
+        drawBatches(opaqueCommands, opaqueBatches);
+        if(counted) glBeginQuery(GL_SAMPLES_PASSED, prepassQueries[prepassQueryFrame][1]);
+        if(prepassed) drawBatches(prepassCommands, prepassBatches, nullptr, PassMode::DEPTH_EQUAL);
+        if(counted){
+            glEndQuery(GL_SAMPLES_PASSED);
+            prepassQueriesPending[prepassQueryFrame] = true;
+            prepassQueryFrame = (prepassQueryFrame + 1) % PREPASS_QUERY_FRAMES;
+        }
+        drawSky(camera, VP);
 
-            opaqueCommand.material->shader->set("transform",VP*opaqueCommand.localToWorld);
-            opaqueCommand.mesh->draw();
+        //TODO: (Req 9) Draw all the transparent commands
+        // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
+        drawBatches(transparentCommands, transparentBatches);
+
+        drawPostprocess();
+    }
+
+    void ForwardRenderer::readPrepassQueries(){
+        // The queries of this slot were issued at least PREPASS_QUERY_FRAMES frames ago. If the GPU is further behind,
+        // the slot stays pending (and is not reused) until they are available, so no result is lost.
+        if(prepassQueriesPending[prepassQueryFrame]){
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(prepassQueries[prepassQueryFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available){
+                GLuint64 samples;
+                glGetQueryObjectui64v(prepassQueries[prepassQueryFrame][0], GL_QUERY_RESULT, &samples);
+                prepassSamples = (size_t)samples;
+                glGetQueryObjectui64v(prepassQueries[prepassQueryFrame][1], GL_QUERY_RESULT, &samples);
+                shadedSamples = (size_t)samples;
+                prepassQueriesPending[prepassQueryFrame] = false;
+            }
         }
+        stats.prepassSamples = prepassSamples;
+        stats.shadedSamples = shadedSamples;
+    }
+
+    void ForwardRenderer::drawSky(CameraComponent* camera, const glm::mat4& VP){
         // If there is a sky material, draw the sky
         if(this->skyMaterial){
             //TODO: (Req 10) setup the sky material
@@ -281,52 +759,25 @@ namespace our {
                 0.0f, 0.0f, 1.0f, 1.0f
             );
             //TODO: (Req 10) set the "transform" uniform
-            skyMaterial->shader->set("transform",alwaysBehindTransform * VP * model);
+            skyMaterial->shader->set(uniforms::TRANSFORM, alwaysBehindTransform * VP * model);
 
             //TODO: (Req 10) draw the sky sphere
             skySphere->draw();
+            ++stats.drawCalls;
         }
+    }
 
-
-        
-        //TODO: (Req 9) Draw all the transparent commands
-        // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for(auto transparentCommand:transparentCommands)
-        {
-            // addLight(transparentCommand.material->shader);
-            // transparentCommand.material->shader->set("material.diffuse",transparentCommand.material->diffuse);
-            // transparentCommand.material->shader->set("material.specular",transparentCommand.material->specular);
-            // transparentCommand.material->shader->set("material.ambient",transparentCommand.material->ambient);
-            // transparentCommand.material->shader->set("material.shininess",transparentCommand.material->shininess);
-            transparentCommand.material->setup();
-            if (dynamic_cast<LitMaterial*>(transparentCommand.material))
-            {
-
-                addLight(transparentCommand.material->shader);
-                transparentCommand.material->shader->set("object_to_world",transparentCommand.localToWorld);
-                transparentCommand.material->shader->set("object_to_world_inv_transpose",glm::transpose(glm::inverse(transparentCommand.localToWorld)));
-                transparentCommand.material->shader->set("view_projection",VP);
-                transparentCommand.material->shader->set("camera_position", cameraPos);
-                // opaqueCommand.material->shader->set("material.diffuse", ((LitMaterial*)opaqueCommand.material)->diffuse);
-                transparentCommand.material->shader->set("material.diffuse", ((LitMaterial*)transparentCommand.material)->diffuse);
-                transparentCommand.material->shader->set("material.specular", ((LitMaterial*)transparentCommand.material)->specular);
-                transparentCommand.material->shader->set("material.ambient", ((LitMaterial*)transparentCommand.material)->ambient);
-                transparentCommand.material->shader->set("material.shininess",((LitMaterial*)transparentCommand.material)->shininess);
-            }
-            transparentCommand.material->shader->set("transform", VP*transparentCommand.localToWorld);
-            transparentCommand.mesh->draw();
-        }
-        
-
+    void ForwardRenderer::drawPostprocess(){
         // If there is a postprocess material, apply postprocessing
         if(postprocessMaterial){
             //TODO: (Req 11) Return to the default framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            GLStateCache::bindDrawFramebuffer(0);
 
             //TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
             postprocessMaterial->setup();
-            glBindVertexArray(postProcessVertexArray);
+            GLStateCache::bindVertexArray(postProcessVertexArray);
             glDrawArrays(GL_TRIANGLES, 0, 3);
+            ++stats.drawCalls;
         }
     }
 
@@ -5,10 +5,20 @@
 #include "../components/light.hpp"
 #include "../components/mesh-renderer.hpp"
 #include "../asset-loader.hpp"
+#include "../ecs/transform-kernel.hpp"
+#include "render-sort.hpp"
+#include "frame-uniforms.hpp"
+#include "../buffer/stream-buffer.hpp"
+#include "../buffer/texture-buffer.hpp"
+#include "light-clusters.hpp"
+#include "worker-pool.hpp"
+#include "renderer.hpp"
 
 #include <glad/gl.h>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
+#include <mutex>
 
 namespace our
 {
@@ -16,18 +26,43 @@ namespace our
     // The render command stores command that tells the renderer that it should draw
     // the given mesh at the given localToWorld matrix using the given material
     // The renderer will fill this struct using the mesh renderer components
+    // The clip space & normal matrices are computed for all the commands at once (see "computeDrawMatrices")
     struct RenderCommand {
         glm::mat4 localToWorld;
+        glm::mat4 localToClip;  // The model-view-projection matrix (VP * localToWorld)
+        glm::mat4 normalMatrix; // The inverse transpose of localToWorld (used to transform the normals)
+        glm::vec4 boundingSphere; // The local bounding sphere of the mesh (center in xyz, radius in w)
         glm::vec3 center;
+        float cullingMargin;      // How deep the bounding sphere is inside the camera frustum (negative if it is outside)
+        uint64_t sortKey;         // The key by which the commands are ordered (see "render-sort.hpp")
         Mesh* mesh;
         Material* material;
     };
 
+    // A run of sorted commands that share a mesh & a material
+    // (or only a material if it is a multi-draw batch, whose meshes are all stored in the same geometry arena)
+    struct DrawBatch {
+        size_t first = 0, count = 0; // The range of the commands of the batch
+        bool instanced = false;      // If true, all the commands are drawn by a single instanced draw call
+        size_t firstInstance = 0;    // The index of the instance data of the first command in "instances"
+        bool multiDraw = false;      // If true, the meshes of the commands are drawn by a single multi-draw call (one draw command per mesh)
+        size_t firstDrawCommand = 0, drawCommandCount = 0; // The range of the draw commands of a multi-draw batch in "drawCommands"
+    };
+
+    // The commands extracted by one job of the parallel extraction (see "ForwardRenderer::extractCommandsParallel")
+    struct ExtractionChunk {
+        std::vector<RenderCommand> opaqueCommands, transparentCommands;
+        size_t opaqueOffset = 0, transparentOffset = 0; // Where the commands of this chunk go in the merged lists
+        std::unordered_map<const Material*, uint64_t> stateKeys; // The state keys found by this chunk (so it rarely locks the shared map)
+    };
+
     // A forward renderer is a renderer that draw the object final color directly to the framebuffer
     // In other words, the fragment shader in the material should output the color that we should see on the screen
     // This is different from more complex renderers that could draw intermediate data to a framebuffer before computing the final color
     // In this project, we only need to implement a forward renderer
-    class ForwardRenderer {
+    // (the deferred renderer builds on it, see "DeferredRenderer")
+    class ForwardRenderer : public Renderer {
+    protected:
         // These window size will be used on multiple occasions (setting the viewport, computing the aspect ratio, etc.)
         glm::ivec2 windowSize;
         // These are two vectors in which we will store the opaque and the transparent commands.
@@ -35,23 +70,162 @@ namespace our
         std::vector<RenderCommand> opaqueCommands;
         std::vector<RenderCommand> transparentCommands;
         std::vector<LightComponent*> lightSources;
+        std::vector<LightComponent*> previousLightSources; // The lights of the previous frame (to detect added or removed lights)
+        // The data written every frame (the frame uniform block & the instances) goes through this buffer.
+        // Each frame writes its own region, so the CPU never waits for the GPU to finish reading the previous frames.
+        StreamBuffer* streamBuffer = nullptr;
+        GLint uniformBufferAlignment = 256; // The alignment of the offsets given to glBindBufferRange
+        // The camera is written once per frame and bound to the "Frame" block of the programs.
+        FrameData frameData;
+        // If the stream buffer is full, the frame block is written to this buffer instead (so the programs never read an old frame)
+        GLuint frameUniformBuffer = 0;
+        size_t frameDataFallbacks = 0; // The frames that used "frameUniformBuffer" (since the renderer was initialized)
+        // The lights are read by the lit programs from buffer textures, so their number is not limited by the size of a uniform block.
+        // The lights that reach every fragment come first, then the lights with a range which are assigned to the clusters of the
+        // camera frustum, so each fragment only evaluates the lights of its cluster (see "LightClusters").
+        // The lights are only copied from their components when they change, but the clusters are built again every frame.
+        std::vector<LightData> lights;
+        std::vector<glm::vec4> lightSpheres; // The bounding sphere of each clustered light in world space (center in xyz, range in w)
+        LightClusters* lightClusters = nullptr;
+        TextureBuffer *lightsTexture = nullptr, *lightClustersTexture = nullptr, *lightIndicesTexture = nullptr;
+        float lightCutoff = 0.02f; // The intensity below which a light is considered to have faded out (it gives the ranges of the lights)
+        uint32_t renderVersion = 0; // The change version of the world when the last frame was rendered
+        uint32_t lightsVersion = 0; // The change version of the world when a light was last changed, moved, added or removed
+        uint32_t filledLightsVersion = 0; // The "lightsVersion" last copied to "frameData"
+        RenderStats stats;
+        // The commands are sorted through these (kept here to prevent reallocating them every frame)
+        std::unordered_map<const Material*, uint64_t> materialStateKeys; // The state key of each material seen this frame
+        std::mutex materialStateKeysMutex; // Guards "materialStateKeys" (the extraction jobs look up the state keys in parallel)
+        std::vector<SortItem> sortItems, sortScratch;
+        std::vector<RenderCommand> sortedCommands;
+        // The commands that share a mesh & a material are drawn by a single instanced draw call if their shader has
+        // an instanced variant. Their matrices are written once per frame to the stream buffer.
+        bool instancingEnabled = true;
+        std::vector<InstanceData> instances;
+        size_t instancesOffset = 0; // The offset of "instances" in the stream buffer in the current frame
+        // The commands that share a material and whose meshes are stored in a geometry arena are drawn by a single
+        // glMultiDrawElementsIndirect call (if the driver supports it). Its draw commands are written to the stream buffer too.
+        bool multiDrawEnabled = true;
+        std::vector<GeometryArena::DrawCommand> drawCommands;
+        size_t drawCommandsOffset = 0; // The offset of "drawCommands" in the stream buffer in the current frame
+        std::vector<DrawBatch> opaqueBatches, transparentBatches;
+        std::vector<std::vector<DrawBatch>*> builtBatches; // The batch lists built in the current frame (see "buildBatches")
+        // If true, the depth of the lit opaque objects is written by a pre-pass that only reads their positions (with "depth.vert"),
+        // then they are shaded with the depth test set to GL_EQUAL and without depth writes. So the lit programs only run for
+        // the visible fragments instead of every fragment that passes the depth test when it is drawn.
+        bool depthPrepass = false;
+        ShaderProgram* depthProgram = nullptr; // Writes the depth of the pre-pass (it has an instanced variant)
+        std::vector<RenderCommand> prepassCommands; // The opaque commands moved to the pre-pass (in their sorted order)
+        std::vector<DrawBatch> prepassBatches;      // Both passes draw the same batches
+        // The samples that pass the depth test in the pre-pass & in the shading after it are counted by queries.
+        // They are read a few frames later, so reading them never waits for the GPU (the frames whose slot is still
+        // waiting for its results are not counted).
+        static constexpr int PREPASS_QUERY_FRAMES = 3;
+        GLuint prepassQueries[PREPASS_QUERY_FRAMES][2] = {};
+        bool prepassQueriesPending[PREPASS_QUERY_FRAMES] = {};
+        int prepassQueryFrame = 0;
+        size_t prepassSamples = 0, shadedSamples = 0; // The last counts read from the queries
+        // The mesh renderers inside the camera frustum are always found by walking the bounds hierarchy. If a worker pool is given
+        // to "render", they are then split into chunks whose commands are built, culled & given their sort keys in parallel.
+        // Otherwise (or if this is false), the commands are built while the hierarchy is walked.
+        bool parallelExtraction = true;
+        std::vector<ExtractionChunk> extractionChunks;
+        std::vector<Entity*> visibleEntities; // The entities whose bounds touch the frustum (found by the parallel extraction)
         // Objects used for rendering a skybox
-        Mesh* skySphere;
-        TexturedMaterial* skyMaterial;
+        Mesh* skySphere = nullptr;
+        TexturedMaterial* skyMaterial = nullptr;
         // Objects used for Postprocessing
-        GLuint postprocessFrameBuffer, postProcessVertexArray;
-        Texture2D *colorTarget, *depthTarget;
-        TexturedMaterial* postprocessMaterial;
+        GLuint postprocessFrameBuffer = 0, postProcessVertexArray = 0;
+        Texture2D *colorTarget = nullptr, *depthTarget = nullptr;
+        TexturedMaterial* postprocessMaterial = nullptr;
     public:
         // Initialize the renderer including the sky and the Postprocessing objects.
         // windowSize is the width & height of the window (in pixels).
-        void initialize(glm::ivec2 windowSize, const nlohmann::json& config);
+        void initialize(glm::ivec2 windowSize, const nlohmann::json& config) override;
         // Clean up the renderer
-        void destroy();
+        void destroy() override;
         // This function should be called every frame to draw the given world
-        void render(World* world);
+        // If a worker pool is given, the render commands are extracted in parallel (see "parallelExtraction")
+        void render(World* world, WorkerPool* pool = nullptr) override;
+        // Returns the draw counts of the last rendered frame
+        const RenderStats& getStats() const override { return stats; }
+    protected:
+        // How a pass changes the pipeline states of the materials it draws
+        enum class PassMode {
+            SHADED,      // The pipeline states of the materials are used as they are
+            DEPTH_ONLY,  // Only the depth is written (and only the positions are read)
+            DEPTH_EQUAL  // Only the fragments whose depth is equal to the depth already written are shaded (and the depth is not written)
+        };
+
+        // Moves the commands whose material passes "predicate" from "commands" to "moved". Both lists keep their sorted order
+        // (so the commands that share a material stay next to each other) and the predicate is only called when the material changes.
+        template<typename Predicate>
+        static void moveCommands(std::vector<RenderCommand>& commands, std::vector<RenderCommand>& moved, Predicate predicate){
+            moved.clear();
+            size_t kept = 0;
+            const Material* lastMaterial = nullptr;
+            bool lastMoved = false;
+            for(size_t index = 0; index < commands.size(); ++index){
+                const RenderCommand& command = commands[index];
+                if(command.material != lastMaterial){
+                    lastMaterial = command.material;
+                    lastMoved = predicate(command.material);
+                }
+                if(lastMoved) moved.push_back(command);
+                else commands[kept++] = command;
+            }
+            commands.resize(kept);
+        }
+
+        // Splits the sorted commands of each pass into batches (see "buildBatches")
+        virtual void buildPassBatches();
+        // Draws the passes of the frame (the opaque commands, the sky, the transparent commands, then the postprocessing)
+        virtual void drawPasses(CameraComponent* camera, const glm::mat4& VP);
+        // Draws the sky sphere around the camera (if the config has a sky)
+        void drawSky(CameraComponent* camera, const glm::mat4& VP);
+        // Draws the postprocessed scene to the window (if the config has a postprocess shader)
+        void drawPostprocess();
+        // Splits the sorted commands into batches (and appends the instances & the draw commands of the batches to "instances" & "drawCommands").
+        // If "program" is not null, the commands will be drawn by it instead of the shaders of their materials.
+        void buildBatches(const std::vector<RenderCommand>& commands, std::vector<DrawBatch>& batches, ShaderProgram* program = nullptr);
+        // Draws the batches of the commands (with the same "program" given to "buildBatches", or any program with an instanced variant)
+        void drawBatches(const std::vector<RenderCommand>& commands, const std::vector<DrawBatch>& batches, ShaderProgram* program = nullptr,
+                         PassMode mode = PassMode::SHADED);
     private:
-        void addLight(ShaderProgram* program);
+        // Sets up the pipeline state of the material (changed by the pass mode) and the program that draws it
+        static void setupPass(const Material* material, ShaderProgram* program, PassMode mode);
+        // Reads the sample counts of the depth pre-pass queries issued a few frames ago (the slot stays pending if the GPU did not finish them)
+        void readPrepassQueries();
+        // Copies the enabled lights to "lights" (the lights that reach every fragment first) and finds the ranges of the others
+        void fillLights();
+        // Writes "frameData" to the stream buffer and binds it to the "Frame" block
+        void uploadFrameData();
+        // Assigns the lights to the clusters of the camera and writes the cluster grid to "frameData"
+        // (the lights are only filled if they changed)
+        void assignLights(CameraComponent* camera, const glm::mat4& projection);
+        // Writes the lights & the clusters to their buffer textures
+        void uploadLights();
+        // Writes the instances & the draw commands to the stream buffer (the batches are drawn without instancing if they do not fit)
+        void uploadInstances();
+        // Builds the commands of the mesh renderers inside the frustum by walking the world's bounds hierarchy on the calling thread
+        void extractCommands(World* world, const glm::mat4& VP, const glm::vec4 (&frustumPlanes)[6],
+                             const glm::vec3& cameraPosition, const glm::vec3& cameraForward);
+        // Builds the commands of the mesh renderers inside the frustum by querying the world's bounds hierarchy, then splitting
+        // the entities it found into chunks processed by the pool.
+        // Each chunk fills its own lists, then the lists are copied to their offsets in the merged lists (so no list is shared).
+        // The world's transforms must be up to date ("render" calls "World::updateTransforms" first) and must not change until
+        // it returns, since the workers read the cached matrices of the entities (this is asserted in debug builds).
+        void extractCommandsParallel(World* world, WorkerPool* pool, const glm::mat4& VP, const glm::vec4 (&frustumPlanes)[6],
+                                     const glm::vec3& cameraPosition, const glm::vec3& cameraForward);
+        // Culls the commands, then computes their draw matrices & their sort keys (it is called by each extraction job on its own lists)
+        void prepareCommands(std::vector<RenderCommand>& commands, uint64_t pass, const glm::mat4& VP, const glm::vec4 (&frustumPlanes)[6],
+                             const glm::vec3& cameraPosition, const glm::vec3& cameraForward, std::unordered_map<const Material*, uint64_t>& stateKeys);
+        // Removes the commands whose bounding sphere is outside the frustum and returns how many were removed
+        static size_t cullCommands(std::vector<RenderCommand>& commands, const glm::vec4 (&frustumPlanes)[6]);
+        // Returns the key of the states of the material (pipeline state, shader & material ids). It can be called from any thread.
+        uint64_t getStateKey(const Material* material);
+        // Orders the commands of a pass by their sort keys (see "prepareCommands")
+        void sortCommands(std::vector<RenderCommand>& commands);
 
 
     };
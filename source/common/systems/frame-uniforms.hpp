@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    // A light as read by the shaders from the "lights" buffer texture (5 RGBA32F texels per light, see "readLight" in "light.glsl").
+    // The diffuse & specular colors are already multiplied by the color of the light.
+    // The ambient colors of all the lights are summed in "FrameData::ambientLight" instead, since they do not depend on the distance.
+    struct LightData {
+        glm::vec3 diffuse;    float type;     // One of the LightType values
+        glm::vec3 specular;   float radius;   // The distance at which the light fades out (0 if it reaches everything)
+        glm::vec3 position;   float attenuationConstant;
+        glm::vec3 direction;  float attenuationLinear;
+        float attenuationQuadratic, innerAngle, outerAngle, padding;
+    };
+    static_assert(sizeof(LightData) == 5 * sizeof(glm::vec4), "LightData must match the texels read by the shaders");
+
+    // The contents of the "Frame" uniform block which holds the data shared by all the draws of a frame.
+    // It is written once per frame and bound to its binding point (see "uniform_blocks::FRAME"),
+    // so the programs that declare it read the camera & the light clusters without any per-draw uniform call.
+    // It mirrors the std140 layout of the block declared in "light.glsl" (the only declaration the shaders include).
+    struct FrameData {
+        glm::mat4 viewProjection;
+        glm::vec3 cameraPosition;  int32_t globalLightCount; // The lights that reach every fragment come first in the lights texture
+        glm::vec3 cameraForward;   float clusterDepthScale;  // The depth slice of a fragment is log(depth) * scale + bias
+        glm::vec3 ambientLight;    float clusterDepthBias;
+        glm::ivec3 clusterCount;   int32_t lightCount;       // The number of clusters along x, y & the depth
+        glm::vec2 clusterTileScale; glm::vec2 padding;       // Multiplies the fragment coordinates to get the cluster x & y
+    };
+    static_assert(offsetof(FrameData, clusterTileScale) == 128, "FrameData must match the std140 layout of the \"Frame\" block in light.glsl");
+
+}
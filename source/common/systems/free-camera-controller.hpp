@@ -22,6 +22,7 @@ namespace our
         Application *app;          // The application in which the state runs
         bool mouse_locked = false; // Is the mouse locked
         glm::vec3 newPosition = {0, 0, 0};
+        Symbol blockTag = Symbol("block"); // The tag of the entities that the player collides with
 
     public:
         // When a state enters, it should call this function and give it the pointer to the application
@@ -34,19 +35,13 @@ namespace our
         void update(World *world, float deltaTime)
         {
             // First of all, we search for an entity containing both a CameraComponent and a FreeCameraControllerComponent
-            // As soon as we find one, we break
-            CameraComponent *camera = nullptr;
-            FreeCameraControllerComponent *controller = nullptr;
-            for (auto entity : world->getEntities())
-            {
-                camera = entity->getComponent<CameraComponent>();
-                controller = entity->getComponent<FreeCameraControllerComponent>();
-                if (camera && controller)
-                    break;
-            }
+            // The world keeps the list of such entities, so we just pick the first one
+            Entity *controlled = world->view<CameraComponent, FreeCameraControllerComponent>().front();
             // If there is no entity with both a CameraComponent and a FreeCameraControllerComponent, we can do nothing so we return
-            if (!(camera && controller))
+            if (!controlled)
                 return;
+            CameraComponent *camera = controlled->getComponent<CameraComponent>();
+            FreeCameraControllerComponent *controller = controlled->getComponent<FreeCameraControllerComponent>();
             // Get the entity that we found via getOwner of camera (we could use controller->getOwner())
             Entity *entity = camera->getOwner();
 
@@ -88,7 +83,11 @@ namespace our
             // We update the camera fov based on the mouse wheel scrolling amount
             float fov = camera->fovY + app->getMouse().getScrollOffset().y * controller->fovSensitivity;
             fov = glm::clamp(fov, glm::pi<float>() * 0.01f, glm::pi<float>() * 0.99f); // We keep the fov in the range 0.01*PI to 0.99*PI
-            camera->fovY = fov;
+            if (fov != camera->fovY)
+            {
+                camera->fovY = fov;
+                controlled->markChanged<CameraComponent>();
+            }
 
             // We get the camera model matrix (relative to its parent) to compute the front, up and right directions
             glm::mat4 matrix = entity->localTransform.toMat4();
@@ -141,17 +140,12 @@ namespace our
             const float minDistance = 0.8f;
             if (position.x <= -10.5 || position.z >= 10 || position.z <= -10)
                 return true;
-            for (auto entity : world->getEntities())
+            // Only the entities tagged "block" around the player can block it, so the spatial grid only visits them
+            const glm::vec2 point(position.x, position.z);
+            return world->getSpatialGrid().visitBox(point - minDistance, point + minDistance, blockTag, [&](const SpatialGrid::Entry &entry)
             {
-                if (entity->name!="block")
-                    continue;
-                glm::vec3 entityPosition = entity->localTransform.position;
-                if ((abs(position.x - entityPosition.x) + abs(position.z - entityPosition.z)) <= minDistance)
-                {
-                    return true;
-                }
-            }
-            return false;
+                return (abs(point.x - entry.position.x) + abs(point.y - entry.position.y)) <= minDistance;
+            });
         }
 
         // When the state exits, it should call this function to ensure the mouse is unlocked
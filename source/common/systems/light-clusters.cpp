@@ -0,0 +1,144 @@
+#include "light-clusters.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OUR_LIGHT_CLUSTERS_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace our {
+
+    LightClusters::LightClusters(glm::ivec3 counts, float sliceNear, float sliceFar) :
+        counts(glm::max(counts, glm::ivec3(1))), sliceNear(sliceNear), sliceFar(sliceFar) {
+        ranges.resize((size_t)this->counts.x * this->counts.y * this->counts.z);
+    }
+
+    void LightClusters::computeBounds(const glm::mat4& projection, float near, float far){
+        if(projection == boundsProjection && near == boundsNear && far == boundsFar) return;
+        boundsProjection = projection;
+        boundsNear = near;
+        boundsFar = far;
+
+        // The slices are spread evenly on a logarithmic scale between the slice depths
+        float first = std::max(sliceNear, near), last = std::min(sliceFar, far);
+        if(last <= first) last = first * 2.0f;
+        depthScale = counts.z / std::log(last / first);
+        depthBias = -std::log(first) * depthScale;
+
+        size_t clusterCount = ranges.size();
+        size_t paddedCount = (clusterCount + 3) / 4 * 4;
+        const float infinity = std::numeric_limits<float>::infinity();
+        // The padding boxes are empty (their minimum is above their maximum), so their distance to any point is infinite
+        minX.assign(paddedCount, infinity); minY.assign(paddedCount, infinity); minZ.assign(paddedCount, infinity);
+        maxX.assign(paddedCount, -infinity); maxY.assign(paddedCount, -infinity); maxZ.assign(paddedCount, -infinity);
+
+        // The corners of the tiles on the near plane. A perspective projection has a 0 in its last element (an orthographic one has a 1).
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        bool perspective = projection[3][3] == 0.0f;
+        auto cornerAt = [&](int x, int y, float depth){
+            glm::vec4 point = inverseProjection * glm::vec4(2.0f * x / counts.x - 1.0f, 2.0f * y / counts.y - 1.0f, -1.0f, 1.0f);
+            glm::vec3 nearPoint = glm::vec3(point) / point.w;
+            // The view space depth is -z. Along a perspective ray, the point moves away from the eye proportionally to the depth.
+            if(perspective) return nearPoint * (depth / -nearPoint.z);
+            return glm::vec3(nearPoint.x, nearPoint.y, -depth);
+        };
+        for(int z = 0; z < counts.z; ++z){
+            float sliceStart = z == 0 ? near : std::exp((z - depthBias) / depthScale);
+            float sliceEnd = z == counts.z - 1 ? far : std::exp((z + 1 - depthBias) / depthScale);
+            for(int y = 0; y < counts.y; ++y){
+                for(int x = 0; x < counts.x; ++x){
+                    glm::vec3 lower(infinity), upper(-infinity);
+                    for(int corner = 0; corner < 8; ++corner){
+                        glm::vec3 point = cornerAt(x + (corner & 1), y + ((corner >> 1) & 1), (corner & 4) ? sliceEnd : sliceStart);
+                        lower = glm::min(lower, point);
+                        upper = glm::max(upper, point);
+                    }
+                    size_t index = ((size_t)z * counts.y + y) * counts.x + x;
+                    minX[index] = lower.x; minY[index] = lower.y; minZ[index] = lower.z;
+                    maxX[index] = upper.x; maxY[index] = upper.y; maxZ[index] = upper.z;
+                }
+            }
+        }
+    }
+
+    void LightClusters::findClusters(size_t first, size_t last, const glm::vec3& center, float radius, uint32_t light){
+        // The squared distance from the center to a box is the sum of the squared distances to its slabs along each axis
+        float radiusSquared = radius * radius;
+#if defined(OUR_LIGHT_CLUSTERS_SSE)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 centerX = _mm_set1_ps(center.x), centerY = _mm_set1_ps(center.y), centerZ = _mm_set1_ps(center.z);
+        const __m128 limit = _mm_set1_ps(radiusSquared);
+        for(size_t index = first; index < last; index += 4){
+            __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[index]), centerX), _mm_sub_ps(centerX, _mm_loadu_ps(&maxX[index]))));
+            __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[index]), centerY), _mm_sub_ps(centerY, _mm_loadu_ps(&maxY[index]))));
+            __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[index]), centerZ), _mm_sub_ps(centerZ, _mm_loadu_ps(&maxZ[index]))));
+            __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, limit));
+            for(; mask != 0; mask &= mask - 1){
+                int lane = 0;
+                while(!(mask & (1 << lane))) ++lane;
+                hitClusters.push_back((uint32_t)(index + lane));
+                hitLights.push_back(light);
+            }
+        }
+#else
+        for(size_t index = first; index < last; ++index){
+            float dx = std::max(0.0f, std::max(minX[index] - center.x, center.x - maxX[index]));
+            float dy = std::max(0.0f, std::max(minY[index] - center.y, center.y - maxY[index]));
+            float dz = std::max(0.0f, std::max(minZ[index] - center.z, center.z - maxZ[index]));
+            if(dx * dx + dy * dy + dz * dz <= radiusSquared){
+                hitClusters.push_back((uint32_t)index);
+                hitLights.push_back(light);
+            }
+        }
+#endif
+    }
+
+    void LightClusters::build(const glm::mat4& view, const glm::mat4& projection, float near, float far,
+                              const glm::vec4* spheres, size_t count, uint32_t firstLight){
+        computeBounds(projection, near, far);
+        hitClusters.clear();
+        hitLights.clear();
+        size_t sliceSize = (size_t)counts.x * counts.y;
+        for(size_t light = 0; light < count; ++light){
+            glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(spheres[light]), 1.0f));
+            float radius = spheres[light].w;
+            // Only the slices between the nearest & the farthest depths of the sphere can touch it
+            float nearest = -center.z - radius, farthest = -center.z + radius;
+            if(farthest < near || nearest > far) continue;
+            int firstSlice = nearest <= 0.0f ? 0 : (int)std::floor(std::log(nearest) * depthScale + depthBias);
+            int lastSlice = (int)std::floor(std::log(std::max(farthest, near)) * depthScale + depthBias);
+            firstSlice = std::clamp(firstSlice, 0, counts.z - 1);
+            lastSlice = std::clamp(lastSlice, 0, counts.z - 1);
+            // The range starts at a multiple of 4, so the loads of the SIMD test stay inside the padded arrays
+            size_t first = firstSlice * sliceSize / 4 * 4, last = (lastSlice + 1) * sliceSize;
+            findClusters(first, last, center, radius, firstLight + (uint32_t)light);
+        }
+
+        // The intersections are grouped by cluster: count them, find where each cluster's list starts, then scatter them.
+        // The lights were visited in order, so each cluster lists its lights in order too.
+        for(Range& range : ranges) range = Range{0, 0};
+        for(uint32_t cluster : hitClusters) ++ranges[cluster].count;
+        size_t total = 0;
+        droppedCount = 0;
+        for(Range& range : ranges){
+            uint32_t kept = (uint32_t)std::min<size_t>(range.count, maxIndexCount - total);
+            droppedCount += range.count - kept;
+            range.offset = (uint32_t)total;
+            range.count = kept;
+            total += kept;
+        }
+        indices.resize(total);
+        writtenCounts.assign(ranges.size(), 0);
+        for(size_t hit = 0; hit < hitClusters.size(); ++hit){
+            uint32_t cluster = hitClusters[hit];
+            // The lights beyond the kept count of a cluster were cut
+            if(writtenCounts[cluster] == ranges[cluster].count) continue;
+            indices[ranges[cluster].offset + writtenCounts[cluster]++] = hitLights[hit];
+        }
+    }
+
+}
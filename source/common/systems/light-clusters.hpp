@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace our {
+
+    // Assigns the lights to the clusters of the camera frustum (also called "froxels"). The screen is split into a grid of tiles
+    // and each tile is split into depth slices whose thickness grows with the depth (so the far clusters are not needlessly thin).
+    // Each fragment finds its cluster from its screen position & its depth and only evaluates the lights listed for that cluster,
+    // so the cost of a fragment depends on the lights that reach it instead of all the lights in the scene.
+    // The lists are built on the CPU every frame: each light's bounding sphere is tested against the view space boxes of the
+    // clusters in its depth range, 4 clusters at a time (with SSE on x86).
+    class LightClusters {
+    public:
+        // The lights of a cluster are "count" indices starting at "offset" in the light indices
+        struct Range {
+            uint32_t offset, count;
+        };
+
+    private:
+        glm::ivec3 counts;              // The number of clusters along x, y & the depth
+        float sliceNear, sliceFar;      // The depths split into slices (the first & last slices extend to the camera near & far planes)
+        float depthScale = 0, depthBias = 0; // The slice of a depth is floor(log(depth) * depthScale + depthBias)
+        // The view space boxes of the clusters (as a structure of arrays so 4 of them are tested at once).
+        // The arrays are padded to a multiple of 4 with empty boxes that no sphere can touch.
+        std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+        glm::mat4 boundsProjection = glm::mat4(0.0f); // The projection for which the boxes were computed
+        float boundsNear = 0, boundsFar = 0;
+        std::vector<Range> ranges;      // The lights of each cluster
+        std::vector<uint32_t> indices;  // The light indices of all the clusters (the lights of each cluster are contiguous)
+        std::vector<uint32_t> hitClusters, hitLights; // The cluster & the light of each intersection found while building
+        std::vector<uint32_t> writtenCounts;          // The indices written to each cluster's list while building
+        size_t maxIndexCount = SIZE_MAX;
+        size_t droppedCount = 0;
+
+        // Computes the boxes of the clusters (only when the projection or the depth range changes)
+        void computeBounds(const glm::mat4& projection, float near, float far);
+        // Records the clusters in [first, last) whose boxes touch the sphere (in view space)
+        void findClusters(size_t first, size_t last, const glm::vec3& center, float radius, uint32_t light);
+
+    public:
+        // "counts" is the number of tiles along x & y and the number of depth slices. The slices are spread between the depths
+        // "sliceNear" & "sliceFar" (clamped to the camera's range), so the slices are not wasted on depths that are rarely seen.
+        LightClusters(glm::ivec3 counts, float sliceNear, float sliceFar);
+
+        // Assigns the lights to the clusters of the camera. Each light is given by its bounding sphere in world space
+        // (center in xyz & radius in w) and the light at "spheres[i]" is listed as the index "firstLight + i".
+        void build(const glm::mat4& view, const glm::mat4& projection, float near, float far,
+                   const glm::vec4* spheres, size_t count, uint32_t firstLight);
+
+        // The lists beyond this number of indices are cut (the buffer texture that holds the indices has a maximum size)
+        void setMaxIndexCount(size_t count) { maxIndexCount = count; }
+
+        const glm::ivec3& getCounts() const { return counts; }
+        float getDepthScale() const { return depthScale; }
+        float getDepthBias() const { return depthBias; }
+        const std::vector<Range>& getRanges() const { return ranges; }
+        const std::vector<uint32_t>& getIndices() const { return indices; }
+        // The number of light indices cut by the last "build" (see "setMaxIndexCount")
+        size_t getDroppedCount() const { return droppedCount; }
+    };
+
+}
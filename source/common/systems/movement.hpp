@@ -2,6 +2,7 @@
 
 #include "../ecs/world.hpp"
 #include "../components/movement.hpp"
+#include "worker-pool.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
@@ -18,18 +19,26 @@ namespace our
     public:
 
         // This should be called every frame to update all entities containing a MovementComponent. 
-        void update(World* world, float deltaTime) {
-            // For each entity in the world
-            for(auto entity : world->getEntities()){
-                // Get the movement component if it exists
-                MovementComponent* movement = entity->getComponent<MovementComponent>();
-                // If the movement component exists
-                if(movement){
+        // If a worker pool is given, the components are split into chunks which are processed in parallel
+        // (each component only moves its own entity, so the chunks never touch the same data).
+        void update(World* world, float deltaTime, WorkerPool* pool = nullptr) {
+            // The movement components in the world are packed together in the world's pool
+            ComponentPool<MovementComponent>& movements = world->getComponents<MovementComponent>();
+            auto integrate = [&movements, deltaTime](size_t begin, size_t end){
+                for(size_t index = begin; index < end; ++index){
+                    MovementComponent& movement = movements[index];
+                    Entity* entity = movement.getOwner();
                     // Change the position and rotation based on the linear & angular velocity and delta time.
-                    entity->localTransform.position += deltaTime * movement->linearVelocity;
-                    entity->localTransform.rotation += deltaTime * movement->angularVelocity;
+                    entity->localTransform.position += deltaTime * movement.linearVelocity;
+                    // If the rotation is stored as a quaternion, the rotation of this frame is applied to it (in local space)
+                    if(entity->localTransform.useQuaternion)
+                        entity->localTransform.orientation = glm::normalize(entity->localTransform.orientation * glm::quat(deltaTime * movement.angularVelocity));
+                    else
+                        entity->localTransform.rotation += deltaTime * movement.angularVelocity;
                 }
-            }
+            };
+            if(pool) pool->parallelFor(movements.size(), 256, integrate);
+            else integrate(0, movements.size());
         }
 
     };
@@ -0,0 +1,83 @@
+#include "render-sort.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace our {
+
+    namespace render_sort {
+
+        // Returns the lowest "bits" bits of the value
+        static uint64_t truncate(uint64_t value, int bits){
+            return value & ((uint64_t(1) << bits) - 1);
+        }
+
+        uint64_t makeStateKey(uint32_t pipelineState, uint32_t shader, uint32_t material){
+            return (truncate(pipelineState, PIPELINE_BITS) << (SHADER_BITS + MATERIAL_BITS))
+                 | (truncate(shader, SHADER_BITS) << MATERIAL_BITS)
+                 | truncate(material, MATERIAL_BITS);
+        }
+
+        uint32_t quantizeDepth(float depth, int bits){
+            // The bits of a positive float are ordered like the float itself, and the sign bit of a positive float is 0
+            // (the draws behind the camera are treated as if they were on the camera)
+            float clamped = depth > 0.0f ? depth : 0.0f;
+            uint32_t floatBits;
+            std::memcpy(&floatBits, &clamped, sizeof(floatBits));
+            return floatBits >> (31 - bits);
+        }
+
+        uint64_t makeOpaqueKey(uint64_t stateKey, uint32_t mesh, float depth){
+            return (OPAQUE_PASS << (64 - PASS_BITS))
+                 | (stateKey << (OPAQUE_MESH_BITS + OPAQUE_DEPTH_BITS))
+                 | (truncate(mesh, OPAQUE_MESH_BITS) << OPAQUE_DEPTH_BITS)
+                 | quantizeDepth(depth, OPAQUE_DEPTH_BITS);
+        }
+
+        uint64_t makeTransparentKey(uint64_t stateKey, uint32_t mesh, float depth){
+            // The farthest draws must come first, so the depth is inverted
+            uint64_t invertedDepth = truncate(~uint64_t(quantizeDepth(depth, TRANSPARENT_DEPTH_BITS)), TRANSPARENT_DEPTH_BITS);
+            return (TRANSPARENT_PASS << (64 - PASS_BITS))
+                 | (invertedDepth << (STATE_BITS + TRANSPARENT_MESH_BITS))
+                 | (stateKey << TRANSPARENT_MESH_BITS)
+                 | truncate(mesh, TRANSPARENT_MESH_BITS);
+        }
+
+    }
+
+    void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch){
+        const size_t count = items.size();
+        if(count < 2) return;
+        scratch.resize(count);
+
+        // The histograms of all the digits are counted in a single pass over the items
+        constexpr int DIGITS = 8;
+        uint32_t histograms[DIGITS][256] = {};
+        for(const SortItem& item : items)
+            for(int digit = 0; digit < DIGITS; ++digit) ++histograms[digit][(item.key >> (8 * digit)) & 0xFF];
+
+        SortItem* source = items.data();
+        SortItem* target = scratch.data();
+        for(int digit = 0; digit < DIGITS; ++digit){
+            const int shift = 8 * digit;
+            uint32_t* histogram = histograms[digit];
+            // If all the keys have the same digit, this pass would not change the order
+            if(histogram[(source[0].key >> shift) & 0xFF] == count) continue;
+            // The histogram becomes the position of the first item of each bucket
+            uint32_t offset = 0;
+            for(int bucket = 0; bucket < 256; ++bucket){
+                uint32_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+            for(size_t index = 0; index < count; ++index){
+                const SortItem& item = source[index];
+                target[histogram[(item.key >> shift) & 0xFF]++] = item;
+            }
+            std::swap(source, target);
+        }
+        // After an odd number of passes, the sorted items are in the scratch buffer
+        if(source != items.data()) items.swap(scratch);
+    }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    // The draws are ordered by a 64-bit key, so sorting them is a single radix sort instead of a comparison sort
+    // over several fields. The most significant bits are compared first:
+    // - Opaque draws:      [pass:2][pipeline state:8][shader:10][material:12][mesh:12][depth:20]
+    //   The draws that share the same states end up next to each other (so the states change as rarely as possible)
+    //   and each group is drawn front to back (so the early depth test rejects the hidden fragments).
+    // - Transparent draws: [pass:2][inverted depth:24][pipeline state:8][shader:10][material:12][mesh:8]
+    //   The draws must be blended back to front, so the depth comes first and the states only break the ties.
+    // The ids are truncated to their bit widths, so two ids may share a group if there are too many of them
+    // (this only affects how well the states are grouped, not the correctness of the drawing).
+    namespace render_sort {
+
+        // The passes in the order they are drawn (wingdi.h defines OPAQUE & TRANSPARENT as macros, hence the suffix)
+        constexpr uint64_t OPAQUE_PASS = 0, TRANSPARENT_PASS = 1;
+
+        constexpr int PASS_BITS = 2, PIPELINE_BITS = 8, SHADER_BITS = 10, MATERIAL_BITS = 12;
+        constexpr int STATE_BITS = PIPELINE_BITS + SHADER_BITS + MATERIAL_BITS;
+        constexpr int OPAQUE_MESH_BITS = 12, OPAQUE_DEPTH_BITS = 20;
+        constexpr int TRANSPARENT_MESH_BITS = 8, TRANSPARENT_DEPTH_BITS = 24;
+
+        // Packs the ids of the states of a material
+        uint64_t makeStateKey(uint32_t pipelineState, uint32_t shader, uint32_t material);
+        // Maps a distance from the camera (along its forward direction) to "bits" bits while keeping the order.
+        // The quantization is finer near the camera (it keeps the exponent and the top bits of the mantissa of the float).
+        uint32_t quantizeDepth(float depth, int bits);
+        uint64_t makeOpaqueKey(uint64_t stateKey, uint32_t mesh, float depth);
+        uint64_t makeTransparentKey(uint64_t stateKey, uint32_t mesh, float depth);
+
+    }
+
+    // An element to sort: its key and the index of the element it refers to (e.g. a render command)
+    struct SortItem {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // Sorts the items by their keys (the order of the items with equal keys is kept).
+    // It is a least significant digit radix sort with 8-bit digits, so it costs O(N) and the digits that are the same
+    // for all the keys are skipped. "scratch" is a buffer for the intermediate passes (kept by the caller to avoid reallocations).
+    void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+}
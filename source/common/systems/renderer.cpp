@@ -0,0 +1,14 @@
+#include "renderer.hpp"
+#include "forward-renderer.hpp"
+#include "deferred-renderer.hpp"
+
+namespace our {
+
+    Renderer* Renderer::create(const nlohmann::json& config){
+        // The scenes without a renderer config get the forward renderer
+        std::string type = config.is_object() ? config.value<std::string>("type", "forward") : "forward";
+        if(type == "deferred") return new DeferredRenderer();
+        return new ForwardRenderer();
+    }
+
+}
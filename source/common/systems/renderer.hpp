@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "worker-pool.hpp"
+
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <cstddef>
+
+namespace our
+{
+
+    // The number of draws in the last frame rendered by a renderer
+    struct RenderStats {
+        size_t submitted = 0; // The number of mesh renderers found in the world
+        size_t culled = 0;    // The mesh renderers skipped since they are outside the camera frustum
+        size_t drawn = 0;     // The mesh renderers drawn (opaque + transparent)
+        size_t drawCalls = 0; // The draw calls issued (an instanced draw call draws many mesh renderers)
+        size_t streamWaits = 0; // The times the renderer waited for the GPU to release its stream buffer (since it was initialized)
+        size_t frameDataFallbacks = 0; // The frames whose frame block did not fit in the stream buffer (since it was initialized)
+        size_t globalLights = 0;    // The lights evaluated by every fragment (directional lights & lights without a range)
+        size_t clusteredLights = 0; // The lights evaluated only by the fragments of the clusters they reach
+        size_t clusterLightIndices = 0; // The number of (cluster, light) pairs in the light clusters
+        // The samples of the lit objects that pass the depth test of the depth pre-pass (those that would be shaded without it)
+        // and those shaded after it (only the visible ones). They are counted by queries, so they are a few frames old.
+        size_t prepassSamples = 0;
+        size_t shadedSamples = 0;
+    };
+
+    // The interface of the renderers that draw a world. The states hold a renderer through it, so the scene's
+    // "renderer" config picks the kind of renderer (see "create") without any change to the states.
+    class Renderer {
+    public:
+        virtual ~Renderer() = default;
+
+        // Initialize the renderer. windowSize is the width & height of the window (in pixels).
+        virtual void initialize(glm::ivec2 windowSize, const nlohmann::json& config) = 0;
+        // Clean up the renderer
+        virtual void destroy() = 0;
+        // This function should be called every frame to draw the given world
+        // If a worker pool is given, the renderer may use it to prepare the frame in parallel
+        virtual void render(World* world, WorkerPool* pool = nullptr) = 0;
+        // Returns the draw counts of the last rendered frame
+        virtual const RenderStats& getStats() const = 0;
+
+        // Creates the renderer named by the "type" of the config: "forward" (the default) or "deferred".
+        // The renderer is not initialized yet (call "initialize" with the same config).
+        static Renderer* create(const nlohmann::json& config);
+    };
+
+}
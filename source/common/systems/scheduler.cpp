@@ -0,0 +1,74 @@
+#include "scheduler.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+namespace our {
+
+    void SystemScheduler::add(const std::string& name, SystemAccess access, Update update){
+        systems.push_back({name, access, std::move(update)});
+        timings.push_back({name});
+        stagesDirty = true;
+    }
+
+    void SystemScheduler::clear(){
+        systems.clear();
+        timings.clear();
+        stages.clear();
+        stagesDirty = false;
+    }
+
+    // Puts each system in the first stage after the last stage holding a system it conflicts with
+    void SystemScheduler::buildStages(){
+        stages.clear();
+        std::vector<size_t> stageOf(systems.size());
+        for(size_t index = 0; index < systems.size(); ++index){
+            size_t stage = 0;
+            for(size_t previous = 0; previous < index; ++previous)
+                if(systems[index].access.conflictsWith(systems[previous].access))
+                    stage = std::max(stage, stageOf[previous] + 1);
+            stageOf[index] = stage;
+            if(stage >= stages.size()) stages.resize(stage + 1);
+            stages[stage].push_back(index);
+        }
+        stagesDirty = false;
+    }
+
+    void SystemScheduler::runSystem(size_t index, World* world, float deltaTime){
+        auto start = std::chrono::high_resolution_clock::now();
+        systems[index].update(world, deltaTime);
+        auto end = std::chrono::high_resolution_clock::now();
+        SystemTiming& timing = timings[index];
+        timing.lastMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        // An exponential moving average smooths the frame to frame noise
+        timing.averageMilliseconds = timing.averageMilliseconds == 0 ? timing.lastMilliseconds :
+                                     0.95 * timing.averageMilliseconds + 0.05 * timing.lastMilliseconds;
+    }
+
+    void SystemScheduler::run(World* world, float deltaTime){
+        if(stagesDirty) buildStages();
+        for(auto& stage : stages){
+            // Each stage gets its own change version, so a system which remembers the version of its last run sees the changes
+            // made by the systems of the other stages since then, but not its own changes (see "World::getChangeVersion")
+            world->advanceChangeVersion();
+            // A stage with a single system does not need the pool
+            if(stage.size() == 1){
+                runSystem(stage[0], world, deltaTime);
+                world->flushCommands();
+                continue;
+            }
+            WorkerPool::TaskGroup group;
+            for(size_t index : stage)
+                if(!systems[index].access.mainThread)
+                    pool->submit(group, [this, index, world, deltaTime](){ runSystem(index, world, deltaTime); });
+            // The main thread systems run here while the others run on the workers
+            for(size_t index : stage)
+                if(systems[index].access.mainThread)
+                    runSystem(index, world, deltaTime);
+            pool->wait(group);
+            // The end of a stage is a sync point: the structural changes recorded by its systems are applied before the next stage
+            world->flushCommands();
+        }
+    }
+
+}
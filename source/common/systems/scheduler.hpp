@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "worker-pool.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace our {
+
+    // Declares which data a system reads and writes.
+    // The component types are given as template arguments. "Transform" can also be used since it is stored in the entities
+    // instead of a pool, e.g. SystemAccess().read<MovementComponent>().write<Transform>()
+    // Two systems conflict if one of them writes a type that the other reads or writes. Conflicting systems never run at the same time.
+    struct SystemAccess {
+        ComponentMask reads = 0;
+        ComponentMask writes = 0;
+        bool mainThread = false; // If true, the system always runs on the thread that runs the scheduler (e.g. it uses the window or OpenGL)
+
+        template<typename... T>
+        SystemAccess& read() { reads |= componentMask<T...>(); return *this; }
+        template<typename... T>
+        SystemAccess& write() { writes |= componentMask<T...>(); return *this; }
+        SystemAccess& onMainThread() { mainThread = true; return *this; }
+
+        bool conflictsWith(const SystemAccess& other) const {
+            return (writes & (other.reads | other.writes)) != 0 || (other.writes & reads) != 0;
+        }
+    };
+
+    // The time taken by a system in the last frame and its running average (in milliseconds)
+    struct SystemTiming {
+        std::string name;
+        double lastMilliseconds = 0;
+        double averageMilliseconds = 0;
+    };
+
+    // The scheduler runs the systems of a world every frame.
+    // The systems are grouped in stages in the order they were added: a system goes to the first stage after the last stage
+    // holding a system it conflicts with. So conflicting systems still run in the order in which they were added,
+    // while the systems of the same stage run concurrently on the worker pool.
+    // Systems can also split their own work across the pool using "parallelFor" (e.g. to process a big query in chunks).
+    // The change version of the world is advanced before each stage, so the systems can skip what did not change since their last run.
+    // WARNING: Systems running concurrently must not change the structure of the world (create or delete entities and components,
+    // or request a view for the first time). Such changes should be recorded in the world's command buffer ("World::getCommands")
+    // which is flushed after each stage, so the systems of the next stage see them.
+    class SystemScheduler {
+    public:
+        using Update = std::function<void(World* world, float deltaTime)>;
+
+    private:
+        struct System {
+            std::string name;
+            SystemAccess access;
+            Update update;
+        };
+
+        WorkerPool* pool;
+        std::vector<System> systems;
+        std::vector<SystemTiming> timings;      // timings[i] is the timing of systems[i]
+        std::vector<std::vector<size_t>> stages; // The indices of the systems in each stage
+        bool stagesDirty = false;
+
+        void buildStages();
+        void runSystem(size_t index, World* world, float deltaTime);
+
+    public:
+        explicit SystemScheduler(WorkerPool& pool) : pool(&pool) {}
+
+        // Adds a system. The systems are run (stage by stage) every time "run" is called.
+        void add(const std::string& name, SystemAccess access, Update update);
+        // Removes all the systems
+        void clear();
+        // Runs all the systems once. It must be called from the main thread.
+        void run(World* world, float deltaTime);
+
+        // Splits [0, count) into chunks and processes them on the worker pool (see "WorkerPool::parallelFor")
+        void parallelFor(size_t count, size_t minChunkSize, const std::function<void(size_t begin, size_t end)>& body){
+            pool->parallelFor(count, minChunkSize, body);
+        }
+
+        // Returns the time taken by each system (in the order they were added)
+        const std::vector<SystemTiming>& getTimings() const { return timings; }
+        // Returns the number of stages (the systems in a stage run concurrently)
+        size_t getStageCount() { if(stagesDirty) buildStages(); return stages.size(); }
+
+        WorkerPool& getPool() { return *pool; }
+    };
+
+}
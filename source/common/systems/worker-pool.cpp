@@ -0,0 +1,89 @@
+#include "worker-pool.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    size_t WorkerPool::defaultWorkerCount(){
+        size_t hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 2 ? hardwareThreads - 1 : 1;
+    }
+
+    WorkerPool::WorkerPool(size_t workerCount){
+        workers.reserve(workerCount);
+        for(size_t index = 0; index < workerCount; ++index)
+            workers.emplace_back([this](){ workerLoop(); });
+    }
+
+    WorkerPool::~WorkerPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for(auto& worker : workers) worker.join();
+    }
+
+    bool WorkerPool::runOne(){
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(jobs.empty()) return false;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job.work();
+        job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void WorkerPool::workerLoop(){
+        while(true){
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this](){ return stopping || !jobs.empty(); });
+                if(jobs.empty()) return; // The pool is stopping and no job is left
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job.work();
+            job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void WorkerPool::submit(TaskGroup& group, std::function<void()> work){
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({std::move(work), &group});
+        }
+        available.notify_one();
+    }
+
+    void WorkerPool::wait(TaskGroup& group){
+        // Instead of sleeping, the waiting thread helps with the queued jobs (which may belong to other groups)
+        while(group.pending.load(std::memory_order_acquire) > 0){
+            if(!runOne()) std::this_thread::yield();
+        }
+    }
+
+    void WorkerPool::parallelFor(size_t count, size_t minChunkSize, const std::function<void(size_t begin, size_t end)>& body){
+        if(count == 0) return;
+        // A few chunks per thread keeps the threads busy even if some chunks take longer than others
+        size_t chunkSize = std::max<size_t>(std::max<size_t>(minChunkSize, 1), (count + getThreadCount() * 4 - 1) / (getThreadCount() * 4));
+        if(chunkSize >= count){
+            body(0, count);
+            return;
+        }
+        TaskGroup group;
+        // The first chunk is processed by the calling thread
+        for(size_t begin = chunkSize; begin < count; begin += chunkSize){
+            size_t end = std::min(begin + chunkSize, count);
+            submit(group, [&body, begin, end](){ body(begin, end); });
+        }
+        body(0, chunkSize);
+        wait(group);
+    }
+
+}
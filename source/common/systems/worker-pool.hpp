@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace our {
+
+    // A worker pool owns a fixed set of threads that run jobs submitted from any thread.
+    // Jobs are grouped in task groups so that the submitter can wait for a group to finish.
+    // While waiting, the waiting thread runs queued jobs itself, so jobs can safely submit & wait for other jobs
+    // (e.g. a system running on a worker can split its query into chunks) without deadlocking the pool.
+    class WorkerPool {
+    public:
+        // A set of jobs that can be waited on (see "submit" & "wait")
+        class TaskGroup {
+            std::atomic<size_t> pending{0};
+            friend WorkerPool;
+        public:
+            TaskGroup() = default;
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+        };
+
+    private:
+        struct Job {
+            std::function<void()> work;
+            TaskGroup* group;
+        };
+
+        std::vector<std::thread> workers;
+        std::deque<Job> jobs;              // The jobs waiting for a thread
+        std::mutex mutex;                  // Guards "jobs" & "stopping"
+        std::condition_variable available; // Notified when a job is queued (or when the pool is stopping)
+        bool stopping = false;
+
+        // Pops and runs one queued job (if any). Returns false if the queue was empty.
+        bool runOne();
+        void workerLoop();
+
+    public:
+        // Creates a pool with the given number of worker threads
+        // By default, one worker is created for each hardware thread except the one running the main loop
+        explicit WorkerPool(size_t workerCount = defaultWorkerCount());
+        ~WorkerPool();
+
+        // Returns the number of hardware threads minus one (at least 1)
+        static size_t defaultWorkerCount();
+        // Returns the number of threads that can run jobs at the same time (the workers and the thread that waits)
+        size_t getThreadCount() const { return workers.size() + 1; }
+
+        // Queues a job in the given group
+        void submit(TaskGroup& group, std::function<void()> work);
+        // Waits until all the jobs in the group are done (running queued jobs in the meantime)
+        void wait(TaskGroup& group);
+
+        // Calls body(begin, end) over chunks covering [0, count) and returns when all the chunks are done.
+        // The chunks hold at least "minChunkSize" items, so small ranges are processed by the calling thread alone.
+        void parallelFor(size_t count, size_t minChunkSize, const std::function<void(size_t begin, size_t end)>& body);
+
+        // The pool should not be copyable
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+    };
+
+}
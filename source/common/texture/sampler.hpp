@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../gl-state-cache.hpp"
+
 #include <glad/gl.h>
 #include <json/json.hpp>
 #include <glm/vec4.hpp>
@@ -22,19 +24,20 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL sampler
         ~Sampler() { 
             //TODO: (Req 6) Complete this function
+            GLStateCache::forgetSampler(name);
             glDeleteSamplers(1, &name);
          }
 
         // This method binds this sampler to the given texture unit
         void bind(GLuint textureUnit) const {
             //TODO: (Req 6) Complete this function
-            glBindSampler(textureUnit, name);
+            GLStateCache::bindSampler(textureUnit, name);
         }
 
         // This static method ensures that no sampler is bound to the given texture unit
         static void unbind(GLuint textureUnit){
             //TODO: (Req 6) Complete this function
-            glBindSampler(textureUnit, 0);
+            GLStateCache::bindSampler(textureUnit, 0);
         }
 
         // This function sets a sampler paramter where the value is of type "GLint"
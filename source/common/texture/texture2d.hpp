@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../gl-state-cache.hpp"
+
 #include <glad/gl.h>
 
 namespace our {
@@ -20,6 +22,7 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL texture
         ~Texture2D() { 
             //TODO: (Req 5) Complete this function
+            GLStateCache::forgetTexture(name);
             glDeleteTextures(1, &name);
         }
 
@@ -28,16 +31,16 @@ namespace our {
             return name;
         }
 
-        // This method binds this texture to GL_TEXTURE_2D
+        // This method binds this texture to GL_TEXTURE_2D (of the active texture unit)
         void bind() const {
             //TODO: (Req 5) Complete this function
-            glBindTexture(GL_TEXTURE_2D, name);
+            GLStateCache::bindTexture2D(name);
         }
 
         // This static method ensures that no texture is bound to GL_TEXTURE_2D
         static void unbind(){
             //TODO: (Req 5) Complete this function
-            glBindTexture(GL_TEXTURE_2D, 0); // not sure
+            GLStateCache::bindTexture2D(0);
         }
 
         Texture2D(const Texture2D&) = delete;
@@ -19,6 +19,11 @@
 #include "states/material-test-state.hpp"
 #include "states/entity-test-state.hpp"
 #include "states/renderer-test-state.hpp"
+#include "states/command-buffer-test-state.hpp"
+#include "states/ecs-benchmark-state.hpp"
+#include "states/spatial-benchmark-state.hpp"
+#include "states/culling-benchmark-state.hpp"
+#include "states/renderer-benchmark-state.hpp"
 
 int main(int argc, char** argv) {
     
@@ -60,6 +65,11 @@ int main(int argc, char** argv) {
     app.registerState<MaterialTestState>("material-test");
     app.registerState<EntityTestState>("entity-test");
     app.registerState<RendererTestState>("renderer-test");
+    app.registerState<CommandBufferTestState>("command-buffer-test");
+    app.registerState<ECSBenchmarkState>("ecs-benchmark");
+    app.registerState<SpatialBenchmarkState>("spatial-benchmark");
+    app.registerState<CullingBenchmarkState>("culling-benchmark");
+    app.registerState<RendererBenchmarkState>("renderer-benchmark");
     // Then choose the state to run based on the option "start-scene" in the config
     if(app_config.contains(std::string{"start-scene"})){
         app.changeState(app_config["start-scene"].get<std::string>());        
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <application.hpp>
+
+#include <chrono>
+#include <string>
+#include <iostream>
+
+// The base of the states that compare two versions of the same work (a baseline & an optimized version).
+// A benchmark reads its options from the "scene" of the app config, runs once in onInitialize and prints its results
+// to the console, then the application is closed by the first onDraw.
+// The passes add what they find to checksums which are printed with the results, so the compiler can not optimize them away.
+class BenchmarkState: public our::State {
+protected:
+    // Prints a line that compares the times of a pass: "name: baseline X unit, optimized Y unit (Zx)"
+    struct Report {
+        std::string baseline, optimized; // The names of the two versions
+        std::string unit;
+        std::string indent = "    ";
+
+        void operator()(const std::string& name, double baselineTime, double optimizedTime) const {
+            std::cout << indent << name << ": " << baseline << " " << baselineTime << " " << unit << ", " << optimized << " "
+                      << optimizedTime << " " << unit << " (" << baselineTime / optimizedTime << "x)" << std::endl;
+        }
+    };
+
+    // Runs "pass" "repetitions" times and returns the average time per item (in the unit given by "Period": nanoseconds by default),
+    // where "count" is the number of items (e.g. components or queries) processed by each run
+    template<typename Period = std::nano, typename Pass>
+    static double measure(size_t count, Pass pass, int repetitions = 1){
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int repetition = 0; repetition < repetitions; ++repetition) pass();
+        auto end = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double, Period>(end - start).count();
+        return time / (double(repetitions > 0 ? repetitions : 1) * double(count > 0 ? count : 1));
+    }
+
+    // The options of the benchmark
+    const nlohmann::json& getBenchmarkConfig() { return getApp()->getConfig()["scene"]; }
+
+    void onDraw(double deltaTime) override {
+        getApp()->close();
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <application.hpp>
+#include <ecs/world.hpp>
+#include <components/movement.hpp>
+
+#include <thread>
+#include <string>
+#include <iostream>
+
+// This state tests that a flush of the world's command buffer applies the commands recorded while it is flushed.
+// The setups of the created entities run on the flushing thread, so the commands they record go to the queue of that thread,
+// which may come before the queue being applied. For every round in the config, the main thread records into its queue
+// first, then a worker thread records creations whose setups record more creations & components on the main thread's queue.
+// The results are printed to the console then the application is closed.
+class CommandBufferTestState: public our::State {
+
+    void onInitialize() override {
+        auto& config = getApp()->getConfig()["scene"];
+        int rounds = config.value("rounds", 3);
+        int creations = config.value("creations", 16);
+
+        our::World world;
+        our::CommandBuffer& commands = world.getCommands();
+        bool passed = true;
+        for(int round = 0; round < rounds; ++round){
+            // The main thread records first, so its queue comes before the worker's queue
+            commands.create();
+            std::thread worker([&](){
+                for(int index = 0; index < creations; ++index){
+                    commands.create([&commands](our::Entity*){
+                        // This runs on the main thread while the worker's queue is applied
+                        our::CommandBuffer::PendingEntity child = commands.create();
+                        commands.addComponent<our::MovementComponent>(child, [](our::MovementComponent& movement){
+                            movement.linearVelocity = {0, 1, 0};
+                        });
+                    });
+                }
+            });
+            worker.join();
+            world.flushCommands();
+
+            // Every round adds the main thread's entity, the worker's entities & a moving child for each of them
+            size_t expectedEntities = size_t(round + 1) * size_t(1 + 2 * creations);
+            size_t expectedMoving = size_t(round + 1) * size_t(creations);
+            size_t entityCount = world.getEntities().size();
+            size_t movingCount = world.getComponents<our::MovementComponent>().size();
+            bool roundPassed = entityCount == expectedEntities && movingCount == expectedMoving;
+            for(auto& movement : world.getComponents<our::MovementComponent>())
+                roundPassed = roundPassed && movement.linearVelocity.y == 1.0f;
+            std::cout << "Command buffer test round " << round << ": " << entityCount << " / " << expectedEntities << " entities, "
+                      << movingCount << " / " << expectedMoving << " moving (" << (roundPassed ? "passed" : "FAILED") << ")" << std::endl;
+            passed = passed && roundPassed;
+        }
+        std::cout << "Command buffer test " << (passed ? "passed" : "FAILED") << std::endl;
+        world.clear();
+    }
+
+    void onDraw(double deltaTime) override {
+        getApp()->close();
+    }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "benchmark-state.hpp"
+#include <ecs/world.hpp>
+#include <components/mesh-renderer.hpp>
+#include <components/movement.hpp>
+#include <systems/movement.hpp>
+#include <mesh/mesh-utils.hpp>
+#include <ecs/transform-kernel.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include <random>
+#include <iostream>
+
+// This state measures how the visibility & spatial queries on renderable entities scale with the size of the world.
+// For every object count in the config, it scatters mesh renderers in a cube and compares brute force tests over all the
+// objects (the vectorized sphere test of the renderer, and a loop over the boxes) against the world's bounds hierarchy for
+// frustum culling, ray casts and box overlap queries. It also measures the cost of keeping the hierarchy up to date
+// while some of the objects move (refits and the occasional rebuild) and the cost of a full rebuild.
+// The times are given in microseconds per frame, ray or box.
+class CullingBenchmarkState: public BenchmarkState {
+
+    // The data read by the brute force frustum test (laid out like the render commands)
+    struct CullingCommand {
+        glm::mat4 localToWorld;
+        glm::vec4 boundingSphere;
+        float cullingMargin;
+    };
+
+    void onInitialize() override {
+        auto& config = getBenchmarkConfig();
+        std::vector<int> objectCounts = config.value("objects", std::vector<int>{1000, 10000, 100000});
+        int frames = config.value("frames", 100);
+        int rayCount = config.value("rays", 1000);
+        int boxCount = config.value("boxes", 1000);
+        float density = config.value("density", 0.05f); // The number of objects per cubic unit
+        float movingFraction = config.value("moving", 0.01f); // The fraction of the objects that move every frame
+        const float deltaTime = 1.0f / 60.0f;
+
+        our::Mesh* mesh = our::mesh_utils::sphere(glm::ivec2(8, 8));
+        our::MovementSystem movementSystem;
+        std::mt19937 random(42);
+        const Report report{"brute force", "hierarchy", "us"};
+
+        std::cout << "Culling benchmark (" << frames << " frames, " << rayCount << " rays, " << boxCount << " boxes)" << std::endl;
+
+        for(int objectCount : objectCounts){
+            // The volume grows with the object count so the camera sees about the same number of objects
+            float extent = 0.5f * std::cbrt(float(objectCount) / density);
+            std::uniform_real_distribution<float> coordinate(-extent, extent);
+            std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+            our::World world;
+            int movingCount = 0;
+            for(int index = 0; index < objectCount; ++index){
+                our::Entity* entity = world.add();
+                entity->localTransform.position = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+                entity->localTransform.rotation = glm::vec3(angle(random), angle(random), angle(random));
+                entity->localTransform.scale = glm::vec3(0.5f + 0.5f * (unit(random) + 1.0f));
+                entity->addComponent<our::MeshRendererComponent>()->mesh = mesh;
+                if(index < objectCount * movingFraction){
+                    auto movement = entity->addComponent<our::MovementComponent>();
+                    movement->linearVelocity = glm::vec3(unit(random), unit(random), unit(random));
+                    movement->angularVelocity = glm::vec3(0, 90, 0);
+                    ++movingCount;
+                }
+            }
+            double initialUpdate = measure<std::micro>(1, [&](){ world.updateTransforms(); });
+            const our::BoundingVolumeHierarchy& hierarchy = world.getBoundsHierarchy();
+
+            // The cameras look at random points of the cube from random points of the cube
+            std::vector<glm::mat4> viewProjections(frames);
+            glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, extent);
+            for(auto& viewProjection : viewProjections){
+                glm::vec3 eye = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+                glm::vec3 target = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+                viewProjection = projection * glm::lookAt(eye, target, glm::vec3(0, 1, 0));
+            }
+
+            size_t bruteForceChecksum = 0, hierarchyChecksum = 0;
+
+            // Pass 1: Frustum culling (the brute force version is the one used by the renderer before the hierarchy)
+            std::vector<CullingCommand> commands;
+            std::vector<our::Entity*> visible;
+            double bruteForceCulling = measure<std::micro>(viewProjections.size(), [&](){
+                for(auto& viewProjection : viewProjections){
+                    glm::vec4 planes[6];
+                    our::extractFrustumPlanes(viewProjection, planes);
+                    commands.clear();
+                    for(auto& meshRenderer : world.getComponents<our::MeshRendererComponent>())
+                        commands.push_back({meshRenderer.getOwner()->getLocalToWorldMatrix(), meshRenderer.mesh->getBoundingSphere(), 0});
+                    if(!commands.empty()) our::computeCullingMargins(planes, commands.size(), sizeof(CullingCommand),
+                                                                     &commands[0].localToWorld, &commands[0].boundingSphere, &commands[0].cullingMargin);
+                    for(auto& command : commands) bruteForceChecksum += command.cullingMargin >= 0.0f;
+                }
+            });
+            double hierarchyCulling = measure<std::micro>(viewProjections.size(), [&](){
+                for(auto& viewProjection : viewProjections){
+                    glm::vec4 planes[6];
+                    our::extractFrustumPlanes(viewProjection, planes);
+                    visible.clear();
+                    hierarchy.queryFrustum(planes, visible);
+                    hierarchyChecksum += visible.size();
+                }
+            });
+
+            // The brute force versions of the ray & box queries read the boxes of the leaves from a packed array
+            std::vector<std::pair<our::AABB, our::Entity*>> boxes;
+            boxes.reserve(objectCount);
+            for(auto& meshRenderer : world.getComponents<our::MeshRendererComponent>()){
+                our::Entity* entity = meshRenderer.getOwner();
+                boxes.emplace_back(our::AABB(mesh->getBoundsMin(), mesh->getBoundsMax()).transformed(entity->getLocalToWorldMatrix()), entity);
+            }
+
+            // Pass 2: Ray casts (find the first box hit by each ray)
+            std::vector<std::pair<glm::vec3, glm::vec3>> rays(rayCount);
+            for(auto& [origin, direction] : rays){
+                origin = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+                direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.001f));
+            }
+            double bruteForceRays = measure<std::micro>(rays.size(), [&](){
+                for(auto& [origin, direction] : rays){
+                    glm::vec3 inverseDirection = 1.0f / direction;
+                    float nearest = INFINITY, distance;
+                    for(auto& [box, entity] : boxes)
+                        if(box.intersectRay(origin, inverseDirection, nearest, distance) && distance < nearest) nearest = distance;
+                    bruteForceChecksum += nearest < INFINITY;
+                }
+            });
+            double hierarchyRays = measure<std::micro>(rays.size(), [&](){
+                for(auto& [origin, direction] : rays)
+                    hierarchyChecksum += hierarchy.raycast(origin, direction).entity != nullptr;
+            });
+
+            // Pass 3: Overlap queries (collect the boxes overlapping a box of 4x4x4 units)
+            std::vector<our::AABB> queries(boxCount);
+            for(auto& query : queries){
+                glm::vec3 center = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+                query = our::AABB(center - 2.0f, center + 2.0f);
+            }
+            std::vector<our::Entity*> results;
+            double bruteForceOverlaps = measure<std::micro>(queries.size(), [&](){
+                for(auto& query : queries){
+                    results.clear();
+                    for(auto& [box, entity] : boxes) if(box.overlaps(query)) results.push_back(entity);
+                    bruteForceChecksum += results.size();
+                }
+            });
+            double hierarchyOverlaps = measure<std::micro>(queries.size(), [&](){
+                for(auto& query : queries){
+                    results.clear();
+                    hierarchy.queryOverlaps(query, results);
+                    hierarchyChecksum += results.size();
+                }
+            });
+
+            // Pass 4: Keeping the hierarchy up to date while some objects move (the update includes composing their transforms)
+            double movingUpdate = measure<std::micro>(frames, [&](){
+                for(int frame = 0; frame < frames; ++frame){
+                    movementSystem.update(&world, deltaTime);
+                    world.updateTransforms();
+                }
+            });
+            int depth = hierarchy.getDepth();
+            double rebuild = measure<std::micro>(1, [&](){ world.rebuildBoundsHierarchy(); });
+
+            std::cout << "  " << objectCount << " objects (" << movingCount << " moving, depth " << depth << ")" << std::endl;
+            report("Frustum culling", bruteForceCulling, hierarchyCulling);
+            report("Ray cast", bruteForceRays, hierarchyRays);
+            report("Box overlap", bruteForceOverlaps, hierarchyOverlaps);
+            std::cout << "    First update (builds the hierarchy): " << initialUpdate << " us, update per frame: "
+                      << movingUpdate << " us, full rebuild: " << rebuild << " us" << std::endl;
+            std::cout << "    Checksums: " << bruteForceChecksum << " / " << hierarchyChecksum << std::endl;
+
+            world.clear();
+        }
+
+        delete mesh;
+    }
+};
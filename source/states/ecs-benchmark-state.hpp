@@ -0,0 +1,165 @@
+#pragma once
+
+#include "benchmark-state.hpp"
+#include <ecs/world.hpp>
+#include <components/mesh-renderer.hpp>
+#include <components/movement.hpp>
+#include <systems/forward-renderer.hpp>
+#include <ecs/transform-kernel.hpp>
+#include <ecs/prefab.hpp>
+
+#include <list>
+#include <unordered_set>
+#include <vector>
+#include <iostream>
+
+// This state measures how fast the systems can iterate over the components of a big world.
+// It compares the world's packed component pools against the previous layout in which every entity owned
+// a list of individually allocated components and the world kept its entities in a hash set.
+// It also measures how fast entities can be spawned from json compared to instantiating a prefab.
+// The legacy & pooled times are given per component.
+class ECSBenchmarkState: public BenchmarkState {
+
+    // A replica of the previous entity layout which is used as the baseline of the benchmark
+    struct LegacyEntity {
+        std::list<our::Component*> components;
+        our::Transform localTransform;
+
+        template<typename T>
+        T* getComponent(){
+            for(auto component : components)
+                if(auto casted = dynamic_cast<T*>(component); casted) return casted;
+            return nullptr;
+        }
+
+        ~LegacyEntity(){ for(auto component : components) delete component; }
+    };
+
+    void onInitialize() override {
+        auto& config = getBenchmarkConfig();
+        int entityCount = config.value("entities", 50000);
+        int iterations = config.value("iterations", 100);
+        int spawnCount = config.value("spawn", 10000);
+        const float deltaTime = 1.0f / 60.0f;
+
+        // Create the same entities in both layouts: every entity has a mesh renderer and every other entity can move
+        std::unordered_set<LegacyEntity*> legacyEntities;
+        our::World world;
+        for(int index = 0; index < entityCount; ++index){
+            glm::vec3 position = glm::vec3(float(index % 100), 0.0f, float(index / 100));
+
+            auto legacy = new LegacyEntity();
+            legacy->localTransform.position = position;
+            legacy->components.push_back(new our::MeshRendererComponent());
+            if(index % 2 == 0){
+                auto movement = new our::MovementComponent();
+                movement->linearVelocity = {0, 1, 0};
+                legacy->components.push_back(movement);
+            }
+            legacyEntities.insert(legacy);
+
+            our::Entity* entity = world.add();
+            entity->localTransform.position = position;
+            entity->addComponent<our::MeshRendererComponent>();
+            if(index % 2 == 0){
+                entity->addComponent<our::MovementComponent>()->linearVelocity = {0, 1, 0};
+            }
+        }
+        size_t movingCount = world.getComponents<our::MovementComponent>().size();
+
+        float legacyChecksum = 0, pooledChecksum = 0;
+
+        // Pass 1: Visit every mesh renderer and read its owner position (similar to what the renderer does)
+        double legacyRender = measure(entityCount, [&](){
+            for(auto entity : legacyEntities)
+                if(entity->getComponent<our::MeshRendererComponent>())
+                    legacyChecksum += entity->localTransform.position.x;
+        }, iterations);
+        double pooledRender = measure(entityCount, [&](){
+            for(auto& meshRenderer : world.getComponents<our::MeshRendererComponent>())
+                pooledChecksum += meshRenderer.getOwner()->localTransform.position.x;
+        }, iterations);
+
+        // Pass 2: Integrate the movement of every moving entity (similar to what the movement system does)
+        double legacyMovement = measure(movingCount, [&](){
+            for(auto entity : legacyEntities)
+                if(auto movement = entity->getComponent<our::MovementComponent>(); movement)
+                    entity->localTransform.position += deltaTime * movement->linearVelocity;
+        }, iterations);
+        double pooledMovement = measure(movingCount, [&](){
+            for(auto& movement : world.getComponents<our::MovementComponent>())
+                movement.getOwner()->localTransform.position += deltaTime * movement.linearVelocity;
+        }, iterations);
+
+        // Pass 3: Compute the matrices needed to draw every entity after they moved (similar to what the renderer does)
+        // The legacy version composes the euler angles and inverts the matrix per entity while the batched version
+        // uses the cached quaternions and the transform kernel
+        glm::mat4 VP = glm::mat4(1.0f);
+        float legacyMatrixChecksum = 0, batchedMatrixChecksum = 0;
+        double legacyTransform = measure(entityCount, [&](){
+            for(auto entity : legacyEntities){
+                entity->localTransform.position.y += deltaTime;
+                glm::mat4 M = entity->localTransform.toMat4();
+                glm::mat4 normalMatrix = glm::transpose(glm::inverse(M));
+                glm::mat4 MVP = VP * M;
+                legacyMatrixChecksum += MVP[3][1] + normalMatrix[1][1];
+            }
+        }, iterations);
+        std::vector<our::Entity*> entities(world.getEntities().begin(), world.getEntities().end());
+        std::vector<our::RenderCommand> commands(entities.size());
+        double batchedTransform = measure(entityCount, [&](){
+            for(auto entity : entities) entity->localTransform.position.y += deltaTime;
+            world.updateTransforms();
+            for(size_t index = 0; index < entities.size(); ++index) commands[index].localToWorld = entities[index]->getLocalToWorldMatrix();
+            if(!commands.empty()) our::computeDrawMatrices(VP, commands.size(), sizeof(our::RenderCommand),
+                                                           &commands[0].localToWorld, &commands[0].localToClip, &commands[0].normalMatrix);
+            for(auto& command : commands) batchedMatrixChecksum += command.localToClip[3][1] + command.normalMatrix[1][1];
+        }, iterations);
+
+        // Pass 4: Spawn many torches (like the ones of the game scene) by deserializing the json of every torch
+        // then by instantiating a prefab compiled from the same json
+        nlohmann::json torchData = nlohmann::json::parse(R"({
+            "name": "torch",
+            "scale": [0.2, 0.2, 0.2],
+            "components": [
+                { "type": "Mesh Renderer", "mesh": "monkey", "material": "fire" },
+                { "type": "Movement", "angularVelocity": [0, 45, 0] },
+                { "type": "Light", "diffuse": [10, 10, 10], "specular": [0, 0, 0], "ambient": [10, 10, 10], "light_type": "point",
+                  "color": [1, 0.5, 0.8], "attenuation": [0, 0.15, 0], "enabled": false }
+            ]
+        })");
+        nlohmann::json torchesData = nlohmann::json::array();
+        std::vector<our::Transform> torchTransforms(spawnCount);
+        for(int index = 0; index < spawnCount; ++index){
+            glm::vec3 position = glm::vec3(float(index % 100), 2.5f, float(index / 100));
+            torchesData.push_back(torchData);
+            torchesData.back()["position"] = {position.x, position.y, position.z};
+            torchTransforms[index].position = position;
+            torchTransforms[index].scale = glm::vec3(0.2f);
+        }
+        our::World spawnWorld;
+        double jsonSpawn = measure(1, [&](){ spawnWorld.deserialize(torchesData); }) / 1e6;
+        spawnWorld.clear();
+        our::Prefab torch;
+        double prefabSpawn = measure(1, [&](){
+            torch.deserialize(torchData);
+            spawnWorld.instantiate(torch, torchTransforms);
+        }) / 1e6;
+        size_t spawnedLights = spawnWorld.getComponents<our::LightComponent>().size();
+        spawnWorld.clear();
+
+        const Report report{"legacy", "pooled", "ns/component", "  "};
+        std::cout << "ECS iteration benchmark (" << entityCount << " entities, " << iterations << " iterations)" << std::endl;
+        report("Mesh renderer pass", legacyRender, pooledRender);
+        report("Movement pass", legacyMovement, pooledMovement);
+        std::cout << "  Transform kernel: " << our::getTransformKernelName() << std::endl;
+        report("Transform pass", legacyTransform, batchedTransform);
+        std::cout << "  Matrix checksums: " << legacyMatrixChecksum << " / " << batchedMatrixChecksum << std::endl;
+        std::cout << "  Checksums: " << legacyChecksum << " / " << pooledChecksum << std::endl;
+        std::cout << "  Spawning " << spawnCount << " torches: json " << jsonSpawn << " ms, prefab " << prefabSpawn
+                  << " ms (" << jsonSpawn / prefabSpawn << "x, " << spawnedLights << " lights)" << std::endl;
+
+        for(auto entity : legacyEntities) delete entity;
+        world.clear();
+    }
+};
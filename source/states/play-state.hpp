@@ -3,10 +3,12 @@
 #include <application.hpp>
 #include "components/light.hpp"
 #include <ecs/world.hpp>
-#include <systems/forward-renderer.hpp>
+#include <systems/renderer.hpp>
 #include <systems/free-camera-controller.hpp>
 #include <systems/movement.hpp>
+#include <systems/scheduler.hpp>
 #include <asset-loader.hpp>
+#include <gl-state-cache.hpp>
 #include "components/mesh-renderer.hpp"
 #include "components/camera.hpp"
 #include "components/free-camera-controller.hpp"
@@ -17,9 +19,14 @@ class Playstate : public our::State
 {
 
     our::World world;
-    our::ForwardRenderer renderer;
+    // The renderer picked by the scene's renderer config (see "Renderer::create")
+    our::Renderer *renderer = nullptr;
     our::FreeCameraControllerSystem cameraController;
     our::MovementSystem movementSystem;
+    // The systems are run by the scheduler which runs the non conflicting systems in parallel on the worker pool
+    our::WorkerPool workers;
+    our::SystemScheduler scheduler{workers};
+    bool showSystemTimings = false; // Toggled with F3
     float time;
 
     void onInitialize() override
@@ -40,32 +47,82 @@ class Playstate : public our::State
         cameraController.enter(getApp());
         // Then we initialize the renderer
         auto size = getApp()->getFrameBufferSize();
-        renderer.initialize(size, config["renderer"]);
+        renderer = our::Renderer::create(config["renderer"]);
+        renderer->initialize(size, config["renderer"]);
         pickUpText = this->getPickUpText();
         pickUpText->localTransform.position.y = -10;
         cameraEntity = getCamera();
         initializeObjectiveItems();
         initializeCounterDisplay();
-        initializeTorchLocations();
+        initializeSystems();
+        // The transforms are updated once so the spatial grid can answer the queries of the first frame
+        world.updateTransforms();
+        showSystemTimings = config.value("showSystemTimings", false);
         time = 0;
     }
 
+    // Registers the systems in the order they should run, along with the data they read & write
+    void initializeSystems()
+    {
+        scheduler.clear();
+        scheduler.add("Movement", our::SystemAccess().read<our::MovementComponent>().write<our::Transform>(),
+            [this](our::World *world, float deltaTime) { movementSystem.update(world, deltaTime, &workers); });
+        // The camera controller reads the input and locks the mouse, so it has to run on the main thread
+        scheduler.add("Camera Controller", our::SystemAccess().read<our::CameraComponent, our::FreeCameraControllerComponent>().write<our::Transform>().onMainThread(),
+            [this](our::World *world, float deltaTime) { cameraController.update(world, deltaTime); });
+        // The game logic reads the input and changes the application state, so it has to run on the main thread too
+        scheduler.add("Gameplay", our::SystemAccess().write<our::Transform, our::LightComponent, our::MovementComponent>().onMainThread(),
+            [this](our::World *world, float deltaTime) {
+                this->checkItemFound();
+                this->checkPlayerWin();
+                this->onStaircase();
+                this->lightTorch();
+                this->hideCeiling();
+                this->playFootSteps();
+            });
+    }
+
+    void onImmediateGui() override
+    {
+        if (!showSystemTimings)
+            return;
+        // Shows the time taken by each system (the timings are those of the previous frame)
+        ImGui::Begin("System Timings");
+        ImGui::Text("Threads: %d, Stages: %d", (int)workers.getThreadCount(), (int)scheduler.getStageCount());
+        for (auto &timing : scheduler.getTimings())
+            ImGui::Text("%s: %.3f ms (avg %.3f ms)", timing.name.c_str(), timing.lastMilliseconds, timing.averageMilliseconds);
+        // The draw counts of the renderer (the meshes outside the camera frustum are culled)
+        const our::RenderStats &stats = renderer->getStats();
+        ImGui::Text("Meshes: %d drawn, %d culled (of %d)", (int)stats.drawn, (int)stats.culled, (int)stats.submitted);
+        ImGui::Text("Draw calls: %d", (int)stats.drawCalls);
+        // The frames that had to wait for the GPU to finish reading the data of an older frame
+        ImGui::Text("Stream buffer waits: %d", (int)stats.streamWaits);
+        // The frames whose frame block went through the fallback buffer since the stream buffer was full
+        ImGui::Text("Frame block fallbacks: %d", (int)stats.frameDataFallbacks);
+        // The lights evaluated by every fragment and those only evaluated by the fragments of the clusters they reach
+        ImGui::Text("Lights: %d global, %d clustered (%d cluster entries)", (int)stats.globalLights, (int)stats.clusteredLights, (int)stats.clusterLightIndices);
+        // The samples whose depth is written by the pre-pass and those that are actually shaded after it
+        if(stats.prepassSamples > 0)
+            ImGui::Text("Depth pre-pass: %d of %d samples shaded (%.0f%% saved)", (int)stats.shadedSamples, (int)stats.prepassSamples,
+                        100.0 * (1.0 - double(stats.shadedSamples) / double(stats.prepassSamples)));
+        // The state changes that reached OpenGL and those dropped by the state cache since they would not change anything
+        const our::GLStateStats &stateStats = our::GLStateCache::getStats();
+        ImGui::Text("GL state calls: %d issued, %d skipped", (int)stateStats.issued, (int)stateStats.skipped);
+        ImGui::End();
+    }
+
     void onDraw(double deltaTime) override
     {
         // Here, we just run a bunch of systems to control the world logic
-        movementSystem.update(&world, (float)deltaTime);
-        cameraController.update(&world, (float)deltaTime);
-        // And finally we use the renderer system to draw the scene
-        this->checkItemFound();
-        this->checkPlayerWin();
-        this->onStaircase();
-        this->lightTorch();
-        this->hideCeiling();
-        this->playFootSteps();
-        renderer.render(&world);
+        scheduler.run(&world, (float)deltaTime);
+        // And finally we use the renderer system to draw the scene (its commands are extracted on the worker pool)
+        renderer->render(&world, &workers);
         // Get a reference to the keyboard object
         auto &keyboard = getApp()->getKeyboard();
 
+        if (keyboard.justPressed(GLFW_KEY_F3))
+            showSystemTimings = !showSystemTimings;
+
         if (keyboard.justPressed(GLFW_KEY_ESCAPE))
         {
             // If the escape  key is pressed in this frame, go to the play state
@@ -77,10 +134,13 @@ class Playstate : public our::State
     void onDestroy() override
     {
         // Don't forget to destroy the renderer
-        renderer.destroy();
+        renderer->destroy();
+        delete renderer;
+        renderer = nullptr;
         // // On exit, we call exit for the camera controller system to make sure that the mouse is unlocked
         cameraController.exit();
-        // // Clear the world
+        // // Clear the world (and the systems that were registered for it)
+        scheduler.clear();
         world.clear();
         // // and we delete all the loaded assets to free memory on the RAM and the VRAM
         our::clearAllAssets();
@@ -89,12 +149,11 @@ class Playstate : public our::State
         objectiveItems.clear();
         cameraEntity = nullptr;
         counterDisplay.clear();
-        torchLocations.clear();
         itemsHeight.clear();
-        gate = nullptr;
+        gate = our::EntityHandle();
         itemCount=0;
         torchCount=0;
-        ceiling=nullptr;
+        ceiling = our::EntityHandle();
     }
 
 private:
@@ -103,7 +162,8 @@ private:
     // Text that tells the player to pick up the item
     our::Entity *pickUpText = NULL;
     // positions of the items to be picked up
-    std::vector<our::Entity *> objectiveItems;
+    // The items (and the gate & ceiling below) are kept as handles so they become null instead of dangling if the entities are deleted
+    std::vector<our::EntityHandle> objectiveItems;
     // To get the position of the player
     our::Entity *cameraEntity = NULL;
     // Counter entities kept in a list
@@ -116,14 +176,15 @@ private:
     int torchCount=0;
     //Max. Number of torches to be lit
     const int MAX_TORCHES=5;
-    // Pointer to the exit gate
-    our::Entity *gate = nullptr;
-    // Torch locations that the player has to ignite during the game
-    std::vector<our::Entity *> torchLocations;
+    // Handle to the exit gate
+    our::EntityHandle gate;
+    // The names of the items and the torches that the player interacts with (they are found through the world's spatial grid)
+    our::Symbol itemName = our::Symbol("objectiveItem");
+    our::Symbol torchName = our::Symbol("torch");
     //vector of the original height of items
     std::vector<float> itemsHeight;
-    //pointer to the ceiling
-    our::Entity* ceiling=nullptr;
+    //handle to the ceiling
+    our::EntityHandle ceiling;
     //playTime of footsteps
     float playTime=0;
 
@@ -132,77 +193,58 @@ private:
 
     our::Entity *getCamera()
     {
-        our::CameraComponent *camera = nullptr;
-        our::FreeCameraControllerComponent *controller = nullptr;
-        for (auto entity : world.getEntities())
-        {
-            camera = entity->getComponent<our::CameraComponent>();
-            controller = entity->getComponent<our::FreeCameraControllerComponent>();
-            if (camera && controller)
-                return entity;
-        }
-        return NULL;
+        return world.view<our::CameraComponent, our::FreeCameraControllerComponent>().front();
     }
 
     our::Entity *getPickUpText()
     {
-        for (auto entity : world.getEntities())
-            if (entity->name == "textE")
-                return entity;
-
-        return NULL;
+        return world.findFirstByName("textE");
     }
     // fills the objectiveItemsPositions vector at the start of the game
     void initializeObjectiveItems()
     {
-        for (auto entity : world.getEntities())
-            if (entity->name == "objectiveItem")
+        for (auto entity : world.findByName("objectiveItem"))
             {
                 itemsHeight.push_back(entity->localTransform.position.y);
-                objectiveItems.push_back(entity);
+                objectiveItems.push_back(entity->getHandle());
                 entity->localTransform.position.y=-10;
             }
     }
-    void initializeTorchLocations()
-    {
-        for (auto entity : world.getEntities())
-            if (entity->name == "torch")
-                torchLocations.push_back(entity);
-    }
     // check if the one of the objective items is found & collect it e
     void checkItemFound()
     {
         const float minDistance = 0.75f;
         our::Entity *foundEntity = nullptr;
         const glm::vec3 &position = cameraEntity->localTransform.position;
-        for (auto entity : objectiveItems)
+        const glm::vec2 point(position.x, position.z);
+        // Only the entities around the player are visited
+        world.getSpatialGrid().visitBox(point - minDistance, point + minDistance, our::Symbol(), [&](const our::SpatialGrid::Entry &entry)
         {
-            if (entity->localTransform.position.y>=0&&abs(position.x - entity->localTransform.position.x) + abs(position.z - entity->localTransform.position.z) <= minDistance)
+            our::Entity *entity = entry.entity;
+            if (entity->getNameSymbol() == itemName && entity->localTransform.position.y>=0&&abs(point.x - entry.position.x) + abs(point.y - entry.position.y) <= minDistance)
             {
                 getApp()->itemFound=true;
                 foundEntity = entity;
-                break;
+                return true;
             }
-        }
+            return false;
+        });
         if (foundEntity && getApp()->getKeyboard().justPressed(GLFW_KEY_E))
         {
-            foundEntity->localTransform.position.y = -10;
-            foundEntity->localTransform.position.x = -100;
+            // The collected item is deleted when the commands are flushed (after the gameplay system), so the loops over the entities never see it disappear
+            world.getCommands().destroy(foundEntity);
             counterDisplay[itemCount]->localTransform.position.z = 1;
             counterDisplay[++itemCount]->localTransform.position.z = -1.5;
             if (itemCount == MAX_ITEMS)
             {
-                for (auto entity : world.getEntities())
-                {
-                    if (entity->name == "gate")
-                        gate = entity;
-                    if(entity->name=="ceiling")
-                        ceiling=entity;
-                    if(ceiling&&gate)
-                        break;
-                }
-                gate->getComponent<our::MovementComponent>()->linearVelocity = {0, 0.3, 0};
-                ceiling->getComponent<our::MovementComponent>()->linearVelocity = {0, 2, 0};
+                if (our::Entity *gateEntity = world.findFirstByName("gate"))
+                    gate = gateEntity->getHandle();
+                if (our::Entity *ceilingEntity = world.findFirstByName("ceiling"))
+                    ceiling = ceilingEntity->getHandle();
+                if (our::Entity *gateEntity = world.getEntity(gate))
+                    gateEntity->getMutableComponent<our::MovementComponent>()->linearVelocity = {0, 0.3, 0};
+                if (our::Entity *ceilingEntity = world.getEntity(ceiling))
+                    ceilingEntity->getMutableComponent<our::MovementComponent>()->linearVelocity = {0, 2, 0};
                 
             }
         }
@@ -214,15 +256,16 @@ private:
     void initializeCounterDisplay()
     {
         counterDisplay.resize(MAX_ITEMS + 1);
-        for (auto entity : world.getEntities())
-            if (entity->name.substr(0, 7) == "counter")
-                counterDisplay[entity->name[7] - '0'] = entity;
+        // The counters are named "counter0" to "counter5"
+        for (int count = 0; count <= MAX_ITEMS; ++count)
+            counterDisplay[count] = world.findFirstByName("counter" + std::to_string(count));
     }
     void checkPlayerWin()
     {
         float x = cameraEntity->localTransform.position.x;
         float z = cameraEntity->localTransform.position.z;
-        if (itemCount == MAX_ITEMS && x <= -10.45 && z <= 1.2 && z >= -1.2 && gate->localTransform.position.y >= 4.2)
+        our::Entity *gateEntity = world.getEntity(gate);
+        if (itemCount == MAX_ITEMS && gateEntity && x <= -10.45 && z <= 1.2 && z >= -1.2 && gateEntity->localTransform.position.y >= 4.2)
             getApp()->changeState("win");
         if (time >= 150)
             getApp()->changeState("lose");
@@ -248,30 +291,37 @@ private:
         const float minDistance = 1.0f;
         our::Entity *foundEntity = nullptr;
         const glm::vec3 &position = cameraEntity->localTransform.position;
+        const glm::vec2 point(position.x, position.z);
         bool* isEnabled=nullptr;
-        for (auto entity : torchLocations)
+        // Only the entities around the player are visited
+        world.getSpatialGrid().visitBox(point - minDistance, point + minDistance, our::Symbol(), [&](const our::SpatialGrid::Entry &entry)
         {
+            our::Entity *entity = entry.entity;
+            if (entity->getNameSymbol() != torchName)
+                return false;
             isEnabled=&entity->getComponent<our::LightComponent>()->enabled;
-            if (!*isEnabled&&entity->localTransform.position.y>=-1 && abs(position.x - entity->localTransform.position.x) + abs(position.z - entity->localTransform.position.z) <= minDistance)
+            if (!*isEnabled&&entity->localTransform.position.y>=-1 && abs(point.x - entry.position.x) + abs(point.y - entry.position.y) <= minDistance)
             {
                 getApp()->torchFound=true;
                 foundEntity = entity;
-                break;
+                return true;
             }
-        }
+            return false;
+        });
         if (foundEntity && getApp()->getKeyboard().justPressed(GLFW_KEY_E))
         {
             torchCount++;
             std::cout<<torchCount<<std::endl;
             *isEnabled=true;
-            foundEntity->getComponent<our::LightComponent>()->ambient=glm::vec3(1,1,1);
+            foundEntity->getMutableComponent<our::LightComponent>()->ambient=glm::vec3(1,1,1);
             pickUpText->localTransform.position.y = -10;
             if(torchCount==MAX_TORCHES)
             {
                 int i=0;
                 for(const float& height : itemsHeight)
                 {
-                    objectiveItems[i++]->localTransform.position.y=height;
+                    if(our::Entity *item = world.getEntity(objectiveItems[i++]))
+                        item->localTransform.position.y=height;
                 }
             }
         }
@@ -280,9 +330,11 @@ private:
     }
     void hideCeiling()
         {
-            if(ceiling && ceiling->localTransform.position.y>=30)
+            our::Entity *ceilingEntity = world.getEntity(ceiling);
+            // Once the ceiling is out of sight, it is deleted instead of being kept (and drawn) under the map
+            if(ceilingEntity && ceilingEntity->localTransform.position.y>=30)
             {
-                ceiling->localTransform.position.y=-100;
+                world.getCommands().destroy(ceilingEntity);
             }
         }
     void playFootSteps(){
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "benchmark-state.hpp"
+#include <asset-loader.hpp>
+#include <ecs/world.hpp>
+#include <components/camera.hpp>
+#include <components/light.hpp>
+#include <components/mesh-renderer.hpp>
+#include <systems/renderer.hpp>
+#include <deserialize-utils.hpp>
+
+#include <glm/glm.hpp>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+// This state compares the forward & the deferred renderers as the number of lights grows.
+// For every light count in the config, it builds a grid of lit objects under point lights of a limited range (plus a directional
+// light that reaches everything), then renders the same world with each renderer. The CPU time is the time spent in "render"
+// and the GPU time is measured by a timer query around the same calls (the queries are read two frames later so they rarely stall).
+class RendererBenchmarkState: public BenchmarkState {
+
+    struct Timings {
+        double cpu = 0, gpu = 0; // The average time per frame (in milliseconds)
+        size_t drawCalls = 0;
+    };
+
+    // Renders the world "warmup" frames (which are not measured) then "frames" frames and returns their average timings
+    static Timings measureFrames(our::Renderer* renderer, our::World* world, int warmup, int frames){
+        Timings timings;
+        GLuint queries[2];
+        glGenQueries(2, queries);
+        double gpuNanoseconds = 0;
+        // Reads the query of a finished frame (it only waits if the GPU is more than a frame behind)
+        auto readQuery = [&](int frame){
+            if(frame < warmup) return;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[frame & 1], GL_QUERY_RESULT, &elapsed);
+            gpuNanoseconds += double(elapsed);
+        };
+        for(int frame = 0; frame < warmup + frames; ++frame){
+            if(frame >= 2) readQuery(frame - 2);
+            glBeginQuery(GL_TIME_ELAPSED, queries[frame & 1]);
+            auto start = std::chrono::high_resolution_clock::now();
+            renderer->render(world);
+            auto end = std::chrono::high_resolution_clock::now();
+            glEndQuery(GL_TIME_ELAPSED);
+            if(frame >= warmup) timings.cpu += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        for(int frame = std::max(0, warmup + frames - 2); frame < warmup + frames; ++frame) readQuery(frame);
+        glDeleteQueries(2, queries);
+        timings.cpu /= double(frames > 0 ? frames : 1);
+        timings.gpu = gpuNanoseconds / 1e6 / double(frames > 0 ? frames : 1);
+        timings.drawCalls = renderer->getStats().drawCalls;
+        return timings;
+    }
+
+    void onInitialize() override {
+        auto& config = getBenchmarkConfig();
+        if(config.contains("assets")){
+            our::deserializeAllAssets(config["assets"]);
+        }
+        std::vector<int> lightCounts = config.value("lights", std::vector<int>{16, 64, 256, 1024});
+        std::vector<std::string> rendererTypes = config.value("renderers", std::vector<std::string>{"forward", "deferred"});
+        int frames = config.value("frames", 200);
+        int warmup = config.value("warmup", 20);
+        glm::ivec2 gridSize = config.value("grid", glm::ivec2(32, 32));
+        float spacing = config.value("spacing", 2.0f);
+        float lightRange = config.value("lightRange", 6.0f);
+        nlohmann::json rendererConfig = config.value("renderer", nlohmann::json::object());
+        our::Mesh* mesh = our::AssetLoader<our::Mesh>::get(config.value<std::string>("mesh", ""));
+        our::Material* material = our::AssetLoader<our::Material>::get(config.value<std::string>("material", ""));
+        if(!mesh || !material){
+            std::cerr << "The renderer benchmark needs a mesh & a material from the assets" << std::endl;
+            return;
+        }
+        glm::ivec2 size = getApp()->getFrameBufferSize();
+
+        std::cout << "Renderer benchmark (" << gridSize.x * gridSize.y << " objects, " << size.x << "x" << size.y
+                  << ", " << frames << " frames)" << std::endl;
+
+        for(int lightCount : lightCounts){
+            // Every light count gets its own world, which is drawn by all the renderers
+            our::World world;
+            std::mt19937 random(42);
+            glm::vec2 extent = 0.5f * spacing * glm::vec2(gridSize - 1);
+            std::uniform_real_distribution<float> x(-extent.x, extent.x), z(-extent.y, extent.y), height(0.5f, 2.0f), unit(0.0f, 1.0f);
+
+            // The camera looks down at the grid from behind its near edge
+            our::Entity* cameraEntity = world.add();
+            cameraEntity->localTransform.position = glm::vec3(0, 0.5f * extent.y, 1.25f * extent.y);
+            cameraEntity->localTransform.rotation = glm::vec3(-0.5f, 0, 0);
+            our::CameraComponent* camera = cameraEntity->addComponent<our::CameraComponent>();
+            camera->cameraType = our::CameraType::PERSPECTIVE;
+            camera->fovY = glm::radians(60.0f);
+            camera->orthoHeight = 1.0f;
+            camera->near = 0.1f;
+            camera->far = 4.0f * (extent.x + extent.y);
+
+            for(int row = 0; row < gridSize.y; ++row){
+                for(int column = 0; column < gridSize.x; ++column){
+                    our::Entity* entity = world.add();
+                    entity->localTransform.position = glm::vec3(column * spacing - extent.x, 0, row * spacing - extent.y);
+                    our::MeshRendererComponent* meshRenderer = entity->addComponent<our::MeshRendererComponent>();
+                    meshRenderer->mesh = mesh;
+                    meshRenderer->material = material;
+                }
+            }
+
+            // All the component fields are set since the components are not deserialized
+            auto addLight = [&](our::LightType type, const glm::vec3& position, const glm::vec3& color){
+                our::Entity* entity = world.add();
+                entity->localTransform.position = position;
+                our::LightComponent* light = entity->addComponent<our::LightComponent>();
+                light->lightType = type;
+                light->color = color;
+                light->diffuse = glm::vec3(1.0f);
+                light->specular = glm::vec3(0.5f);
+                light->ambient = glm::vec3(0.0f);
+                light->direction = glm::vec3(0, -1, 0);
+                light->position = position;
+                light->attenuation = {1.0f, 0.0f, 0.5f};
+                light->spot_angle = {0.0f, glm::radians(45.0f)};
+                light->range = lightRange;
+                return light;
+            };
+            // A dim directional light reaches every fragment (and gives the ambient light), the point lights are clustered
+            addLight(our::LightType::DIRECTIONAL, glm::vec3(0), glm::vec3(0.1f))->ambient = glm::vec3(0.1f);
+            for(int index = 0; index < lightCount; ++index)
+                addLight(our::LightType::POINT, glm::vec3(x(random), height(random), z(random)), glm::vec3(unit(random), unit(random), unit(random)));
+
+            std::cout << "  " << lightCount << " lights" << std::endl;
+            for(const std::string& type : rendererTypes){
+                rendererConfig["type"] = type;
+                our::Renderer* renderer = our::Renderer::create(rendererConfig);
+                renderer->initialize(size, rendererConfig);
+                Timings timings = measureFrames(renderer, &world, warmup, frames);
+                const our::RenderStats& stats = renderer->getStats();
+                std::cout << "    " << type << ": CPU " << timings.cpu << " ms, GPU " << timings.gpu << " ms ("
+                          << timings.drawCalls << " draw calls, " << stats.clusterLightIndices << " cluster entries)" << std::endl;
+                renderer->destroy();
+                delete renderer;
+            }
+
+            world.clear();
+        }
+
+        our::clearAllAssets();
+    }
+};
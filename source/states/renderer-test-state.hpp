@@ -4,14 +4,14 @@
 #include <ecs/world.hpp>
 #include <components/camera.hpp>
 #include <components/mesh-renderer.hpp>
-#include <systems/forward-renderer.hpp>
+#include <systems/renderer.hpp>
 #include <application.hpp>
 
-// This state tests and shows how to use the Forward renderer.
+// This state tests and shows how to use the renderers (forward or deferred).
 class RendererTestState: public our::State {
 
     our::World world;
-    our::ForwardRenderer renderer;
+    our::Renderer* renderer = nullptr;
     
     void onInitialize() override {
         // First of all, we get the scene configuration from the app config
@@ -27,15 +27,20 @@ class RendererTestState: public our::State {
         }
 
         glm::ivec2 size = getApp()->getFrameBufferSize();
-        renderer.initialize(size, config["renderer"]);
+        // The renderer's config picks the forward or the deferred renderer
+        renderer = our::Renderer::create(config["renderer"]);
+        renderer->initialize(size, config["renderer"]);
     }
 
     void onDraw(double deltaTime) override {
         // We simply call the renderer's "render" function and it should do all the rendering work
-        renderer.render(&world);
+        renderer->render(&world);
     }
 
     void onDestroy() override {
+        renderer->destroy();
+        delete renderer;
+        renderer = nullptr;
         world.clear();
         our::clearAllAssets();
     }
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "benchmark-state.hpp"
+#include <ecs/world.hpp>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+// This state measures how fast the proximity queries used by the gameplay (collisions & interactions) scale with the size of the world.
+// For every obstacle count in the config, it scatters the obstacles on the XZ plane then compares a linear scan over the tagged
+// entities (the previous implementation) against the world's spatial grid for box, radius and nearest neighbour queries.
+// The times are given per query.
+class SpatialBenchmarkState: public BenchmarkState {
+
+    void onInitialize() override {
+        auto& config = getBenchmarkConfig();
+        std::vector<int> obstacleCounts = config.value("obstacles", std::vector<int>{1000, 10000, 50000});
+        int queryCount = config.value("queries", 10000);
+        float density = config.value("density", 0.5f); // The number of obstacles per square unit
+        float radius = config.value("radius", 0.8f);
+        size_t nearestCount = config.value("nearest", 4);
+
+        const our::Symbol blockTag("block");
+        std::mt19937 random(42);
+        const Report report{"linear", "grid", "ns/query"};
+
+        std::cout << "Spatial query benchmark (" << queryCount << " queries, radius " << radius << ", "
+                  << nearestCount << " nearest)" << std::endl;
+
+        for(int obstacleCount : obstacleCounts){
+            // The area grows with the obstacle count so the number of obstacles around each query stays the same
+            float extent = 0.5f * std::sqrt(float(obstacleCount) / density);
+            std::uniform_real_distribution<float> coordinate(-extent, extent);
+
+            our::World world;
+            for(int index = 0; index < obstacleCount; ++index){
+                our::Entity* entity = world.add();
+                entity->localTransform.position = glm::vec3(coordinate(random), 1.5f, coordinate(random));
+                // Only half of the entities are obstacles, like the scenery which is mixed with the blocks in the game
+                if(index % 2 == 0) entity->addTag(blockTag);
+            }
+            world.updateTransforms();
+
+            std::vector<glm::vec2> queries(queryCount);
+            for(auto& query : queries) query = glm::vec2(coordinate(random), coordinate(random));
+
+            size_t linearChecksum = 0, gridChecksum = 0;
+            const auto& grid = world.getSpatialGrid();
+
+            // Pass 1: The collision check of the camera controller (is there any block within a manhattan distance)
+            double linearCollision = measure(queries.size(), [&](){
+                for(auto query : queries){
+                    for(auto entity : world.findByTag(blockTag)){
+                        const glm::vec3& position = entity->localTransform.position;
+                        if(std::abs(query.x - position.x) + std::abs(query.y - position.z) <= radius){ ++linearChecksum; break; }
+                    }
+                }
+            });
+            double gridCollision = measure(queries.size(), [&](){
+                for(auto query : queries){
+                    gridChecksum += grid.visitBox(query - radius, query + radius, blockTag, [&](const our::SpatialGrid::Entry& entry){
+                        return std::abs(query.x - entry.position.x) + std::abs(query.y - entry.position.y) <= radius;
+                    });
+                }
+            });
+
+            // Pass 2: Collect all the blocks within a radius
+            std::vector<our::Entity*> results;
+            double linearRadius = measure(queries.size(), [&](){
+                for(auto query : queries){
+                    results.clear();
+                    for(auto entity : world.findByTag(blockTag)){
+                        const glm::vec3& position = entity->localTransform.position;
+                        glm::vec2 offset = glm::vec2(position.x, position.z) - query;
+                        if(glm::dot(offset, offset) <= radius * radius) results.push_back(entity);
+                    }
+                    linearChecksum += results.size();
+                }
+            });
+            double gridRadius = measure(queries.size(), [&](){
+                for(auto query : queries){
+                    results.clear();
+                    grid.queryRadius(query, radius, results, blockTag);
+                    gridChecksum += results.size();
+                }
+            });
+
+            // Pass 3: Find the nearest blocks (sorting the distances to all the blocks in the linear version)
+            std::vector<std::pair<float, our::Entity*>> distances;
+            double linearNearest = measure(queries.size(), [&](){
+                for(auto query : queries){
+                    distances.clear();
+                    for(auto entity : world.findByTag(blockTag)){
+                        const glm::vec3& position = entity->localTransform.position;
+                        glm::vec2 offset = glm::vec2(position.x, position.z) - query;
+                        distances.emplace_back(glm::dot(offset, offset), entity);
+                    }
+                    size_t count = std::min(nearestCount, distances.size());
+                    std::partial_sort(distances.begin(), distances.begin() + count, distances.end());
+                    linearChecksum += count;
+                }
+            });
+            double gridNearest = measure(queries.size(), [&](){
+                for(auto query : queries){
+                    results.clear();
+                    grid.queryNearest(query, nearestCount, results, blockTag);
+                    gridChecksum += results.size();
+                }
+            });
+
+            std::cout << "  " << obstacleCount << " entities (" << world.findByTag(blockTag).size() << " blocks)" << std::endl;
+            report("Collision check", linearCollision, gridCollision);
+            report("Radius query", linearRadius, gridRadius);
+            report("Nearest query", linearNearest, gridNearest);
+            std::cout << "    Checksums: " << linearChecksum << " / " << gridChecksum << std::endl;
+
+            world.clear();
+        }
+    }
+};